@@ -0,0 +1,41 @@
+#version 330 core
+
+// Input: the unit box
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 2) in vec3 vertexNormal;
+layout(location = 3) in vec2 vertexUV;
+
+// Input: one building per instance
+layout(location = 4) in vec4 instancePositionYaw;
+layout(location = 5) in vec4 instanceSizeLayer;
+layout(location = 6) in vec2 instanceUVScale;
+
+// Output data, the same as scene.vert so scene.frag shades the buildings
+out vec3 color;
+
+out vec3 worldPosition;
+out vec3 worldNormal;
+out vec4 fragPosLightSpace;
+
+out vec2 uv;
+flat out float material;
+
+void main() {
+    // Scale the box to the building, turn it about y and move it into place
+    float s = sin(instancePositionYaw.w);
+    float c = cos(instancePositionYaw.w);
+    mat3 rotation = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+    worldPosition = instancePositionYaw.xyz + rotation * (vertexPosition * instanceSizeLayer.xyz);
+    worldNormal = rotation * vertexNormal;
+
+    gl_Position = viewProjection * vec4(worldPosition, 1);
+
+    color = baseColor.rgb;
+
+    // Walls repeat their texture with the building's size, the roof does not
+    uv = vertexNormal.y > 0.5 ? vertexUV : vertexUV * instanceUVScale;
+    material = instanceSizeLayer.w;
+
+    // Transform position into light space
+    fragPosLightSpace = lightSpaceMatrix * vec4(worldPosition, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+
+layout(location = 0) in vec3 aPos;
+layout(location = 4) in vec4 instancePositionYaw;
+layout(location = 5) in vec4 instanceSizeLayer;
+
+void main()
+{
+    float s = sin(instancePositionYaw.w);
+    float c = cos(instancePositionYaw.w);
+    mat3 rotation = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+    vec3 worldPosition = instancePositionYaw.xyz + rotation * (aPos * instanceSizeLayer.xyz);
+    gl_Position = viewProjection * vec4(worldPosition, 1.0);
+}
@@ -0,0 +1,111 @@
+// Prepended by the shader library to every shader after the #version line
+// and its defines, with VERTEX_SHADER or FRAGMENT_SHADER defined for the
+// stage being compiled.
+
+// Must match the blocks in render/frame_uniforms.h and MAX_SHADOW_CASCADES
+// in render/shadow_cascades.h
+#define MAX_SHADOW_CASCADES 4
+layout(std140) uniform FrameUniforms {
+    mat4 lightSpaceMatrix;
+    vec3 lightPosition;
+    vec3 lightIntensity;
+    vec4 cascadeCrops[MAX_SHADOW_CASCADES]; // Scale and offset of x and y
+    float cascadeScales[MAX_SHADOW_CASCADES];
+    int cascadeCount;
+};
+
+layout(std140) uniform ViewUniforms {
+    mat4 viewProjection; // Camera or shadow cascade
+};
+
+layout(std140) uniform ObjectUniforms {
+    mat4 model; // Unused by instanced draws
+    vec4 baseColor; // Constant color of the draw
+};
+
+#ifdef FRAGMENT_SHADER
+uniform sampler2DArrayShadow shadowMap;
+
+// Shadow filter, compiled in through the shader library's defines
+// (--shadow-filter): 1, 4, 9 or 16 taps on a grid one texel apart, or 0 for
+// 8 Poisson disk taps rotated per pixel. Every tap is itself a bilinear
+// blend of four depth comparisons.
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER 1
+#endif
+
+#if SHADOW_FILTER == 4
+#define SHADOW_FILTER_SIDE 2
+#elif SHADOW_FILTER == 9
+#define SHADOW_FILTER_SIDE 3
+#elif SHADOW_FILTER == 16
+#define SHADOW_FILTER_SIDE 4
+#elif SHADOW_FILTER != 0 && SHADOW_FILTER != 1
+#error SHADOW_FILTER must be 0, 1, 4, 9 or 16
+#endif
+
+#if SHADOW_FILTER == 0
+const vec2 poissonDisk[8] = vec2[](
+    vec2(-0.613392, 0.617481), vec2(0.170019, -0.040254),
+    vec2(-0.299417, 0.791925), vec2(0.645680, 0.493210),
+    vec2(-0.651784, 0.717887), vec2(0.421003, 0.027070),
+    vec2(-0.817194, -0.271096), vec2(0.977050, -0.108615)
+);
+#endif
+
+// Fraction of the taps around coords that are lit; coordsMin and coordsMax
+// keep the taps inside the cascade's corner of the layer
+float filterShadow(vec2 coords, float layer, float depth, vec2 coordsMin, vec2 coordsMax) {
+#if SHADOW_FILTER == 1
+    return texture(shadowMap, vec4(clamp(coords, coordsMin, coordsMax), layer, depth));
+#else
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+#if SHADOW_FILTER == 0
+    // Interleaved gradient noise turns the disk differently at every pixel
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    for (int i = 0; i < 8; ++i) {
+        vec2 tap = coords + rotation * poissonDisk[i] * (1.5 * texel);
+        lit += texture(shadowMap, vec4(clamp(tap, coordsMin, coordsMax), layer, depth));
+    }
+    return lit / 8.0;
+#else
+    for (int y = 0; y < SHADOW_FILTER_SIDE; ++y) {
+        for (int x = 0; x < SHADOW_FILTER_SIDE; ++x) {
+            vec2 tap = coords + (vec2(x, y) - 0.5 * float(SHADOW_FILTER_SIDE - 1)) * texel;
+            lit += texture(shadowMap, vec4(clamp(tap, coordsMin, coordsMax), layer, depth));
+        }
+    }
+    return lit / float(SHADOW_FILTER_SIDE * SHADOW_FILTER_SIDE);
+#endif
+#endif
+}
+
+// Cascaded shadow maps: every cascade crops the light's x and y, so one
+// light-space position serves all of them. The first cascade whose map
+// covers the fragment decides; it uses the corner of its layer given by
+// cascadeScales. Acne is prevented by the polygon offset of the depth pass.
+float calculateShadow(vec4 fragPosLightSpace) {
+    if (fragPosLightSpace.w <= 0.0) return 1.0;
+
+    // Perform perspective divide
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+
+    // Transform depth to [0, 1] range
+    float currentDepth = projCoords.z * 0.5 + 0.5;
+    if (currentDepth > 1.0) return 1.0;
+
+    for (int i = 0; i < cascadeCount; ++i) {
+        vec2 cascadeCoords = projCoords.xy * cascadeCrops[i].xy + cascadeCrops[i].zw;
+        if (any(greaterThanEqual(abs(cascadeCoords), vec2(1.0)))) continue;
+
+        // Compare against the shadow map and return shadow factor
+        cascadeCoords = (cascadeCoords * 0.5 + 0.5) * cascadeScales[i];
+        vec2 halfTexel = 0.5 / vec2(textureSize(shadowMap, 0).xy);
+        float lit = filterShadow(cascadeCoords, float(i), currentDepth, halfTexel, vec2(cascadeScales[i]) - halfTexel);
+        return mix(0.2, 1.0, lit);
+    }
+    return 1.0;
+}
+#endif
@@ -0,0 +1,213 @@
+#include "base64.h"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+// Decoded 6-bit value per character, -1 outside the alphabet
+struct DecodeTable {
+	signed char values[256];
+
+	DecodeTable()
+	{
+		const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		memset(values, -1, sizeof(values));
+		for (int i = 0; i < 64; ++i) values[(unsigned char)alphabet[i]] = (signed char)i;
+	}
+};
+
+static bool decodeScalar(const char *src, size_t length, unsigned char *dst, size_t &written)
+{
+	static const DecodeTable table;
+	const signed char *decodeTable = table.values;
+
+	size_t out = 0;
+	for (size_t i = 0; i < length; i += 4) {
+		int a = decodeTable[(unsigned char)src[i]];
+		int b = decodeTable[(unsigned char)src[i + 1]];
+		if (a < 0 || b < 0) return false;
+		dst[out++] = (unsigned char)(a << 2 | b >> 4);
+
+		// Padding is only allowed in the last quad
+		bool last = i + 4 == length;
+		if (last && src[i + 2] == '=' && src[i + 3] == '=') break;
+		int c = decodeTable[(unsigned char)src[i + 2]];
+		if (c < 0) return false;
+		dst[out++] = (unsigned char)(b << 4 | c >> 2);
+
+		if (last && src[i + 3] == '=') break;
+		int d = decodeTable[(unsigned char)src[i + 3]];
+		if (d < 0) return false;
+		dst[out++] = (unsigned char)(c << 6 | d);
+	}
+	written = out;
+	return true;
+}
+
+#ifdef BASE64_X86
+
+// Vector decoding after Muła and Lemire: the high and low nibble of every 
+// character index two small tables whose AND is zero only for valid input, 
+// a third table yields the offset that maps the character to its 6-bit 
+// value, and two multiply-adds pack four 6-bit values into three bytes.
+// The store writes 4 (SSSE3) or 8 (AVX2) bytes past the decoded ones.
+
+__attribute__((target("ssse3")))
+static size_t decodeSSSE3(const char *src, size_t length, unsigned char *dst, size_t &consumed)
+{
+	const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+	const __m128i slash = _mm_set1_epi8(0x2F);
+	const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	size_t in = 0, out = 0;
+	// 32 characters left guarantee 16 writable bytes even after padding
+	while (length - in >= 32) {
+		__m128i str = _mm_loadu_si128((const __m128i *)(src + in));
+		__m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), nibbleMask);
+		__m128i loNibbles = _mm_and_si128(str, nibbleMask);
+		__m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+		__m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+		if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0) break;
+
+		__m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(str, slash), hiNibbles));
+		str = _mm_add_epi8(str, roll);
+
+		__m128i merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+		merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		_mm_storeu_si128((__m128i *)(dst + out), _mm_shuffle_epi8(merged, pack));
+
+		in += 16;
+		out += 12;
+	}
+	consumed = in;
+	return out;
+}
+
+__attribute__((target("avx2")))
+static size_t decodeAVX2(const char *src, size_t length, unsigned char *dst, size_t &consumed)
+{
+	const __m256i lutLo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i lutHi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lutRoll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+	const __m256i slash = _mm256_set1_epi8(0x2F);
+	const __m256i pack = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+	size_t in = 0, out = 0;
+	// 64 characters left guarantee 32 writable bytes even after padding
+	while (length - in >= 64) {
+		__m256i str = _mm256_loadu_si256((const __m256i *)(src + in));
+		__m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), nibbleMask);
+		__m256i loNibbles = _mm256_and_si256(str, nibbleMask);
+		__m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+		__m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+		if (!_mm256_testz_si256(lo, hi)) break;
+
+		__m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(str, slash), hiNibbles));
+		str = _mm256_add_epi8(str, roll);
+
+		__m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+		merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+		merged = _mm256_shuffle_epi8(merged, pack);
+		// Move the 12 bytes of the upper lane next to those of the lower one
+		_mm256_storeu_si256((__m256i *)(dst + out), _mm256_permutevar8x32_epi32(merged, lanes));
+
+		in += 32;
+		out += 24;
+	}
+	consumed = in;
+	return out;
+}
+
+enum Base64Path { PATH_SCALAR, PATH_SSSE3, PATH_AVX2 };
+
+static Base64Path selectPath()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return PATH_AVX2;
+	if (__builtin_cpu_supports("ssse3")) return PATH_SSSE3;
+	return PATH_SCALAR;
+}
+
+#endif
+
+bool Base64Decode(const char *src, size_t length, unsigned char *dst, size_t &written)
+{
+	written = 0;
+	if (length % 4 != 0) return false;
+
+	size_t consumed = 0, out = 0;
+#ifdef BASE64_X86
+	static const Base64Path decodePath = selectPath();
+	if (decodePath == PATH_AVX2) out = decodeAVX2(src, length, dst, consumed);
+	if (decodePath != PATH_SCALAR) {
+		size_t more = 0;
+		out += decodeSSSE3(src + consumed, length - consumed, dst + out, more);
+		consumed += more;
+	}
+#endif
+
+	// The tail, the padding and any invalid input go through the table
+	size_t tail = 0;
+	if (!decodeScalar(src + consumed, length - consumed, dst + out, tail)) return false;
+	written = out + tail;
+	return true;
+}
+
+Base64Stream::Base64Stream() : carryCount(0), padded(false)
+{
+}
+
+bool Base64Stream::push(const char *src, size_t length, unsigned char *dst, size_t &written)
+{
+	written = 0;
+	if (length == 0) return true;
+	if (padded) return false; // nothing may follow the padding
+
+	// Complete the quad left over from the previous piece
+	if (carryCount > 0) {
+		while (carryCount < 4 && length > 0) {
+			carry[carryCount++] = *src++;
+			--length;
+		}
+		if (carryCount < 4) return true;
+		size_t bytes = 0;
+		if (!Base64Decode(carry, 4, dst, bytes)) return false;
+		padded = carry[3] == '=';
+		written = bytes;
+		dst += bytes;
+		carryCount = 0;
+		if (padded && length > 0) return false;
+	}
+
+	size_t whole = length / 4 * 4;
+	size_t bytes = 0;
+	if (!Base64Decode(src, whole, dst, bytes)) return false;
+	if (whole > 0) padded = src[whole - 1] == '=';
+	written += bytes;
+
+	carryCount = (int)(length - whole);
+	memcpy(carry, src + whole, carryCount);
+	if (padded && carryCount > 0) return false;
+	return true;
+}
+
+bool Base64Stream::finish() const
+{
+	return carryCount == 0;
+}
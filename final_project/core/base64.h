@@ -0,0 +1,31 @@
+#ifndef _BASE64_H_
+#define _BASE64_H_
+
+#include <cstddef>
+
+// Upper bound of the bytes decoded from length base64 characters
+inline size_t Base64DecodedSize(size_t length) { return length / 4 * 3; }
+
+// Decodes length base64 characters (a multiple of 4; only the last quad may 
+// carry '=' padding) into dst, which must hold Base64DecodedSize(length) 
+// bytes. Uses AVX2 or SSSE3 when the CPU has them. Returns false on 
+// characters outside the standard alphabet.
+bool Base64Decode(const char *src, size_t length, unsigned char *dst, size_t &written);
+
+// Incremental decoder for base64 text that arrives in arbitrary pieces
+struct Base64Stream {
+	char carry[4];
+	int carryCount;
+	bool padded;
+
+	Base64Stream();
+
+	// Decodes every complete quad of src (plus carried characters) to dst, 
+	// which must hold Base64DecodedSize(length + 3) bytes
+	bool push(const char *src, size_t length, unsigned char *dst, size_t &written);
+
+	// True when no partial quad is left over
+	bool finish() const;
+};
+
+#endif
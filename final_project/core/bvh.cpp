@@ -0,0 +1,311 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+AABB::AABB() : min(0.0f), max(0.0f)
+{
+}
+
+AABB::AABB(const glm::vec3 &min, const glm::vec3 &max) : min(min), max(max)
+{
+}
+
+bool AABB::contains(const AABB &other) const
+{
+	return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+		&& other.max.x <= max.x && other.max.y <= max.y && other.max.z <= max.z;
+}
+
+float AABB::surfaceArea() const
+{
+	glm::vec3 d = max - min;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+AABB Union(const AABB &a, const AABB &b)
+{
+	return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+AABB TransformAABB(const AABB &box, const glm::mat4 &transform)
+{
+	// Centre and extent form: the new extent is |M| times the old one
+	glm::vec3 centre = 0.5f * (box.min + box.max);
+	glm::vec3 extent = 0.5f * (box.max - box.min);
+	glm::vec3 newCentre = glm::vec3(transform * glm::vec4(centre, 1.0f));
+	glm::vec3 newExtent(0.0f);
+	for (int column = 0; column < 3; ++column) {
+		newExtent += glm::abs(glm::vec3(transform[column])) * extent[column];
+	}
+	return AABB(newCentre - newExtent, newCentre + newExtent);
+}
+
+void ExtractFrustum(const glm::mat4 &viewProjection, Frustum &frustum)
+{
+	// Gribb-Hartmann: the planes are sums and differences of the matrix rows
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; ++i) {
+		row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+	frustum.planes[0] = row[3] + row[0];
+	frustum.planes[1] = row[3] - row[0];
+	frustum.planes[2] = row[3] + row[1];
+	frustum.planes[3] = row[3] - row[1];
+	frustum.planes[4] = row[3] + row[2];
+	frustum.planes[5] = row[3] - row[2];
+}
+
+AABBTree::AABBTree(float margin) : root(-1), freeList(-1), leafCount(0), margin(margin)
+{
+}
+
+int AABBTree::allocateNode()
+{
+	int node;
+	if (freeList >= 0) {
+		node = freeList;
+		freeList = nodes[node].parent;
+	} else {
+		node = (int)nodes.size();
+		nodes.push_back(Node());
+	}
+	Node &n = nodes[node];
+	n.parent = -1;
+	n.child[0] = -1;
+	n.child[1] = -1;
+	n.height = 0;
+	n.userData = -1;
+	return node;
+}
+
+void AABBTree::freeNode(int node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+int AABBTree::insert(const AABB &box, int userData)
+{
+	int leaf = allocateNode();
+	nodes[leaf].box = AABB(box.min - glm::vec3(margin), box.max + glm::vec3(margin));
+	nodes[leaf].userData = userData;
+	insertLeaf(leaf);
+	++leafCount;
+	return leaf;
+}
+
+void AABBTree::remove(int proxy)
+{
+	removeLeaf(proxy);
+	freeNode(proxy);
+	--leafCount;
+}
+
+bool AABBTree::move(int proxy, const AABB &box)
+{
+	if (nodes[proxy].box.contains(box)) return false;
+
+	removeLeaf(proxy);
+	nodes[proxy].box = AABB(box.min - glm::vec3(margin), box.max + glm::vec3(margin));
+	insertLeaf(proxy);
+	return true;
+}
+
+void AABBTree::insertLeaf(int leaf)
+{
+	if (root < 0) {
+		root = leaf;
+		nodes[root].parent = -1;
+		return;
+	}
+
+	// Walk down towards the sibling that grows the tree's surface area least
+	AABB leafBox = nodes[leaf].box;
+	int index = root;
+	while (nodes[index].child[0] >= 0) {
+		float area = nodes[index].box.surfaceArea();
+		float combinedArea = Union(nodes[index].box, leafBox).surfaceArea();
+
+		// Cost of pairing the leaf with this node, and the growth every
+		// ancestor below it pays for taking the leaf
+		float cost = 2.0f * combinedArea;
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float childCost[2];
+		for (int i = 0; i < 2; ++i) {
+			const Node &child = nodes[nodes[index].child[i]];
+			float grown = Union(leafBox, child.box).surfaceArea();
+			childCost[i] = (child.child[0] < 0 ? grown : grown - child.box.surfaceArea()) + inheritanceCost;
+		}
+
+		if (cost < childCost[0] && cost < childCost[1]) break;
+		index = childCost[0] < childCost[1] ? nodes[index].child[0] : nodes[index].child[1];
+	}
+
+	// Replace the sibling with a new parent of the sibling and the leaf
+	int sibling = index;
+	int oldParent = nodes[sibling].parent;
+	int newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].box = Union(leafBox, nodes[sibling].box);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child[0] = sibling;
+	nodes[newParent].child[1] = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+	if (oldParent >= 0) {
+		int slot = nodes[oldParent].child[0] == sibling ? 0 : 1;
+		nodes[oldParent].child[slot] = newParent;
+	} else {
+		root = newParent;
+	}
+
+	// Refit and rebalance the ancestors
+	for (index = nodes[leaf].parent; index >= 0; index = nodes[index].parent) {
+		index = balance(index);
+		const Node &a = nodes[nodes[index].child[0]];
+		const Node &b = nodes[nodes[index].child[1]];
+		nodes[index].height = 1 + std::max(a.height, b.height);
+		nodes[index].box = Union(a.box, b.box);
+	}
+}
+
+void AABBTree::removeLeaf(int leaf)
+{
+	if (leaf == root) {
+		root = -1;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = nodes[parent].child[0] == leaf ? nodes[parent].child[1] : nodes[parent].child[0];
+
+	if (grandParent < 0) {
+		root = sibling;
+		nodes[sibling].parent = -1;
+		freeNode(parent);
+		return;
+	}
+
+	// The sibling takes the parent's place
+	int slot = nodes[grandParent].child[0] == parent ? 0 : 1;
+	nodes[grandParent].child[slot] = sibling;
+	nodes[sibling].parent = grandParent;
+	freeNode(parent);
+
+	for (int index = grandParent; index >= 0; index = nodes[index].parent) {
+		index = balance(index);
+		const Node &a = nodes[nodes[index].child[0]];
+		const Node &b = nodes[nodes[index].child[1]];
+		nodes[index].height = 1 + std::max(a.height, b.height);
+		nodes[index].box = Union(a.box, b.box);
+	}
+}
+
+// Rotates the taller child of a up when the children's heights differ by
+// more than one; returns the node now at a's place
+int AABBTree::balance(int a)
+{
+	if (nodes[a].child[0] < 0 || nodes[a].height < 2) return a;
+
+	for (int side = 0; side < 2; ++side) {
+		int low = nodes[a].child[side];      // Stays below a
+		int high = nodes[a].child[1 - side]; // Becomes a's parent
+		if (nodes[high].height - nodes[low].height <= 1) continue;
+
+		int f = nodes[high].child[0];
+		int g = nodes[high].child[1];
+
+		// high takes a's place
+		nodes[high].child[0] = a;
+		nodes[high].parent = nodes[a].parent;
+		nodes[a].parent = high;
+		if (nodes[high].parent >= 0) {
+			int parent = nodes[high].parent;
+			int slot = nodes[parent].child[0] == a ? 0 : 1;
+			nodes[parent].child[slot] = high;
+		} else {
+			root = high;
+		}
+
+		// The taller grandchild stays with high, the other moves under a
+		int keep = nodes[f].height > nodes[g].height ? f : g;
+		int give = keep == f ? g : f;
+		nodes[high].child[1] = keep;
+		nodes[a].child[1 - side] = give;
+		nodes[give].parent = a;
+
+		nodes[a].box = Union(nodes[low].box, nodes[give].box);
+		nodes[a].height = 1 + std::max(nodes[low].height, nodes[give].height);
+		nodes[high].box = Union(nodes[a].box, nodes[keep].box);
+		nodes[high].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+		return high;
+	}
+	return a;
+}
+
+void AABBTree::collectLeaves(int node, std::vector<int> &userData) const
+{
+	if (nodes[node].child[0] < 0) {
+		userData.push_back(nodes[node].userData);
+		return;
+	}
+	collectLeaves(nodes[node].child[0], userData);
+	collectLeaves(nodes[node].child[1], userData);
+}
+
+void AABBTree::query(const Frustum &frustum, std::vector<int> &userData) const
+{
+	if (root < 0) return;
+
+	// Each entry carries the planes its box still straddles; a subtree
+	// entirely inside a plane is not tested against it again
+	std::vector<std::pair<int, int> > stack;
+	stack.push_back(std::make_pair(root, 0x3f));
+	while (!stack.empty()) {
+		int index = stack.back().first;
+		int mask = stack.back().second;
+		stack.pop_back();
+
+		const Node &node = nodes[index];
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p) {
+			if (!(mask & (1 << p))) continue;
+			const glm::vec4 &plane = frustum.planes[p];
+
+			// Corners furthest along and against the plane normal
+			glm::vec3 positive(plane.x >= 0.0f ? node.box.max.x : node.box.min.x,
+				plane.y >= 0.0f ? node.box.max.y : node.box.min.y,
+				plane.z >= 0.0f ? node.box.max.z : node.box.min.z);
+			glm::vec3 negative(plane.x >= 0.0f ? node.box.min.x : node.box.max.x,
+				plane.y >= 0.0f ? node.box.min.y : node.box.max.y,
+				plane.z >= 0.0f ? node.box.min.z : node.box.max.z);
+			if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) outside = true;
+			else if (glm::dot(glm::vec3(plane), negative) + plane.w >= 0.0f) mask &= ~(1 << p);
+		}
+		if (outside) continue;
+
+		if (mask == 0 || node.child[0] < 0) {
+			collectLeaves(index, userData);
+		} else {
+			stack.push_back(std::make_pair(node.child[0], mask));
+			stack.push_back(std::make_pair(node.child[1], mask));
+		}
+	}
+}
+
+int AABBTree::height() const
+{
+	return root < 0 ? 0 : nodes[root].height;
+}
+
+void AABBTree::clear()
+{
+	nodes.clear();
+	root = -1;
+	freeList = -1;
+	leafCount = 0;
+}
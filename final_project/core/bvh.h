@@ -0,0 +1,75 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct AABB {
+	glm::vec3 min;
+	glm::vec3 max;
+
+	AABB();
+	AABB(const glm::vec3 &min, const glm::vec3 &max);
+
+	bool contains(const AABB &other) const;
+	float surfaceArea() const;
+};
+
+AABB Union(const AABB &a, const AABB &b);
+
+// Bounds of box after transform
+AABB TransformAABB(const AABB &box, const glm::mat4 &transform);
+
+// The six planes (left, right, bottom, top, near, far) of a view frustum,
+// facing inwards, taken from projection * view. The planes are not
+// normalized, which does not matter for inside/outside tests.
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+void ExtractFrustum(const glm::mat4 &viewProjection, Frustum &frustum);
+
+// Dynamic AABB tree over scene objects. Leaves hold an object's bounds
+// grown by margin, so an object that moves a little keeps its leaf; one
+// that leaves its fat box is removed and reinserted, and the tree is kept
+// balanced by rotations on the way back up.
+struct AABBTree {
+	struct Node {
+		AABB box;
+		int parent;   // Next free node while on the free list
+		int child[2]; // -1 for leaves
+		int height;   // 0 for leaves, -1 for free nodes
+		int userData;
+	};
+
+	std::vector<Node> nodes;
+	int root;
+	int freeList;
+	int leafCount;
+	float margin;
+
+	AABBTree(float margin = 50.0f);
+
+	// Returns a proxy for box; userData is what queries report
+	int insert(const AABB &box, int userData);
+	void remove(int proxy);
+
+	// Updates a proxy's bounds; true when it had to be reinserted
+	bool move(int proxy, const AABB &box);
+
+	// Appends the user data of every leaf that intersects the frustum
+	void query(const Frustum &frustum, std::vector<int> &userData) const;
+
+	int height() const;
+	void clear();
+
+	int allocateNode();
+	void freeNode(int node);
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	int balance(int node);
+	void collectLeaves(int node, std::vector<int> &userData) const;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "frame_clock.h"
+
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+FixedTimestep::FixedTimestep(double step, int maxSteps)
+	: step(step), maxSteps(maxSteps), accumulator(0.0), steps(0), droppedTime(0.0)
+{
+}
+
+void FixedTimestep::setRate(double stepsPerSecond)
+{
+	if (stepsPerSecond > 0.0) step = 1.0 / stepsPerSecond;
+}
+
+int FixedTimestep::advance(double seconds)
+{
+	if (seconds > 0.0) accumulator += seconds;
+
+	int count = 0;
+	while (accumulator >= step && count < maxSteps) {
+		accumulator -= step;
+		++count;
+	}
+
+	// After a stall (a breakpoint, a window drag) keep less than a step
+	// rather than running many steps to catch up with real time
+	if (accumulator >= step) {
+		double dropped = std::floor(accumulator / step) * step;
+		accumulator -= dropped;
+		droppedTime += dropped;
+	}
+
+	steps += count;
+	return count;
+}
+
+float FixedTimestep::alpha() const
+{
+	return (float)(accumulator / step);
+}
+
+void FixedTimestep::reset()
+{
+	accumulator = 0.0;
+	steps = 0;
+	droppedTime = 0.0;
+}
+
+FrameLimiter::FrameLimiter() : interval(0.0), started(false), waited(0.0)
+{
+}
+
+void FrameLimiter::setRate(double framesPerSecond)
+{
+	interval = framesPerSecond > 0.0 ? 1.0 / framesPerSecond : 0.0;
+	started = false;
+}
+
+void FrameLimiter::wait()
+{
+	typedef std::chrono::steady_clock clock;
+	if (interval <= 0.0) return;
+
+	clock::duration period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(interval));
+	clock::time_point now = clock::now();
+	if (!started) {
+		next = now + period;
+		started = true;
+		return;
+	}
+
+	clock::time_point start = now;
+	clock::duration spin = std::chrono::milliseconds(1);
+	if (next - now > spin) std::this_thread::sleep_until(next - spin);
+	while ((now = clock::now()) < next) std::this_thread::yield();
+	waited += std::chrono::duration<double>(now - start).count();
+
+	// A frame that ran late moves the schedule instead of being followed by
+	// a burst of frames without waits
+	next += period;
+	if (next < now) next = now + period;
+}
+
+FramePacing::FramePacing(size_t window) : intervals(window), targetMs(0.0), started(false)
+{
+}
+
+void FramePacing::tick()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (started) intervals.add(std::chrono::duration<double, std::milli>(now - last).count());
+	last = now;
+	started = true;
+}
+
+void FramePacing::clear()
+{
+	intervals.clear();
+	started = false;
+}
+
+void FramePacing::print() const
+{
+	if (intervals.count() == 0) return;
+
+	double mean = intervals.avg();
+	double variance = 0.0;
+	for (size_t i = 0; i < intervals.samples.size(); ++i) {
+		double d = intervals.samples[i] - mean;
+		variance += d * d;
+	}
+	double deviation = std::sqrt(variance / intervals.samples.size());
+
+	double target = targetMs > 0.0 ? targetMs : intervals.percentile(50.0);
+	size_t late = 0;
+	for (size_t i = 0; i < intervals.samples.size(); ++i) {
+		if (intervals.samples[i] > 1.5 * target) ++late;
+	}
+
+	printf("Frame pacing: interval avg %.3f ms (%.1f fps), p99 %.3f ms, deviation %.3f ms, %zu of %zu frames over 1.5x the %s interval of %.3f ms\n",
+		mean, mean > 0.0 ? 1000.0 / mean : 0.0, intervals.percentile(99.0), deviation, late, intervals.count(),
+		targetMs > 0.0 ? "target" : "median", target);
+}
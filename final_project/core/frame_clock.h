@@ -0,0 +1,72 @@
+#ifndef _FRAME_CLOCK_H_
+#define _FRAME_CLOCK_H_
+
+#include "frame_stats.h"
+
+#include <chrono>
+
+// Timing of the main loop: a fixed-timestep simulation clock, a frame
+// limiter and frame pacing statistics.
+
+// Real time is accumulated and consumed in steps of exactly step seconds,
+// so the simulation does the same work in the same order whatever the frame
+// rate. The time left over, less than one step, is what rendering
+// interpolates across (see alpha).
+struct FixedTimestep {
+	double step;         // Seconds per simulation step
+	int maxSteps;        // Per frame; longer stalls are dropped instead of caught up
+	double accumulator;  // Real time not yet simulated
+	long long steps;
+	double droppedTime;  // Seconds dropped by stalls
+
+	FixedTimestep(double step = 1.0 / 60.0, int maxSteps = 8);
+
+	void setRate(double stepsPerSecond);
+
+	// Adds seconds of real time and returns how many steps to simulate now
+	int advance(double seconds);
+
+	// How far real time is between the last two simulated states, in [0, 1)
+	float alpha() const;
+
+	void reset();
+};
+
+// Holds the loop to a target frame rate on the CPU, for when swap interval
+// pacing is off or unavailable (headless). Sleeps most of the wait and spins
+// the last millisecond, since sleeps overshoot.
+struct FrameLimiter {
+	double interval; // Seconds per frame, 0 for unlimited
+	std::chrono::steady_clock::time_point next;
+	bool started;
+	double waited;   // Seconds spent in wait()
+
+	FrameLimiter();
+
+	void setRate(double framesPerSecond);
+
+	// Returns once the next frame is due
+	void wait();
+};
+
+// Intervals between the starts of consecutive frames. Unlike frame times,
+// these include everything the loop does, so they show what the viewer
+// sees: how steady presentation is, not just how fast rendering is.
+struct FramePacing {
+	FrameStats intervals;
+	double targetMs; // Expected interval, 0 to compare against the median
+	std::chrono::steady_clock::time_point last;
+	bool started;
+
+	FramePacing(size_t window = 0);
+
+	// Call once per frame, at the same point of the loop
+	void tick();
+	void clear();
+
+	// Prints the interval statistics, their deviation and the frames that
+	// took over one and a half times the target (or median) interval
+	void print() const;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+FrameStats::FrameStats(size_t window) : window(window), next(0), lastSample(0.0)
+{
+	if (window > 0) samples.reserve(window);
+}
+
+void FrameStats::add(double ms)
+{
+	lastSample = ms;
+	if (window == 0 || samples.size() < window) {
+		samples.push_back(ms);
+		return;
+	}
+
+	// Rolling window: overwrite the oldest sample
+	samples[next] = ms;
+	next = (next + 1) % window;
+}
+
+void FrameStats::clear()
+{
+	samples.clear();
+	next = 0;
+	lastSample = 0.0;
+}
+
+size_t FrameStats::count() const
+{
+	return samples.size();
+}
+
+double FrameStats::last() const
+{
+	return lastSample;
+}
+
+double FrameStats::min() const
+{
+	if (samples.empty()) return 0.0;
+	return *std::min_element(samples.begin(), samples.end());
+}
+
+double FrameStats::max() const
+{
+	if (samples.empty()) return 0.0;
+	return *std::max_element(samples.begin(), samples.end());
+}
+
+double FrameStats::avg() const
+{
+	if (samples.empty()) return 0.0;
+	double sum = 0.0;
+	for (size_t i = 0; i < samples.size(); ++i) sum += samples[i];
+	return sum / samples.size();
+}
+
+double FrameStats::percentile(double p) const
+{
+	if (samples.empty()) return 0.0;
+
+	// Nearest-rank percentile on a sorted copy
+	std::vector<double> sorted(samples);
+	std::sort(sorted.begin(), sorted.end());
+	size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+	if (rank > 0) rank -= 1;
+	if (rank >= sorted.size()) rank = sorted.size() - 1;
+	return sorted[rank];
+}
+
+void FrameStats::print(const char *label) const
+{
+	printf("%s: min %.3f ms, avg %.3f ms, p99 %.3f ms, max %.3f ms (%zu samples)\n",
+		label, min(), avg(), percentile(99.0), max(), count());
+}
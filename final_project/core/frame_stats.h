@@ -0,0 +1,31 @@
+#ifndef _FRAME_STATS_H_
+#define _FRAME_STATS_H_
+
+#include <cstddef>
+#include <vector>
+
+// Collects timing samples (in milliseconds) and summarises them. A non-zero 
+// window keeps only the most recent samples, giving rolling statistics.
+struct FrameStats {
+	FrameStats(size_t window = 0);
+
+	void add(double ms);
+	void clear();
+
+	size_t count() const;
+	double last() const;
+	double min() const;
+	double max() const;
+	double avg() const;
+	double percentile(double p) const;
+
+	// Prints "label: min/avg/p99/max" on a single line
+	void print(const char *label) const;
+
+	size_t window;
+	size_t next;
+	double lastSample;
+	std::vector<double> samples;
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include "job_system.h"
+
+#include <cstdio>
+
+// Index of the calling thread's deque
+static thread_local int currentThread = 0;
+
+JobCounter::JobCounter() : pending(0)
+{
+}
+
+JobSystem::JobSystem() : initialized(false), queued(0), stopping(false), executed(0), stolen(0)
+{
+}
+
+void JobSystem::initialize(int workerCount)
+{
+	if (workerCount < 0) {
+		int hardwareThreads = (int)std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	stopping = false;
+	for (int i = 0; i <= workerCount; ++i) queues.push_back(new Queue());
+	for (int i = 1; i <= workerCount; ++i) {
+		workers.push_back(std::thread(&JobSystem::workerMain, this, i));
+	}
+	initialized = true;
+}
+
+void JobSystem::cleanup()
+{
+	if (!initialized) return;
+
+	// Whatever is still queued is run by the caller first
+	Job job;
+	while (take(0, job)) execute(job);
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+	workers.clear();
+
+	for (size_t i = 0; i < queues.size(); ++i) delete queues[i];
+	queues.clear();
+	deferred.clear();
+	initialized = false;
+}
+
+int JobSystem::threadIndex()
+{
+	return currentThread;
+}
+
+void JobSystem::push(const Job &job)
+{
+	Queue &queue = *queues[currentThread < (int)queues.size() ? currentThread : 0];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+	queued.fetch_add(1, std::memory_order_release);
+
+	// Taking the lock orders this with a worker about to sleep, so the wake-up is not lost
+	if (!workers.empty()) {
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wake.notify_one();
+	}
+}
+
+void JobSystem::run(const std::function<void()> &function, JobCounter *counter, const JobCounter *dependency)
+{
+	Job job;
+	job.function = function;
+	job.counter = counter;
+	if (counter != NULL) counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+	if (!initialized) {
+		execute(job);
+		return;
+	}
+
+	if (dependency != NULL) {
+		// A job finishing the dependency takes this lock after its count
+		// reaches zero, so the job is either queued here or found there
+		std::lock_guard<std::mutex> lock(dependencyMutex);
+		if (!dependency->done()) {
+			Deferred d;
+			d.dependency = dependency;
+			d.job = job;
+			deferred.push_back(d);
+			return;
+		}
+	}
+	push(job);
+}
+
+// Own deque first, newest job; then the oldest job of any other
+bool JobSystem::take(int thread, Job &job)
+{
+	if (queued.load(std::memory_order_acquire) == 0) return false;
+
+	int count = (int)queues.size();
+	for (int i = 0; i < count; ++i) {
+		int victim = (thread + i) % count;
+		Queue &queue = *queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty()) continue;
+		if (i == 0) {
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+		} else {
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+			stolen.fetch_add(1, std::memory_order_relaxed);
+		}
+		queued.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::execute(Job &job)
+{
+	job.function();
+	executed.fetch_add(1, std::memory_order_relaxed);
+	if (job.counter == NULL || job.counter->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+	// The counter is done: queue the jobs that waited for it. Only its
+	// address is compared from here on, since a waiter may already have
+	// returned and destroyed it.
+	const JobCounter *finished = job.counter;
+	std::vector<Job> ready;
+	{
+		std::lock_guard<std::mutex> lock(dependencyMutex);
+		for (size_t i = 0; i < deferred.size(); ) {
+			if (deferred[i].dependency == finished) {
+				ready.push_back(deferred[i].job);
+				deferred[i] = deferred.back();
+				deferred.pop_back();
+			} else {
+				++i;
+			}
+		}
+	}
+	for (size_t i = 0; i < ready.size(); ++i) push(ready[i]);
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+	int thread = currentThread < (int)queues.size() ? currentThread : 0;
+	Job job;
+	while (!counter.done()) {
+		if (take(thread, job)) execute(job);
+		else std::this_thread::yield();
+	}
+}
+
+void JobSystem::parallelFor(int count, int grain, const std::function<void(int, int)> &body)
+{
+	if (count <= 0) return;
+	if (grain < 1) grain = 1;
+
+	// A few chunks per thread, so threads that finish early can steal the rest
+	int chunks = (count + grain - 1) / grain;
+	int most = threadCount() * 4;
+	if (chunks > most) chunks = most;
+	if (chunks <= 1 || !initialized || workers.empty()) {
+		body(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	int begin = 0;
+	for (int i = 0; i < chunks; ++i) {
+		int end = (int)((long long)count * (i + 1) / chunks);
+		if (i + 1 < chunks) {
+			run([&body, begin, end]() { body(begin, end); }, &counter);
+		} else {
+			// The caller does the last chunk itself rather than queue and take it back
+			body(begin, end);
+		}
+		begin = end;
+	}
+	wait(counter);
+}
+
+void JobSystem::workerMain(int thread)
+{
+	currentThread = thread;
+	Job job;
+	while (true) {
+		if (take(thread, job)) {
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		while (!stopping && queued.load(std::memory_order_acquire) == 0) wake.wait(lock);
+		if (stopping) return;
+	}
+}
+
+void JobSystem::resetStatistics()
+{
+	executed = 0;
+	stolen = 0;
+}
+
+void JobSystem::printStatistics() const
+{
+	printf("Job system: %d threads, %lld jobs run, %lld stolen from another thread\n",
+		(int)queues.size(), executed.load(), stolen.load());
+}
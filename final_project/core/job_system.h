@@ -0,0 +1,95 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the unfinished jobs of a group. Jobs started with a counter
+// increment it and decrement it when they finish; JobSystem::wait returns
+// once it is back at zero, and jobs that depend on it are queued then.
+struct JobCounter {
+	std::atomic<int> pending;
+
+	JobCounter();
+
+	bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// A work-stealing thread pool for the CPU side of a frame. Every thread has
+// its own deque: it pushes and pops jobs at the back, where the work it just
+// created is still in cache, and idle threads steal from the front of the
+// others', where the oldest and usually largest jobs are. The thread that
+// called initialize (the GL thread) owns deque 0 and runs jobs while it
+// waits, so nothing is lost by blocking on a counter; with no workers every
+// job runs there and the results are the same.
+struct JobSystem {
+	struct Job {
+		std::function<void()> function;
+		JobCounter *counter; // Decremented when the job finishes, or NULL
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	// A job held back until its dependency reaches zero
+	struct Deferred {
+		const JobCounter *dependency;
+		Job job;
+	};
+
+	JobSystem();
+
+	// Starts workerCount threads beside the calling one; a negative count
+	// takes one per hardware thread but the caller's
+	void initialize(int workerCount = -1);
+	void cleanup();
+
+	// Queues function, counted by counter if not NULL. With a dependency the
+	// job is only queued once that counter is done.
+	void run(const std::function<void()> &function, JobCounter *counter = NULL, const JobCounter *dependency = NULL);
+
+	// Runs queued jobs on the calling thread until counter is done
+	void wait(JobCounter &counter);
+
+	// Calls body(begin, end) over [0, count) in chunks of at least grain
+	// items, spread over every thread, and returns when all have finished
+	void parallelFor(int count, int grain, const std::function<void(int, int)> &body);
+
+	// 0 on the thread that initialized the system (and any other thread
+	// outside it), 1 .. workerCount on the workers
+	static int threadIndex();
+	int threadCount() const { return (int)queues.size(); }
+
+	void resetStatistics();
+	void printStatistics() const;
+
+	bool initialized;
+	std::vector<Queue *> queues;
+	std::vector<std::thread> workers;
+
+	std::mutex dependencyMutex;
+	std::vector<Deferred> deferred;
+
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::atomic<int> queued;
+	bool stopping;
+
+	std::atomic<long long> executed;
+	std::atomic<long long> stolen;
+
+private:
+	void push(const Job &job);
+	bool take(int thread, Job &job);
+	void execute(Job &job);
+	void workerMain(int thread);
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : data(NULL), size(0)
+#ifdef _WIN32
+	, file(NULL), mapping(NULL)
+#endif
+{
+}
+
+#ifdef _WIN32
+
+bool MapFile(const char *path, MappedFile &file)
+{
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL) {
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file.data = (const unsigned char *)data;
+	file.size = (size_t)size.QuadPart;
+	file.file = handle;
+	file.mapping = mapping;
+	return true;
+}
+
+void UnmapFile(MappedFile &file)
+{
+	if (file.data != NULL) UnmapViewOfFile(file.data);
+	if (file.mapping != NULL) CloseHandle((HANDLE)file.mapping);
+	if (file.file != NULL) CloseHandle((HANDLE)file.file);
+	file = MappedFile();
+}
+
+#else
+
+bool MapFile(const char *path, MappedFile &file)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+	if (data == MAP_FAILED) return false;
+
+	file.data = (const unsigned char *)data;
+	file.size = (size_t)info.st_size;
+	return true;
+}
+
+void UnmapFile(MappedFile &file)
+{
+	if (file.data != NULL) munmap((void *)file.data, file.size);
+	file = MappedFile();
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file
+struct MappedFile {
+	const unsigned char *data;
+	size_t size;
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#endif
+
+	MappedFile();
+};
+
+bool MapFile(const char *path, MappedFile &file);
+
+void UnmapFile(MappedFile &file);
+
+#endif
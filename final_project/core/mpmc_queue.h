@@ -0,0 +1,90 @@
+#ifndef _MPMC_QUEUE_H_
+#define _MPMC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded multi-producer multi-consumer queue without locks (Vyukov). Every
+// cell carries a sequence number that says whether it is ready to be written
+// for a given lap or holds a value to be read, so producers and consumers
+// only contend on their own position counter. The capacity is rounded up to
+// a power of two. Neither call ever blocks; they return false when the queue
+// is full or empty.
+template <typename T>
+struct MPMCQueue {
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	MPMCQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity) size *= 2;
+		cells = new Cell[size];
+		mask = size - 1;
+		for (size_t i = 0; i < size; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+		enqueuePosition.store(0, std::memory_order_relaxed);
+		dequeuePosition.store(0, std::memory_order_relaxed);
+	}
+
+	~MPMCQueue() { delete[] cells; }
+
+	bool tryPush(const T &value)
+	{
+		size_t position = enqueuePosition.load(std::memory_order_relaxed);
+		Cell *cell;
+		while (true) {
+			cell = &cells[position & mask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)position;
+			if (difference == 0) {
+				if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+			} else if (difference < 0) {
+				return false; // Full
+			} else {
+				position = enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+		cell->value = value;
+		cell->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool tryPop(T &value)
+	{
+		size_t position = dequeuePosition.load(std::memory_order_relaxed);
+		Cell *cell;
+		while (true) {
+			cell = &cells[position & mask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)(position + 1);
+			if (difference == 0) {
+				if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+			} else if (difference < 0) {
+				return false; // Empty
+			} else {
+				position = dequeuePosition.load(std::memory_order_relaxed);
+			}
+		}
+		value = cell->value;
+		cell->sequence.store(position + mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	Cell *cells;
+	size_t mask;
+
+	// Kept on separate cache lines so producers and consumers do not share one
+	char padding0[64];
+	std::atomic<size_t> enqueuePosition;
+	char padding1[64];
+	std::atomic<size_t> dequeuePosition;
+	char padding2[64];
+
+private:
+	MPMCQueue(const MPMCQueue &);
+	MPMCQueue &operator=(const MPMCQueue &);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "qoi.h"
+
+#include <cstring>
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+
+static void writeBigEndian(unsigned char *dst, unsigned value)
+{
+	dst[0] = (unsigned char)(value >> 24);
+	dst[1] = (unsigned char)(value >> 16);
+	dst[2] = (unsigned char)(value >> 8);
+	dst[3] = (unsigned char)value;
+}
+
+void EncodeQOI(const unsigned char *pixels, int width, int height, ptrdiff_t stride, int channels, std::vector<unsigned char> &out)
+{
+	// Worst case is one byte more than the raw pixels per pixel, plus header and end marker
+	out.resize(14 + (size_t)width * height * (channels + 1) + 8);
+	unsigned char *dst = out.data();
+
+	memcpy(dst, "qoif", 4);
+	writeBigEndian(dst + 4, (unsigned)width);
+	writeBigEndian(dst + 8, (unsigned)height);
+	dst[12] = (unsigned char)channels;
+	dst[13] = 0; // sRGB with linear alpha
+	size_t p = 14;
+
+	unsigned char index[64][4];
+	memset(index, 0, sizeof(index));
+	unsigned char previous[4] = { 0, 0, 0, 255 };
+	int run = 0;
+
+	for (int y = 0; y < height; ++y) {
+		const unsigned char *row = pixels + y * stride;
+		for (int x = 0; x < width; ++x) {
+			unsigned char pixel[4] = { row[4 * x], row[4 * x + 1], row[4 * x + 2], channels == 4 ? row[4 * x + 3] : (unsigned char)255 };
+			bool last = y == height - 1 && x == width - 1;
+
+			if (memcmp(pixel, previous, 4) == 0) {
+				run++;
+				if (run == 62 || last) {
+					dst[p++] = (unsigned char)(QOI_OP_RUN | (run - 1));
+					run = 0;
+				}
+				continue;
+			}
+			if (run > 0) {
+				dst[p++] = (unsigned char)(QOI_OP_RUN | (run - 1));
+				run = 0;
+			}
+
+			int hash = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+			if (memcmp(index[hash], pixel, 4) == 0) {
+				dst[p++] = (unsigned char)(QOI_OP_INDEX | hash);
+			} else {
+				memcpy(index[hash], pixel, 4);
+				if (pixel[3] == previous[3]) {
+					int dr = (signed char)(pixel[0] - previous[0]);
+					int dg = (signed char)(pixel[1] - previous[1]);
+					int db = (signed char)(pixel[2] - previous[2]);
+					int drg = dr - dg;
+					int dbg = db - dg;
+					if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+						dst[p++] = (unsigned char)(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+					} else if (drg >= -8 && drg <= 7 && dg >= -32 && dg <= 31 && dbg >= -8 && dbg <= 7) {
+						dst[p++] = (unsigned char)(QOI_OP_LUMA | (dg + 32));
+						dst[p++] = (unsigned char)((drg + 8) << 4 | (dbg + 8));
+					} else {
+						dst[p++] = QOI_OP_RGB;
+						dst[p++] = pixel[0];
+						dst[p++] = pixel[1];
+						dst[p++] = pixel[2];
+					}
+				} else {
+					dst[p++] = QOI_OP_RGBA;
+					memcpy(dst + p, pixel, 4);
+					p += 4;
+				}
+			}
+			memcpy(previous, pixel, 4);
+		}
+	}
+
+	static const unsigned char end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	memcpy(dst + p, end, 8);
+	out.resize(p + 8);
+}
@@ -0,0 +1,13 @@
+#ifndef _QOI_H_
+#define _QOI_H_
+
+#include <cstddef>
+#include <vector>
+
+// Encodes an RGBA8 image as QOI ("Quite OK Image", qoiformat.org) into out,
+// which is resized to the encoded size. Rows are stride bytes apart; a
+// negative stride with pixels pointing at the last row flips the image.
+// channels is 3 to drop alpha (it is then taken to be 255) or 4 to keep it.
+void EncodeQOI(const unsigned char *pixels, int width, int height, ptrdiff_t stride, int channels, std::vector<unsigned char> &out);
+
+#endif
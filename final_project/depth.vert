@@ -2,9 +2,7 @@
 
 layout(location = 0) in vec3 aPos;
 
-uniform mat4 lightSpaceMatrix;
-
 void main()
 {
-    gl_Position = lightSpaceMatrix * vec4(aPos, 1.0);
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
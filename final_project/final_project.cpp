@@ -12,23 +12,64 @@
 #include <tiny_gltf.h>
 
 #include <render/shader.h>
+#include <render/headless_context.h>
+#include <render/gpu_profiler.h>
+#include <render/frame_latency.h>
+#include <render/texture_cache.h>
+#include <render/texture_loader.h>
+#include <render/material_array.h>
+#include <render/shader_library.h>
+#include <render/gltf_model.h>
+#include <render/mesh_blob.h>
+#include <render/geometry_arena.h>
+#include <render/render_queue.h>
+#include <render/building_batch.h>
+#include <render/shadow_cascades.h>
+#include <render/readback.h>
+#include <render/recorder.h>
+#include <scene/scene_geometry.h>
+#include <scene/city.h>
+#include <scene/fly_camera.h>
+#include <core/frame_stats.h>
+#include <core/frame_clock.h>
+#include <core/job_system.h>
+#include <core/bvh.h>
 
 #include <vector>
 #include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #define _USE_MATH_DEFINES
 #include <math.h>
 
 static GLFWwindow *window;
 static int windowWidth = 1024;
 static int windowHeight = 768;
+static int framebufferWidth = 0;
+static int framebufferHeight = 0;
+
+// Headless benchmark mode: render into an offscreen FBO instead of a window
+static bool headless = false;
+static int benchmarkFrames = 0;
+static int warmupFrames = 10;
+static GLuint sceneFBO = 0; // 0 is the default framebuffer
+static GLuint sceneColorBuffer = 0;
+static GLuint sceneDepthBuffer = 0;
+
+// GPU profiling of the shadow and main passes (--profile, --profile-csv)
+static bool profiling = false;
+static std::string profileCSVPath;
+static int profileInterval = 240;
+static GpuProfiler profiler;
+static int shadowPassID = -1;
+static int mainPassID = -1;
 
 static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode);
-static void cursor_callback(GLFWwindow *window, double xpos, double ypos);
 
-// OpenGL camera view parameters
-static glm::vec3 eye_center(-278.0f, 350.0f, 800.0f);
-static glm::vec3 lookat(-278.0f, 350.0f, 0.0f);
-static glm::vec3 up(0.0f, 1.0f, 0.0f);
+// OpenGL camera view parameters, looking down -z
+static FlyCamera camera(glm::vec3(-278.0f, 350.0f, 800.0f));
 static float FoV = 65.0f;
 static float zNear = 10.0f;
 static float zFar = 10500.0f;
@@ -43,72 +84,149 @@ static glm::vec3 lightTarget(-1000.0f, 0.0f, -275.0f);;
 
 // Shadow mapping
 static glm::vec3 lightUp(0, 0, 1);
-static int shadowMapWidth = 0;
-static int shadowMapHeight = 0;
 
-GLuint shadowFBO;
-GLuint depthTexture;
+// Cascades cover the camera frustum up to shadowDistance; the first is
+// shadowMapSize texels wide and redrawn every frame, the farther ones are
+// smaller and redrawn less often (--shadow-size)
+static ShadowCascades shadows;
+static int shadowMapSize = 768;
+static float shadowDistance = 6000.0f;
+
+// PCF taps per shadow lookup, 0 for rotated Poisson taps (--shadow-filter)
+static int shadowFilter = 1;
+
+// Static casters (ground, buildings, robot) are cached per cascade and only
+// the UFO is drawn every time (--no-shadow-cache). Moving a static caster
+// through moveStaticCaster bumps staticCasterVersion, which invalidates the
+// caches.
+static bool shadowCaching = true;
+static unsigned staticCasterVersion = 0;
+static int robotCullProxy = -1;
+static glm::mat4 robotCasterMatrix(1.0f);
+static long long shadowCascadeDraws = 0;
+static long long shadowStaticDraws = 0;
 
 // TODO: set these parameters 
 static float depthFoV = 100.0f;
 static float depthNear = 10.0f;
 static float depthFar = 7500.0f; 
 
-// Mouse control variables
+// Mouse control variables. The keyboard and mouse are polled once per
+// frame, just before the view matrix is built (see latchCamera), and only
+// in the interactive loop, so benchmarks always see the same view.
+static bool pollInput = false;
 static double lastX = windowWidth / 2.0, lastY = windowHeight / 2.0;
-static float yaw = -90.0f; // Horizontal rotation
-static float pitch = 0.0f; // Vertical rotation
-static float mouseSensitivity = 0.1f;
+static float mouseSensitivity = 0.1f; // Degrees per pixel
+static std::chrono::steady_clock::time_point lastInputTime;
 
-// Helper flag and function to save depth maps for debugging
+// Helper flag to save depth maps for debugging; the reads complete a few
+// frames later and are written to disk on a background thread
 static bool saveDepth = true;
+static AsyncReadback readback;
+
+// The simulation advances in fixed steps of 1 / tickRate seconds 
+// (--tick-rate) and frames are drawn between its last two states. Benchmarks 
+// and recordings take exactly one step per frame, so every machine renders 
+// the same sequence of states however fast it is.
+static FixedTimestep simulation;
+static int tickRate = 60;
+
+// Presentation: the swap interval (--swap-interval; -1 keeps the driver's 
+// default) and a CPU frame limiter (--max-fps), with pacing statistics
+static int swapInterval = -1;
+static double maxFrameRate = 0.0;
+static FrameLimiter frameLimiter;
+static FramePacing framePacing;
+
+// At most framesInFlight (--frames-in-flight, 1 to 3) submitted frames wait
+// for the GPU before the CPU starts another
+static FrameLatency frameLatency;
+static int framesInFlight = 2;
+static int latencyCounterID = -1;
+
+// Recording (--record): every recordInterval-th frame goes to an image
+// sequence or a raw stream. The scene advances one fixed step per rendered
+// frame, so a recording plays back at tickRate / recordInterval frames per
+// second however long each frame took to render.
+static FrameRecorder recorder;
+static std::string recordPath;
+static std::string recordFormat;
+static int recordInterval = 1;
+static int recordEncoders = 0;
+
+// Textures are decoded on worker threads unless --sync-textures is given
+static bool asyncTextures = true;
+static AsyncTextureLoader textureLoader;
+
+// Programs are shared between objects and cached on disk (--shader-cache, --no-shader-cache)
+static ShaderLibrary shaderLibrary;
+static std::string shaderCacheDirectory = "shader_cache";
+
+// Meshes baked by asset_bake (--baked, --no-baked); without them they are built at startup
+static std::string bakedDirectory = "baked";
+static MeshBlob sceneBlob;
+
+// Every static mesh lives in one vertex and index buffer
+static GeometryArena geometry;
+
+// Every pass records its draws here; they are sorted by state when flushed
+static RenderQueue renderQueue;
+
+// The render queue's command lists, one per recording job, in draw order
+enum RecordList {
+	LIST_GROUND,
+	LIST_BUILDINGS,
+	LIST_ROBOT,
+	LIST_UFO
+};
 
-static GLuint LoadTextureTileBox(const char *texture_file_path) {
-    int w, h, channels;
-    uint8_t* img = stbi_load(texture_file_path, &w, &h, &channels, 3);
-    GLuint texture;
-    glGenTextures(1, &texture);  
-    glBindTexture(GL_TEXTURE_2D, texture);  
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    if (img) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, img);
-        glGenerateMipmap(GL_TEXTURE_2D);
-		std::cout << "Texture loaded successfully: " << texture_file_path << std::endl;
-
-    } else {
-        std::cout << "Failed to load texture " << texture_file_path << std::endl;
-    }
-    stbi_image_free(img);
+// The textures of all static geometry, one layer per SceneMaterial
+static MaterialArray materials;
+
+// Generated buildings around the two original ones (--buildings N)
+static int buildingCount = 1000;
+
+// Frustum culling (--no-culling): the ground ranges, buildings, UFO and robot 
+// live in one AABB tree that each pass queries with its own frustum
+static bool frustumCulling = true;
+static AABBTree cullingTree;
+static long long cullFrames = 0;
+static long long shadowVisibleObjects = 0;
+static long long mainVisibleObjects = 0;
+
+// CPU work of the frame (culling, gathering instances) runs on a work-stealing
+// pool of --jobs N threads beside the GL thread (0 runs it all on the GL
+// thread); GL calls stay on the GL thread
+static JobSystem jobs;
+static int jobThreads = -1;
+
+// User data of the tree's leaves: the kind of object above bit 24, its index below
+enum CullKind {
+	CULL_GROUND_RANGE,
+	CULL_BUILDING,
+	CULL_UFO,
+	CULL_ROBOT
+};
 
-    return texture;
+static int cullID(CullKind kind, int index)
+{
+	return (int)kind << 24 | index;
 }
 
-// This function retrieves and stores the depth map of the default frame buffer 
-// or a particular frame buffer (indicated by FBO ID) to a PNG image.
-static void saveDepthTexture(GLuint fbo, std::string filename) {
-    int width = shadowMapWidth;
-    int height = shadowMapHeight;
-	if (shadowMapWidth == 0 || shadowMapHeight == 0) {
-		width = windowWidth;
-		height = windowHeight;
+// Loads a texture into its layer of the material array
+static void LoadMaterial(int layer, const char *texture_file_path) {
+	// Returns at once; the layer stays grey until the loader fills it in
+	if (asyncTextures) {
+		textureLoader.loadLayer(texture_file_path, materials.textureID, layer, materials.width, materials.height);
+		return;
+	}
+
+	// Resized, mipmapped levels come from the texture cache when the source is unchanged
+	if (materials.load(layer, texture_file_path)) {
+		std::cout << "Texture loaded successfully: " << texture_file_path << std::endl;
+	} else {
+		std::cout << "Failed to load texture " << texture_file_path << std::endl;
 	}
-    int channels = 3; 
-    
-    std::vector<float> depth(width * height);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glReadBuffer(GL_DEPTH_COMPONENT);
-    glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, depth.data());
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    std::vector<unsigned char> img(width * height * 3);
-    for (int i = 0; i < width * height; ++i) img[3*i] = img[3*i+1] = img[3*i+2] = depth[i] * 255;
-
-    stbi_write_png(filename.c_str(), width, height, channels, img.data(), width * channels);
 }
 
 // Set initial mouse position and capture mode
@@ -118,1144 +236,772 @@ void setupMouseControl()
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); // Disable cursor for FPS-style control
 }
 
-// Struct for a simple GLTF mesh representation
-struct GLTFMesh {
-    GLuint vao;
-    GLuint vbo;
-    GLuint ebo;
-    GLsizei indexCount;
+// Reads the movement keys and the cursor as they are now
+static CameraInput sampleInput()
+{
+	CameraInput input;
+	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) input.forward += 1.0f;
+	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) input.forward -= 1.0f;
+	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) input.right += 1.0f;
+	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) input.right -= 1.0f;
+
+	double x, y;
+	glfwGetCursorPos(window, &x, &y);
+	input.yaw = (float)(x - lastX) * mouseSensitivity;
+	input.pitch = (float)(lastY - y) * mouseSensitivity; // Reversed since y-coordinates go from bottom to top
+	lastX = x;
+	lastY = y;
+	return input;
+}
+
+// Late latch: processes pending window events and moves the camera by the
+// input as it stands right before the view matrix is built, rather than
+// as it stood at the end of the previous frame. Movement covers the real
+// time since the last sample, or one simulation step per frame when
+// recording so that recordings play back at the speed they were flown.
+static void latchCamera()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(now - lastInputTime).count();
+	lastInputTime = now;
+	if (recorder.initialized) seconds = simulation.step;
+	if (seconds > 0.1) seconds = 0.1; // Do not jump across a stall
+
+	glfwPollEvents();
+	camera.update(sampleInput(), (float)seconds);
+}
+
+// Moves a static shadow caster's leaf in the culling tree
+static void moveStaticCaster(int proxy, const AABB &box)
+{
+	cullingTree.move(proxy, box);
+	++staticCasterVersion;
+}
+
+// Finds a built-in mesh in the baked scene blob, or builds it into source 
+// from the arrays in scene_geometry when there is no blob
+static MeshRef getSceneMesh(const char *name, void (*build)(MeshBlobSource &), MeshBlobSource &source)
+{
+	int index = FindMeshBlobMesh(sceneBlob, name);
+	if (index >= 0) return GetMeshBlobMesh(sceneBlob, index);
+	build(source);
+	return GetMeshSource(source);
+}
+
+// Copies a built-in mesh into the geometry arena and returns its draw ranges 
+// with their bounds
+static void loadSceneMesh(const char *name, void (*build)(MeshBlobSource &), GeometryAllocation &allocation, std::vector<MeshBlobRange> &ranges, std::vector<AABB> &rangeBounds)
+{
+	MeshBlobSource source(name);
+	MeshRef ref = getSceneMesh(name, build, source);
+	geometry.allocate(ref, allocation);
+	ranges.assign(ref.ranges, ref.ranges + ref.mesh->rangeCount);
+
+	rangeBounds.resize(ranges.size());
+	for (size_t i = 0; i < ranges.size(); ++i) {
+		float boundsMin[3], boundsMax[3];
+		if (!GetMeshRangeBounds(ref, ranges[i], boundsMin, boundsMax)) {
+			memcpy(boundsMin, ref.mesh->boundsMin, sizeof(boundsMin));
+			memcpy(boundsMax, ref.mesh->boundsMax, sizeof(boundsMax));
+		}
+		rangeBounds[i] = AABB(glm::vec3(boundsMin[0], boundsMin[1], boundsMin[2]), glm::vec3(boundsMax[0], boundsMax[1], boundsMax[2]));
+	}
+}
+
+// The objects one pass draws
+struct VisibleSet {
+	bool groundRanges[GROUND_RANGE_COUNT];
+	std::vector<int> buildings;
+	bool ufo;
+	bool robot;
+	std::vector<int> proxies; // What the culling tree returned
 };
 
 struct Ground {
 
-	GLfloat vertex_buffer_data[264] = {
-		// Ground and Background
-	    -3500.0f, 0.0f, -3500.0f,  // Bottom-left
-		3500.0f, 0.0f, -3500.0f,   // Bottom-right
-     	3500.0f, 0.0f,  3500.0f,  // Top-right
-		-3500.0f, 0.0f,  3500.0f,  // Top-left
-
-		// Top face
-		-3500.0f, 7000.0f, -3500.0f,  // Bottom-left
-		-3500.0f, 7000.0f,  3500.0f,  // Top-left
-		3500.0f, 7000.0f,  3500.0f,  // Top-right
-		3500.0f, 7000.0f, -3500.0f,  // Bottom-right
-
-		// Front face
-		-3500.0f, 0.0f,  3500.0f,  // Bottom-left
-		-3500.0f, 7000.0f,  3500.0f,  // Top-left
-		3500.0f, 7000.0f,  3500.0f,  // Top-right
-		3500.0f, 0.0f,  3500.0f,  // Bottom-right
-
-		// Back face
-		-3500.0f, 0.0f, -3500.0f,  // Bottom-left
-		-3500.0f, 7000.0f, -3500.0f,  // Top-left
-		3500.0f, 7000.0f, -3500.0f,  // Top-right
-		3500.0f, 0.0f, -3500.0f,  // Bottom-right
-
-		// Left face
-		-3500.0f, 0.0f, -3500.0f,  // Bottom-left
-		-3500.0f, 7000.0f, -3500.0f,  // Top-left
-		-3500.0f, 7000.0f,  3500.0f,  // Top-right
-		-3500.0f, 0.0f,  3500.0f,  // Bottom-right
-
-		// Right face
-		3500.0f, 0.0f, -3500.0f,  // Bottom-left
-		3500.0f, 7000.0f, -3500.0f,  // Top-left
-		3500.0f, 7000.0f,  3500.0f,  // Top-right
-		3500.0f, 0.0f,  3500.0f,  // Bottom-right
-
-		// Building 1
-		// Top face
-		-200.0f, 1600.0f, -500.0f,  // Bottom-left
-		-200.0f, 1600.0f,  500.0f,  // Top-left
-		800.0f, 1600.0f,  500.0f,  // Top-right
-		800.0f, 1600.0f, -500.0f,  // Bottom-right
-
-		// Front face
-		-200.0f, 0.0f,  500.0f,  // Bottom-left
-		-200.0f, 1600.0f,  500.0f,  // Top-left
-		800.0f, 1600.0f,  500.0f,  // Top-right
-		800.0f, 0.0f,  500.0f,  // Bottom-right
-
-		// Back face
-		-200.0f, 0.0f, -500.0f,  // Bottom-left
-		-200.0f, 1600.0f, -500.0f,  // Top-left
-		800.0f, 1600.0f, -500.0f,  // Top-right
-		800.0f, 0.0f, -500.0f,  // Bottom-right
-
-		// Left face
-		-200.0f, 0.0f, -500.0f,  // Bottom-left
-		-200.0f, 1600.0f, -500.0f,  // Top-left
-		-200.0f, 1600.0f,  500.0f,  // Top-right
-		-200.0f, 0.0f,  500.0f,  // Bottom-right
-
-		// Right face
-		800.0f, 0.0f, -500.0f,  // Bottom-left
-		800.0f, 1600.0f, -500.0f,  // Top-left
-		800.0f, 1600.0f,  500.0f,  // Top-right
-		800.0f, 0.0f,  500.0f,  // Bottom-right
-
-		// Building 2
-		// Top face
-		-1200.0f - 350.0f, 1900.0f, -350.0f,  // Bottom-left
-		-1200.0f - 350.0f, 1900.0f,  350.0f,  // Top-left
-		-1200.0f + 350.0f, 1900.0f,  350.0f,  // Top-right
-		-1200.0f + 350.0f, 1900.0f, -350.0f,  // Bottom-right
-
-		// Front face
-		-1200.0f - 350.0f, 0.0f,  350.0f,  // Bottom-left
-		-1200.0f - 350.0f, 1900.0f,  350.0f,  // Top-left
-		-1200.0f + 350.0f, 1900.0f,  350.0f,  // Top-right
-		-1200.0f + 350.0f, 0.0f,  350.0f,  // Bottom-right
-
-		// Back face
-		-1200.0f - 350.0f, 0.0f, -350.0f,  // Bottom-left
-		-1200.0f - 350.0f, 1900.0f, -350.0f,  // Top-left
-		-1200.0f + 350.0f, 1900.0f, -350.0f,  // Top-right
-		-1200.0f + 350.0f, 0.0f, -350.0f,  // Bottom-right
-
-		// Left face
-		-1200.0f - 350.0f, 0.0f, -350.0f,  // Bottom-left
-		-1200.0f - 350.0f, 1900.0f, -350.0f,  // Top-left
-		-1200.0f - 350.0f, 1900.0f,  350.0f,  // Top-right
-		-1200.0f - 350.0f, 0.0f,  350.0f,  // Bottom-right
-
-		// Right face
-		-1200.0f + 350.0f, 0.0f, -350.0f,  // Bottom-left
-		-1200.0f + 350.0f, 1900.0f, -350.0f,  // Top-left
-		-1200.0f + 350.0f, 1900.0f,  350.0f,  // Top-right
-		-1200.0f + 350.0f, 0.0f,  350.0f,  // Bottom-right
-		
-	};
-	
-	GLfloat normal_buffer_data[264] = {
-		// Ground and background
-		// Floor 
-		0.0, 1.0, 0.0,   
-		0.0, 1.0, 0.0,
-		0.0, 1.0, 0.0,
-		0.0, 1.0, 0.0,
-
-		// Ceiling
-		0.0f, -1.0f, 0.0f,  // Bottom-left
-		0.0f, -1.0f, 0.0f,  // Top-left
-		0.0f, -1.0f, 0.0f,  // Top-right
-		0.0f, -1.0f, 0.0f,  // Bottom-right
-
-		// Front face
-		0.0f, 0.0f, -1.0f,   // Bottom-left
-		0.0f, 0.0f, -1.0f,   // Top-left
-		0.0f, 0.0f, -1.0f,   // Top-right
-		0.0f, 0.0f, -1.0f,   // Bottom-right
-
-		// Back face
-		0.0f, 0.0f, 1.0f,  // Bottom-left
-		0.0f, 0.0f, 1.0f,  // Top-left
-		0.0f, 0.0f, 1.0f,  // Top-right
-		0.0f, 0.0f, 1.0f,  // Bottom-right
-
-		// Left face
-		1.0f, 0.0f, 0.0f,  // Bottom-left
-		1.0f, 0.0f, 0.0f,  // Top-left
-		1.0f, 0.0f, 0.0f,  // Top-right
-		1.0f, 0.0f, 0.0f,  // Bottom-right
-
-		// Right face
-		-1.0f, 0.0f, 0.0f,   // Bottom-left
-		-1.0f, 0.0f, 0.0f,   // Top-left
-		-1.0f, 0.0f, 0.0f,   // Top-right
-		-1.0f, 0.0f, 0.0f,   // Bottom-right
-
-		// Building 1
-		// Ceiling
-		0.0f, 1.0f, 0.0f,  // Bottom-left
-		0.0f, 1.0f, 0.0f,  // Top-left
-		0.0f, 1.0f, 0.0f,  // Top-right
-		0.0f, 1.0f, 0.0f,  // Bottom-right
-
-		// Front face
-		0.0f, 0.0f, -1.0f,   // Bottom-left
-		0.0f, 0.0f, -1.0f,   // Top-left
-		0.0f, 0.0f, -1.0f,   // Top-right
-		0.0f, 0.0f, -1.0f,   // Bottom-right
-
-		// Back face
-		0.0f, 0.0f, 1.0f,  // Bottom-left
-		0.0f, 0.0f, 1.0f,  // Top-left
-		0.0f, 0.0f, 1.0f,  // Top-right
-		0.0f, 0.0f, 1.0f,  // Bottom-right
-
-		// Left face
-		-1.0f, 0.0f, 0.0f,  // Bottom-left
-		-1.0f, 0.0f, 0.0f,  // Top-left
-		-1.0f, 0.0f, 0.0f,  // Top-right
-		-1.0f, 0.0f, 0.0f,  // Bottom-right
-
-		// Right face
-		-1.0f, 0.0f, 0.0f,   // Bottom-left
-		-1.0f, 0.0f, 0.0f,   // Top-left
-		-1.0f, 0.0f, 0.0f,   // Top-right
-		-1.0f, 0.0f, 0.0f,   // Bottom-right
-
-		// Building 2
-		// Ceiling
-		0.0f, 1.0f, 0.0f,  // Bottom-left
-		0.0f, 1.0f, 0.0f,  // Top-left
-		0.0f, 1.0f, 0.0f,  // Top-right
-		0.0f, 1.0f, 0.0f,  // Bottom-right
-
-		// Front face
-		0.0f, 0.0f, -1.0f,   // Bottom-left
-		0.0f, 0.0f, -1.0f,   // Top-left
-		0.0f, 0.0f, -1.0f,   // Top-right
-		0.0f, 0.0f, -1.0f,   // Bottom-right
-
-		// Back face
-		0.0f, 0.0f, 1.0f,  // Bottom-left
-		0.0f, 0.0f, 1.0f,  // Top-left
-		0.0f, 0.0f, 1.0f,  // Top-right
-		0.0f, 0.0f, 1.0f,  // Bottom-right
-
-		// Left face
-		1.0f, 0.0f, 0.0f,  // Bottom-left
-		1.0f, 0.0f, 0.0f,  // Top-left
-		1.0f, 0.0f, 0.0f,  // Top-right
-		1.0f, 0.0f, 0.0f,  // Bottom-right
-
-		// Right face
-		-1.0f, 0.0f, 0.0f,   // Bottom-left
-		-1.0f, 0.0f, 0.0f,   // Top-left
-		-1.0f, 0.0f, 0.0f,   // Top-right
-		-1.0f, 0.0f, 0.0f,   // Bottom-right
-
-	};
-
-	GLfloat color_buffer_data[264] = {
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-	};
-
-	GLuint index_buffer_data[96] = {
-		// ground and background
-		// Botton
-		2, 1, 0, 	
-		3, 2, 0,
-
-		// Top face
-		6, 5, 4,
-		7, 6, 4,
-
-		// Front face
-		8, 9, 10,
-		8, 10, 11,
-
-		// Back face
-		14, 13, 12,
-		15, 14, 12,
-
-		// Left face
-		16, 17, 18,
-		16, 18, 19,
-
-		// Right face
-		22, 21, 20,
-		23, 22, 20,
-
-		// Building 1
-		24, 25, 26,
-		24, 26, 27,
-
-		30, 29, 28,
-		31, 30, 28,
-
-		32, 33, 34,
-		32, 34, 35,
-
-		38, 37, 36,
-		39, 38, 36,
-
-		40, 41, 42,
-		40, 42, 43,
-
-		// Building 2
-		44, 45, 46,
-		44, 46, 47,
-
-		50, 49, 48,
-		51, 50, 48,
-
-		52, 53, 54,
-		52, 54, 55,
-
-		58, 57, 56,
-		59, 58, 56,
-
-		60, 61, 62,
-		60, 62, 63,
-
-	};	
-
-	GLfloat uv_buffer_data[128] = {
-		8.0f,  8.0f,    // Top-right
-		0.0f,  8.0f,    // Top-left
-		0.0f,  0.0f,    // Bottom-left
-		8.0f,  0.0f,    // Bottom-right
-
-		0.5f,  0.333f,  // Top-right
-		0.25f, 0.333f,  // Top-left
-		0.25f, 0.0f,    // Bottom-left
-		0.5f,  0.0f,    // Bottom-right
-
-		0.25f, 0.666f,  // Top-right
-		0.25f, 0.333f,  // Bottom-right
-		0.0f,  0.333f,  // Bottom-left
-		0.0f,  0.666f,  // Top-left
-		
-		0.5f,  0.666f,  // Top-left
-		0.5f,  0.333f,  // Bottom-left
-		0.75f, 0.333f,  // Bottom-right
-		0.75f, 0.666f,  // Top-right y
-
-		0.5f,  0.666f,  // Top-right
-		0.5f,  0.333f,  // Bottom-right
-		0.25f, 0.333f,  // Bottom-left
-		0.25f, 0.666f,  // Top-left y
-
-		0.75f, 0.666f,  // Top-left
-		0.75f, 0.333f,  // Bottom-left
-		1.0f,  0.333f,  // Bottom-right
-		1.0f,  0.666f,  // Top-right y
-
-		// Building 1
-		// Building top
-		0.1f,  0.1f,  // Top-right
-		0.1f,  0.0f,  // Bottom-right
-		0.0f,  0.0f,  // Bottom-left
-		0.0f,  0.1f,  // Top-left
-
-		1.0f,  3.0f,  // Top-right
-		1.0f,  0.0f,  // Bottom-right
-		0.0f,  0.0f,  // Bottom-left
-		0.0f,  3.0f,  // Top-left
-		
-		0.0f,  3.0f,  // Top-left
-		0.0f,  0.0f,  // Bottom-left
-		1.0f,  0.0f,  // Bottom-right
-		1.0f,  3.0f,  // Top-right y
-
-		0.0f,  0.0f,  // Bottom-left
-		0.0f,  3.0f,  // Top-left y
-		1.0f,  3.0f,  // Top-right
-		1.0f,  0.0f,  // Bottom-right
-
-		0.0f,  3.0f,  // Top-left
-		0.0f,  0.0f,  // Bottom-left
-		1.0f,  0.0f,  // Bottom-right
-		1.0f,  3.0f,  // Top-right y
-
-		// Building 2
-		// Building top
-		0.1f,  0.1f,  // Top-right
-		0.1f,  0.0f,  // Bottom-right
-		0.0f,  0.0f,  // Bottom-left
-		0.0f,  0.1f,  // Top-left
-
-		1.0f,  2.0f,  // Top-right
-		1.0f,  0.0f,  // Bottom-right
-		0.0f,  0.0f,  // Bottom-left
-		0.0f,  2.0f,  // Top-left
-		
-		0.0f,  2.0f,  // Top-left
-		0.0f,  0.0f,  // Bottom-left
-		1.0f,  0.0f,  // Bottom-right
-		1.0f,  2.0f,  // Top-right y
-
-		0.0f,  0.0f,  // Bottom-left
-		0.0f,  2.0f,  // Top-left y
-		1.0f,  2.0f,  // Top-right
-		1.0f,  0.0f,  // Bottom-right
-
-		0.0f,  2.0f,  // Top-left
-		0.0f,  0.0f,  // Bottom-left
-		1.0f,  0.0f,  // Bottom-right
-		1.0f,  2.0f,  // Top-right y
-	};
-
-	// OpenGL buffers
-	GLuint vertexArrayID; 
-	GLuint vertexBufferID; 
-	GLuint indexBufferID; 
-	GLuint colorBufferID;
-	GLuint normalBufferID;
-	GLuint uvBufferID;
-	GLuint backgroundTextureID;
-	GLuint groundTextureID;
-	GLuint building1TextureID;
-	GLuint building2TextureID;
-
-	// Shader variable IDs
-	GLuint mvpMatrixID;
-	GLuint textureSamplerID;
-	GLuint lightPositionID;
-	GLuint lightIntensityID;
-	GLuint programID;
+	// Where the mesh lives in the geometry arena
+	GeometryAllocation mesh;
+	std::vector<MeshBlobRange> ranges;
 
-	GLuint depthProgramID;
-	GLuint depthMVPMatrixID;
-	GLuint shadowMapID;
-	GLuint lightSpaceMatrixID;
+	// Instanced buildings, one draw for all wall textures
+	BuildingBatch buildings;
+	GLuint buildingProgramID;
+	GLuint buildingDepthProgramID;
 
-	// Robot meshes
-    // std::vector<GLTFMesh> robotMeshes;
+	// Shader programs and their uniforms, shared through the render queue
+	GLuint programID;
+	GLuint depthProgramID;
+	RenderProgram *program;
+	RenderProgram *depthProgram;
 
 	void initialize() {
-		for (int i = 0; i < 132; ++i) color_buffer_data[i] = 1.0f;
-		// Create a vertex array object
-		glGenVertexArrays(1, &vertexArrayID);
-		glBindVertexArray(vertexArrayID);
-
-		// Create a vertex buffer object to store the vertex data		
-		glGenBuffers(1, &vertexBufferID);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
-
-		// Create a vertex buffer object to store the color data
-		glGenBuffers(1, &colorBufferID);
-		glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(color_buffer_data), color_buffer_data, GL_STATIC_DRAW);
-
-		// Create a vertex buffer object to store the vertex normals		
-		glGenBuffers(1, &normalBufferID);
-		glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(normal_buffer_data), normal_buffer_data, GL_STATIC_DRAW);
-
-		// Create a vertex buffer object to store the UV data
-		glGenBuffers(1, &uvBufferID);
-		glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data,
-		GL_STATIC_DRAW);
-		
-		// Create an index buffer object to store the index data that defines triangle faces
-		glGenBuffers(1, &indexBufferID);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
-
-        glGenFramebuffers(1, &shadowFBO);
-        glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
-
-        glGenTextures(1, &depthTexture);
-        glBindTexture(GL_TEXTURE_2D, depthTexture);
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, shadowMapWidth, shadowMapHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
-        glDrawBuffer(GL_NONE);
-        glReadBuffer(GL_NONE);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		// Sub-allocated from the geometry arena's vertex and index buffer
+		std::vector<AABB> rangeBounds;
+		loadSceneMesh("ground", BuildGroundMesh, mesh, ranges, rangeBounds);
+		for (int i = 0; i < GROUND_RANGE_COUNT; ++i) {
+			cullingTree.insert(rangeBounds[i], cullID(CULL_GROUND_RANGE, i));
+		}
 
 		// Create and compile our GLSL program from the shaders
-		programID = LoadShadersFromFile("/Users/selinawang/Downloads/Graphics Final Project/final_project/scene.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/scene.frag");
+		programID = shaderLibrary.load("/Users/selinawang/Downloads/Graphics Final Project/final_project/scene.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/scene.frag");
 		if (programID == 0)
 		{
 			std::cerr << "Failed to load shaders." << std::endl;
 		}
 
 		std::string texturePath = "/Users/selinawang/Downloads/Graphics Final Project/final_project/texture/road.png";
-		groundTextureID = LoadTextureTileBox(texturePath.c_str());
+		LoadMaterial(SCENE_MATERIAL_ROAD, texturePath.c_str());
 
 		texturePath = "/Users/selinawang/Downloads/Graphics Final Project/final_project/texture/star.png";
-		backgroundTextureID = LoadTextureTileBox(texturePath.c_str());  // Convert string to C-style string
+		LoadMaterial(SCENE_MATERIAL_SKY, texturePath.c_str());  // Convert string to C-style string
 
 		texturePath = "/Users/selinawang/Downloads/Graphics Final Project/final_project/texture/building1.png";
-		building1TextureID = LoadTextureTileBox(texturePath.c_str());
+		LoadMaterial(SCENE_MATERIAL_BUILDING, texturePath.c_str());
 
 		texturePath = "/Users/selinawang/Downloads/Graphics Final Project/final_project/texture/building2.png";
-		building2TextureID = LoadTextureTileBox(texturePath.c_str());
+		LoadMaterial(SCENE_MATERIAL_BUILDING + 1, texturePath.c_str());
 
-		textureSamplerID = glGetUniformLocation(programID,"textureSampler");
-
-		// Get a handle for our "MVP" uniform
-		mvpMatrixID = glGetUniformLocation(programID, "MVP");
-		lightPositionID = glGetUniformLocation(programID, "lightPosition");
-		lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
-		shadowMapID = glGetUniformLocation(programID, "shadowMap");
-		lightSpaceMatrixID = glGetUniformLocation(programID, "lightSpaceMatrix");
+		// The uniforms live in the render queue's uniform buffers
+		program = renderQueue.registerProgram(programID);
 
 		// Create and compile GLSL program for depth rendering (shadow mapping)
-		depthProgramID = LoadShadersFromFile("/Users/selinawang/Downloads/Graphics Final Project/final_project/depth.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/depth.frag");
+		depthProgramID = shaderLibrary.load("/Users/selinawang/Downloads/Graphics Final Project/final_project/depth.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/depth.frag");
 		if (depthProgramID == 0) {
 			std::cerr << "Failed to load depth shaders." << std::endl;
 		}
-		depthMVPMatrixID = glGetUniformLocation(depthProgramID, "lightSpaceMatrix");
-	}
+		depthProgram = renderQueue.registerProgram(depthProgramID);
 
-	void render(glm::mat4 cameraMatrix, glm::mat4 lightSpaceMatrix) {
-		glUseProgram(programID);
-
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-		glEnableVertexAttribArray(2);
-		glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
-		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-
-		// Set model-view-projection matrix
-		glm::mat4 mvp = cameraMatrix;
-		glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
-
-		glEnableVertexAttribArray(3);
-		glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-		glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-		// Set light data 
-		glUniform3fv(lightPositionID, 1, &lightPosition[0]);
-		glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
-
-		// Pass light-space matrix to shader
-		glUniformMatrix4fv(lightSpaceMatrixID, 1, GL_FALSE, &lightSpaceMatrix[0][0]);
-
-		// Bind depth texture to texture unit 0
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, depthTexture);
-		glUniform1i(shadowMapID, 1); // Tell the shader that the shadow map is on texture unit 0
-
-		// Set light data
-		glUniform3fv(lightPositionID, 1, &lightPosition[0]);
-		glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
-		
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, groundTextureID);
-		glUniform1i(textureSamplerID, 0); 
-		glDrawElements(
-			GL_TRIANGLES,      // mode
-			6,    			   // number of indices
-			GL_UNSIGNED_INT,   // type
-			(void*)(0 * sizeof(GLuint))  // element array buffer offset
-		);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, backgroundTextureID);
-		glUniform1i(textureSamplerID, 0); 
-		// Draw the box
-		glDrawElements(
-			GL_TRIANGLES,      // mode
-			30,    			   // number of indices
-			GL_UNSIGNED_INT,   // type
-			(void*)(6 * sizeof(GLuint))   // element array buffer offset
-		);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, building1TextureID);
-		glUniform1i(textureSamplerID, 0); 
-		// Draw the box
-		glDrawElements(
-			GL_TRIANGLES,      // mode
-			30,    			   // number of indices
-			GL_UNSIGNED_INT,   // type
-			(void*)(36 * sizeof(GLuint))   // element array buffer offset
-		);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, building2TextureID);
-		glUniform1i(textureSamplerID, 0); 
-		// Draw the box
-		glDrawElements(
-			GL_TRIANGLES,      // mode
-			30,    			   // number of indices
-			GL_UNSIGNED_INT,   // type
-			(void*)(66 * sizeof(GLuint))   // element array buffer offset
-		);
-
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
-		glDisableVertexAttribArray(2);
-		glDisableVertexAttribArray(3);
-	}
-
-	void renderDepth(glm::mat4 lightSpaceMatrix) {
-		glUseProgram(depthProgramID);
-
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		// The buildings share one box mesh and take their placement from the instance buffer
+		buildingProgramID = shaderLibrary.load("/Users/selinawang/Downloads/Graphics Final Project/final_project/building.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/scene.frag");
+		buildingDepthProgramID = shaderLibrary.load("/Users/selinawang/Downloads/Graphics Final Project/final_project/building_depth.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/depth.frag");
+		if (buildingProgramID == 0 || buildingDepthProgramID == 0) {
+			std::cerr << "Failed to load building shaders." << std::endl;
+		}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+		std::vector<BuildingInstance> city;
+		GenerateCity(buildingCount, 1, city);
+		MeshBlobSource source("building");
+		buildings.initialize(geometry, getSceneMesh("building", BuildBuildingMesh, source), city,
+			renderQueue.registerProgram(buildingProgramID), renderQueue.registerProgram(buildingDepthProgramID));
+		buildings.jobs = &jobs;
+		for (size_t i = 0; i < buildings.instances.size(); ++i) {
+			cullingTree.insert(BuildingBounds(buildings.instances[i]), cullID(CULL_BUILDING, (int)i));
+		}
+	}
 
-		// Set light-space matrix
-		glUniformMatrix4fv(depthMVPMatrixID, 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+	// Submits the visible ranges, merging neighbours that can share a draw;
+	// the vertices carry their material, so ground and background merge.
+	// With colored set, every draw gets its range's base color.
+	void submitRanges(CommandList &list, DrawPacket &packet, const VisibleSet &visible, bool colored) {
+		for (int i = 0; i < GROUND_RANGE_COUNT; ++i) {
+			if (!visible.groundRanges[i]) continue;
+			int last = i;
+			while (last + 1 < GROUND_RANGE_COUNT && visible.groundRanges[last + 1] 
+				&& ranges[last + 1].mode == ranges[i].mode
+				&& ranges[last + 1].firstIndex == ranges[last].firstIndex + ranges[last].indexCount
+				&& memcmp(ranges[last + 1].baseColor, ranges[i].baseColor, sizeof(ranges[i].baseColor)) == 0) ++last;
+
+			packet.setGeometry(geometry, mesh, ranges[i].mode, ranges[i].firstIndex, ranges[last].firstIndex + ranges[last].indexCount - ranges[i].firstIndex);
+			if (colored) packet.object = list.addObject(glm::mat4(1.0f), ranges[i].baseColor, 3);
+			list.submit(packet);
+			i = last;
+		}
+	}
 
-		glDrawElements(
-			GL_TRIANGLES,
-			90,
-			GL_UNSIGNED_INT,
-			(void*)0
-		);
+	// Ground and background; the buildings record separately (see recordPass)
+	void submit(CommandList &list, const VisibleSet &visible) {
+		DrawPacket packet;
+		packet.program = program;
+		packet.setTexture(GL_TEXTURE_2D_ARRAY, materials.textureID);
+		submitRanges(list, packet, visible, true);
+	}
 
-		glDisableVertexAttribArray(0);
+	void submitDepth(CommandList &list, const VisibleSet &visible) {
+		DrawPacket packet;
+		packet.program = depthProgram;
+		packet.object = list.addObject(glm::mat4(1.0f));
+		submitRanges(list, packet, visible, false);
 	}
 
 	void cleanup() {
-		glDeleteBuffers(1, &vertexBufferID);
-		glDeleteBuffers(1, &colorBufferID);
-		glDeleteBuffers(1, &indexBufferID);
-		glDeleteBuffers(1, &normalBufferID);
-		glDeleteVertexArrays(1, &vertexArrayID);
-		glDeleteBuffers(1, &uvBufferID);
-		glDeleteTextures(1, &backgroundTextureID);
-		glDeleteTextures(1, &groundTextureID);
-		glDeleteTextures(1, &building1TextureID);
-		glDeleteTextures(1, &building2TextureID);
-		glDeleteProgram(programID);
-		glDeleteProgram(depthProgramID);
+		geometry.free(mesh);
+		buildings.cleanup();
+		shaderLibrary.release(programID);
+		shaderLibrary.release(depthProgramID);
+		shaderLibrary.release(buildingProgramID);
+		shaderLibrary.release(buildingDepthProgramID);
 	}
 }; 
 
 
 struct UFO {
 
+	// Spin in degrees: the simulated state after the last step and before 
+	// it, and the blend of the two that is drawn
 	float rotationAngle = 0.0f;
+	float previousRotationAngle = 0.0f;
+	float drawnRotationAngle = 0.0f;
+	float rotationSpeed = 7.2f; // Degrees per second
 
-	GLfloat vertex_buffer_data[72] = {
-		// Front face
-		2000.0f, 1400.0f,  200.0f,  // Bottom-left
-		2400.0f, 1400.0f,  200.0f,  // Bottom-right
-		2400.0f, 1800.0f, 200.0f,  // Top-right
-		2000.0f, 1800.0f, 200.0f,  // Top-left
-
-		// Back face
-		2000.0f, 1400.0f, -200.0f,  // Bottom-left
-		2400.0f, 1400.0f, -200.0f,  // Bottom-right
-		2400.0f, 1800.0f, -200.0f, // Top-right
-		2000.0f, 1800.0f, -200.0f, // Top-left
-
-		// Left face
-		2000.0f, 1400.0f, -200.0f,  // Bottom-left
-		2000.0f, 1400.0f,  200.0f,  // Bottom-right
-		2000.0f, 1800.0f, 200.0f,  // Top-right
-		2000.0f, 1800.0f, -200.0f, // Top-left
-
-		// Right face
-		2400.0f, 1400.0f, -200.0f,  // Bottom-left
-		2400.0f, 1400.0f,  200.0f,  // Bottom-right
-		2400.0f, 1800.0f, 200.0f,  // Top-right
-		2400.0f, 1800.0f, -200.0f, // Top-left
-
-		// Top face
-		2000.0f, 1800.0f, 200.0f,  // Bottom-left
-		2400.0f, 1800.0f, 200.0f,  // Bottom-right
-		2400.0f, 1800.0f, -200.0f, // Top-right
-		2000.0f, 1800.0f, -200.0f, // Top-left
-
-		// Bottom face
-		2000.0f, 1400.0f, 200.0f,   // Bottom-left
-		2400.0f, 1400.0f, 200.0f,   // Bottom-right
-		2400.0f, 1400.0f, -200.0f,  // Top-right
-		2000.0f, 1400.0f, -200.0f   // Top-left
-	};
-	
-	GLfloat normal_buffer_data[72] = {    
-		// Front face (facing +Z)
-		0.0f, 0.0f,  -1.0f,  // Bottom-left
-		0.0f, 0.0f,  -1.0f,  // Bottom-right
-		0.0f, 0.0f,  -1.0f,  // Top-right
-		0.0f, 0.0f,  -1.0f,  // Top-left
-
-		// Back face (facing -Z)
-		0.0f, 0.0f, -1.0f,  // Bottom-left
-		0.0f, 0.0f, -1.0f,  // Bottom-right
-		0.0f, 0.0f, -1.0f,  // Top-right
-		0.0f, 0.0f, -1.0f,  // Top-left
-
-		// Left face (facing -X)
-		-1.0f, 0.0f, 0.0f,  // Bottom-left
-		-1.0f, 0.0f, 0.0f,  // Bottom-right
-		-1.0f, 0.0f, 0.0f,  // Top-right
-		-1.0f, 0.0f, 0.0f,  // Top-left
-
-		// Right face (facing +X)
-		-1.0f, 0.0f, 0.0f,   // Bottom-left
-		-1.0f, 0.0f, 0.0f,   // Bottom-right
-		-1.0f, 0.0f, 0.0f,   // Top-right
-		-1.0f, 0.0f, 0.0f,   // Top-left
-
-		// Top face (facing +Y)
-		0.0f, -1.0f, 0.0f,   // Bottom-left
-		0.0f, -1.0f, 0.0f,   // Bottom-right
-		0.0f, -1.0f, 0.0f,   // Top-right
-		0.0f, -1.0f, 0.0f,   // Top-left
-
-		// Bottom face (facing -Y)
-		0.0f, 1.0f, 0.0f,  // Bottom-left
-		0.0f, 1.0f, 0.0f,  // Bottom-right
-		0.0f, 1.0f, 0.0f,  // Top-right
-		0.0f, 1.0f, 0.0f   // Top-left
-	};
-
-	GLfloat color_buffer_data[72] = {
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 1.0f
-	};
-
-	GLuint index_buffer_data[96] = {
-		// Front face (+Z)
-		0, 1, 2,  // First triangle
-		0, 2, 3,  // Second triangle
-
-		// Back face (-Z)
-		6, 5, 4,  // First triangle
-		7, 6, 4,  // Second triangle y
-
-		// Left face (-X)
-		8, 9, 10,  // First triangle
-		8, 10, 11, // Second triangle y
-
-		// Right face (+X)
-		14, 13, 12, // First triangle
-		15, 14, 12, // Second triangle
-
-		// Top face (+Y)
-		16, 17, 18, // First triangle
-		16, 18, 19, // Second triangle
-
-		// Bottom face (-Y)
-		22, 21, 20, // First triangle
-		23, 22, 20  // Second triangle
-	};
-
-	GLfloat uv_buffer_data[128] = {
-		// Front face (+Z)
-		0.0f, 0.0f,  // Bottom-left
-		1.0f, 0.0f,  // Bottom-right
-		1.0f, 1.0f,  // Top-right
-		0.0f, 1.0f,  // Top-left
-
-		// Back face (-Z)
-		0.0f, 0.0f,  // Bottom-left
-		1.0f, 0.0f,  // Bottom-right
-		1.0f, 1.0f,  // Top-right
-		0.0f, 1.0f,  // Top-left
-
-		// Left face (-X)
-		0.0f, 0.0f,  // Bottom-left
-		1.0f, 0.0f,  // Bottom-right
-		1.0f, 1.0f,  // Top-right
-		0.0f, 1.0f,  // Top-left
-
-		// Right face (+X)
-		0.0f, 0.0f,  // Bottom-left
-		1.0f, 0.0f,  // Bottom-right
-		1.0f, 1.0f,  // Top-right
-		0.0f, 1.0f,  // Top-left
-
-		// Top face (+Y)
-		0.0f, 0.0f,  // Bottom-left
-		0.1f, 0.0f,  // Bottom-right
-		0.1f, 0.1f,  // Top-right
-		0.0f, 0.1f,  // Top-left
-
-		// Bottom face (-Y)
-		0.0f, 0.0f,  // Bottom-left
-		0.1f, 0.0f,  // Bottom-right
-		0.1f, 0.1f,  // Top-right
-		0.0f, 0.1f   // Top-left
-	};
-
-	// OpenGL buffers
-	GLuint vertexArrayID; 
-	GLuint vertexBufferID; 
-	GLuint indexBufferID; 
-	GLuint colorBufferID;
-	GLuint normalBufferID;
-	GLuint uvBufferID;
-	GLuint textureID;
-
-	// Shader variable IDs
-	GLuint mvpMatrixID;
-	GLuint textureSamplerID;
-	GLuint lightPositionID;
-	GLuint lightIntensityID;
-	GLuint programID;
+	// Where the mesh lives in the geometry arena
+	GeometryAllocation mesh;
+	std::vector<MeshBlobRange> ranges;
+
+	// Model-space bounds and leaf in the culling tree
+	AABB bounds;
+	int cullProxy;
 
-	GLuint lightSpaceMatrixID;
+	// Shader programs and their uniforms, shared through the render queue
+	GLuint programID;
+	GLuint depthProgramID;
+	RenderProgram *program;
+	RenderProgram *depthProgram;
 
 	void initialize() {
-		for (int i = 0; i < 72; ++i) color_buffer_data[i] = 1.0f;
-		// Create a vertex array object
-		glGenVertexArrays(1, &vertexArrayID);
-		glBindVertexArray(vertexArrayID);
-
-		// Create a vertex buffer object to store the vertex data		
-		glGenBuffers(1, &vertexBufferID);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
-
-		// Create a vertex buffer object to store the color data
-		glGenBuffers(1, &colorBufferID);
-		glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(color_buffer_data), color_buffer_data, GL_STATIC_DRAW);
-
-		// Create a vertex buffer object to store the vertex normals		
-		glGenBuffers(1, &normalBufferID);
-		glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(normal_buffer_data), normal_buffer_data, GL_STATIC_DRAW);
-
-		// Create a vertex buffer object to store the UV data
-		glGenBuffers(1, &uvBufferID);
-		glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data,
-		GL_STATIC_DRAW);
-		
-		// Create an index buffer object to store the index data that defines triangle faces
-		glGenBuffers(1, &indexBufferID);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
+		// Sub-allocated from the geometry arena's vertex and index buffer
+		std::vector<AABB> rangeBounds;
+		loadSceneMesh("ufo", BuildUFOMesh, mesh, ranges, rangeBounds);
+		bounds = rangeBounds[0];
+		cullProxy = cullingTree.insert(TransformAABB(bounds, modelMatrix()), cullID(CULL_UFO, 0));
 
 		// Create and compile our GLSL program from the shaders
-		programID = LoadShadersFromFile("/Users/selinawang/Downloads/Graphics Final Project/final_project/scene.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/scene.frag");
+		programID = shaderLibrary.load("/Users/selinawang/Downloads/Graphics Final Project/final_project/scene.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/scene.frag");
 		if (programID == 0)
 		{
 			std::cerr << "Failed to load shaders." << std::endl;
 		}
 
 		std::string texturePath = "/Users/selinawang/Downloads/Graphics Final Project/final_project/texture/UFO.png";
-		textureID = LoadTextureTileBox(texturePath.c_str());
+		LoadMaterial(SCENE_MATERIAL_UFO, texturePath.c_str());
+
+		// The uniforms live in the render queue's uniform buffers
+		program = renderQueue.registerProgram(programID);
+
+		depthProgramID = shaderLibrary.load("/Users/selinawang/Downloads/Graphics Final Project/final_project/depth.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/depth.frag");
+		if (depthProgramID == 0) {
+			std::cerr << "Failed to load depth shaders." << std::endl;
+		}
+		depthProgram = renderQueue.registerProgram(depthProgramID);
+	}
+
+	glm::mat4 modelMatrix() const {
+		return glm::rotate(glm::mat4(1.0f), glm::radians(drawnRotationAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+	}
 
-		textureSamplerID = glGetUniformLocation(programID,"textureSampler");
+	// Advances the spin by one simulation step of dt seconds
+	void step(float dt) {
+		previousRotationAngle = rotationAngle;
+		rotationAngle += rotationSpeed * dt;
+		if (rotationAngle >= 360.0f) {
+			// Both wrap, so blending between them never sweeps back through a full turn
+			rotationAngle -= 360.0f;
+			previousRotationAngle -= 360.0f;
+		}
+	}
 
-		// Get a handle for our "MVP" uniform
-		mvpMatrixID = glGetUniformLocation(programID, "MVP");
-		lightPositionID = glGetUniformLocation(programID, "lightPosition");
-		lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
-		lightSpaceMatrixID = glGetUniformLocation(programID, "lightSpaceMatrix");
+	// Places the UFO alpha of the way from the previous state to the current
+	// one and moves its bounds in the culling tree
+	void interpolate(float alpha) {
+		drawnRotationAngle = previousRotationAngle + (rotationAngle - previousRotationAngle) * alpha;
+		cullingTree.move(cullProxy, TransformAABB(bounds, modelMatrix()));
 	}
 
-	void render(glm::mat4 vpMatrix, glm::mat4 lightSpaceMatrix) {
-		glUseProgram(programID);
-
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-		glEnableVertexAttribArray(2);
-		glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
-		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-
-		// Set model-view-projection matrix
-		
-        glm::mat4 modelMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(rotationAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-        glm::mat4 mvp = vpMatrix * modelMatrix;
-		glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
-
-		glEnableVertexAttribArray(3);
-		glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-		glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-		// Set light data 
-		glUniform3fv(lightPositionID, 1, &lightPosition[0]);
-		glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
-
-		// Pass light-space matrix to shader
-		glUniformMatrix4fv(lightSpaceMatrixID, 1, GL_FALSE, &lightSpaceMatrix[0][0]);
-
-		// Set light data
-		glUniform3fv(lightPositionID, 1, &lightPosition[0]);
-		glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
-		
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glUniform1i(textureSamplerID, 0); 
-		glDrawElements(
-			GL_TRIANGLES,      // mode
-			36,    			   // number of indices
-			GL_UNSIGNED_INT,   // type
-			(void*)(0 * sizeof(GLuint))  // element array buffer offset
-		);
-
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
-		glDisableVertexAttribArray(2);
-		glDisableVertexAttribArray(3);
+	void submit(CommandList &list) {
+		DrawPacket packet;
+		packet.program = program;
+		packet.setGeometry(geometry, mesh, ranges[0].mode, ranges[0].firstIndex, ranges[0].indexCount);
+		packet.setTexture(GL_TEXTURE_2D_ARRAY, materials.textureID);
+		packet.object = list.addObject(modelMatrix(), ranges[0].baseColor, 3);
+		list.submit(packet);
+	}
+
+	void submitDepth(CommandList &list) {
+		DrawPacket packet;
+		packet.program = depthProgram;
+		packet.setGeometry(geometry, mesh, ranges[0].mode, ranges[0].firstIndex, ranges[0].indexCount);
+		packet.object = list.addObject(modelMatrix());
+		list.submit(packet);
 	}
 
 	void cleanup() {
-		glDeleteBuffers(1, &vertexBufferID);
-		glDeleteBuffers(1, &colorBufferID);
-		glDeleteBuffers(1, &indexBufferID);
-		glDeleteBuffers(1, &normalBufferID);
-		glDeleteVertexArrays(1, &vertexArrayID);
-		glDeleteBuffers(1, &uvBufferID);
-		glDeleteTextures(1, &textureID);
-		glDeleteProgram(programID);
+		geometry.free(mesh);
+		shaderLibrary.release(programID);
+		shaderLibrary.release(depthProgramID);
 	}
 }; 
 
-/*
-// Function to load a GLTF model
-std::vector<GLTFMesh> LoadGLTFModel(const std::string &path) {
-    tinygltf::Model model;
-    tinygltf::TinyGLTF loader;
-    std::string err;
-    std::string warn;
-
-    if (!loader.LoadASCIIFromFile(&model, &err, &warn, path)) {
-        std::cerr << "Failed to load GLTF: " << err << std::endl;
-        return {};
-    }
+// Fills visible with the objects inside the frustum of viewProjection, or 
+// with every object when culling is off
+static void findVisible(const glm::mat4 &viewProjection, const Ground &b, VisibleSet &visible)
+{
+	visible.buildings.clear();
+	if (!frustumCulling) {
+		for (int i = 0; i < GROUND_RANGE_COUNT; ++i) visible.groundRanges[i] = true;
+		for (size_t i = 0; i < b.buildings.instances.size(); ++i) visible.buildings.push_back((int)i);
+		visible.ufo = true;
+		visible.robot = true;
+		return;
+	}
 
-    if (!warn.empty()) {
-        std::cerr << "GLTF Warning: " << warn << std::endl;
-    }
+	for (int i = 0; i < GROUND_RANGE_COUNT; ++i) visible.groundRanges[i] = false;
+	visible.ufo = false;
+	visible.robot = false;
+
+	Frustum frustum;
+	ExtractFrustum(viewProjection, frustum);
+	visible.proxies.clear();
+	cullingTree.query(frustum, visible.proxies);
+	for (size_t i = 0; i < visible.proxies.size(); ++i) {
+		int index = visible.proxies[i] & 0xffffff;
+		switch (visible.proxies[i] >> 24) {
+		case CULL_GROUND_RANGE: visible.groundRanges[index] = true; break;
+		case CULL_BUILDING: visible.buildings.push_back(index); break;
+		case CULL_UFO: visible.ufo = true; break;
+		case CULL_ROBOT: visible.robot = true; break;
+		}
+	}
+}
 
-    std::vector<GLTFMesh> meshes;
-
-    // Iterate over meshes in the model
-    for (const auto &mesh : model.meshes) {
-        for (const auto &primitive : mesh.primitives) {
-            GLTFMesh gltfMesh;
-
-            // Extract vertex positions
-            const auto &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-            const auto &posBufferView = model.bufferViews[posAccessor.bufferView];
-            const auto &posBuffer = model.buffers[posBufferView.buffer];
-            const float *positions = reinterpret_cast<const float *>(&posBuffer.data[posBufferView.byteOffset + posAccessor.byteOffset]);
-            size_t posCount = posAccessor.count;
-
-            // Log vertex positions
-            std::cout << "Vertex Positions:" << std::endl;
-            for (size_t i = 0; i < posCount; ++i) {
-                std::cout << "  [" << i << "] "
-                          << positions[i * 3 + 0] << ", "
-                          << positions[i * 3 + 1] << ", "
-                          << positions[i * 3 + 2] << std::endl;
-            }
-
-            // Extract indices
-            const auto &indexAccessor = model.accessors[primitive.indices];
-            const auto &indexBufferView = model.bufferViews[indexAccessor.bufferView];
-            const auto &indexBuffer = model.buffers[indexBufferView.buffer];
-            const unsigned short *indices = reinterpret_cast<const unsigned short *>(&indexBuffer.data[indexBufferView.byteOffset + indexAccessor.byteOffset]);
-            size_t indexCount = indexAccessor.count;
-
-            gltfMesh.indexCount = static_cast<GLsizei>(indexCount);
-
-            // Log index data
-            std::cout << "Indices:" << std::endl;
-            for (size_t i = 0; i < indexCount; ++i) {
-                std::cout << "  [" << i << "] " << indices[i] << std::endl;
-            }
-
-            // Generate and bind VAO
-            glGenVertexArrays(1, &gltfMesh.vao);
-            glBindVertexArray(gltfMesh.vao);
-
-            // Generate and bind VBO for positions
-            glGenBuffers(1, &gltfMesh.vbo);
-            glBindBuffer(GL_ARRAY_BUFFER, gltfMesh.vbo);
-            glBufferData(GL_ARRAY_BUFFER, posCount * 3 * sizeof(float), positions, GL_STATIC_DRAW);
-
-            // Enable vertex attribute for positions
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-            glEnableVertexAttribArray(0);
-
-            // Generate and bind EBO for indices
-            glGenBuffers(1, &gltfMesh.ebo);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gltfMesh.ebo);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned short), indices, GL_STATIC_DRAW);
-
-            glBindVertexArray(0);
-
-            meshes.push_back(gltfMesh);
-        }
-    }
+// Records a pass with one job per group of objects, each into its own
+// command list, then streams the buildings' instances; the caller flushes.
+// The UFO is left out when NULL, and depth records the depth-only draws.
+static void recordPass(Ground &b, UFO *u, GLTFModel &robot, const VisibleSet &visible, bool depth)
+{
+	JobCounter recorded;
+	if (depth) {
+		jobs.run([&]() { b.submitDepth(renderQueue.list(LIST_GROUND), visible); }, &recorded);
+		jobs.run([&]() { b.buildings.submitDepth(renderQueue.list(LIST_BUILDINGS), visible.buildings); }, &recorded);
+		if (visible.robot) jobs.run([&]() { robot.submitDepth(renderQueue.list(LIST_ROBOT)); }, &recorded);
+		if (u != NULL && visible.ufo) jobs.run([&]() { u->submitDepth(renderQueue.list(LIST_UFO)); }, &recorded);
+	} else {
+		jobs.run([&]() { b.submit(renderQueue.list(LIST_GROUND), visible); }, &recorded);
+		jobs.run([&]() { b.buildings.submit(renderQueue.list(LIST_BUILDINGS), materials.textureID, visible.buildings); }, &recorded);
+		if (visible.robot) jobs.run([&]() { robot.submit(renderQueue.list(LIST_ROBOT)); }, &recorded);
+		if (u != NULL && visible.ufo) jobs.run([&]() { u->submit(renderQueue.list(LIST_UFO)); }, &recorded);
+	}
+	jobs.wait(recorded);
+	b.buildings.upload();
+}
+
+// Draws the casters that never move by themselves into the bound depth target
+static void renderStaticDepth(Ground &b, GLTFModel &robot, const VisibleSet &visible)
+{
+	recordPass(b, NULL, robot, visible, true);
+	renderQueue.flush();
+}
 
-    return meshes;
+// Runs the simulation steps that seconds of real time call for and places
+// the moving objects between their last two states for drawing
+static void advanceSimulation(UFO &u, double seconds)
+{
+	int steps = simulation.advance(seconds);
+	for (int i = 0; i < steps; ++i) u.step((float)simulation.step);
+	u.interpolate(simulation.alpha());
 }
 
-// Function to render meshes
-void RenderGLTFModel(const std::vector<GLTFMesh> &meshes, const glm::mat4 &vpMatrix) {
-    glm::mat4 modelMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(20.0f)); // Scale by 100 times
-    glm::mat4 mvpMatrix = vpMatrix * modelMatrix; // Combine view-projection with model matrix
+// Renders the shadow pass and the main pass of one frame into sceneFBO
+static void renderFrame(Ground &b, UFO &u, GLTFModel &robot, const glm::mat4 &projectionMatrix)
+{
+	static VisibleSet mainVisible;
+	static VisibleSet cascadeVisible[MAX_SHADOW_CASCADES];
 
-    // Bind shader and set the uniform
-    GLuint programID = LoadShadersFromFile("/Users/selinawang/Downloads/Graphics Final Project/final_project/robot.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/robot.frag");
-    glUseProgram(programID);
+	profiler.beginFrame();
+	++cullFrames;
 
-    GLint mvpLocation = glGetUniformLocation(programID, "uMVP");
-    glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(mvpMatrix));
+	// Input is latched before any matrix is built, so a reset (R) moves the
+	// light and the camera in the same frame
+	if (pollInput) latchCamera();
 
-    for (const auto &mesh : meshes) {
-        glBindVertexArray(mesh.vao);
-        glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_SHORT, nullptr);
-        glBindVertexArray(0);
-    }
-    
-    glUseProgram(0);
-*/
+	// The robot is a static caster, so a new placement invalidates the shadow caches
+	if (robotCullProxy >= 0 && robot.modelMatrix != robotCasterMatrix) {
+		robotCasterMatrix = robot.modelMatrix;
+		moveStaticCaster(robotCullProxy, TransformAABB(AABB(robot.boundsMin, robot.boundsMax), robot.modelMatrix));
+	}
+
+	// Set up light's view and projection matrix
+	glm::mat4 lightProjection = glm::perspective(glm::radians(depthFoV), (float)windowWidth / windowHeight, depthNear, depthFar);
+	glm::mat4 lightView = glm::lookAt(lightPosition, lightTarget, lightUp);
+	glm::mat4 lightSpaceMatrix = lightProjection * lightView;
+	glm::mat4 viewMatrix = camera.viewMatrix();
+
+	// First pass: Render depth into the cascades due this frame, pushed back
+	// by a slope-scaled bias instead of a bias in the shaders
+	profiler.beginPass(shadowPassID);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(shadows.slopeBias, shadows.constantBias);
+	shadows.update(viewMatrix, glm::radians(FoV), (float)windowWidth / windowHeight, zNear, std::min(shadowDistance, zFar), lightSpaceMatrix);
+
+	// Everything the shaders read once per frame goes up in one write: the
+	// light, the cascades and the camera and cascade view-projections
+	glm::mat4 vp = projectionMatrix * viewMatrix;
+	FrameUniforms &uniforms = renderQueue.uniforms;
+	uniforms.beginFrame();
+	uniforms.setLight(lightPosition, lightIntensity);
+	uniforms.setShadows(shadows);
+	int cameraView = uniforms.addView(vp);
+	int cascadeViews[MAX_SHADOW_CASCADES];
+	for (int i = 0; i < shadows.cascadeCount; ++i) cascadeViews[i] = uniforms.addView(shadows.cascades[i].matrix);
+
+	// Cull the camera and every cascade due this frame at once, one job per
+	// view; nothing moves in the tree until the next frame
+	JobCounter culled;
+	jobs.run([&]() { findVisible(vp, b, mainVisible); }, &culled);
+	for (int i = 0; i < shadows.cascadeCount; ++i) {
+		if (!shadows.cascades[i].due) continue;
+		jobs.run([&, i]() { findVisible(shadows.cascades[i].matrix, b, cascadeVisible[i]); }, &culled);
+	}
+	uniforms.upload();
+	jobs.wait(culled);
+
+	for (int i = 0; i < shadows.cascadeCount; ++i) {
+		const ShadowCascade &cascade = shadows.cascades[i];
+		if (!cascade.due) continue;
+		const VisibleSet &visible = cascadeVisible[i];
+		renderQueue.begin(cascadeViews[i], NULL);
+		shadowVisibleObjects += visible.proxies.size();
+		++shadowCascadeDraws;
+
+		if (shadowCaching) {
+			// Redraw the static casters only when the cache is stale, then
+			// start from a copy of it
+			if (shadows.staticStale(i, staticCasterVersion)) {
+				shadows.bindStatic(i, staticCasterVersion);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				renderStaticDepth(b, robot, visible);
+				++shadowStaticDraws;
+			}
+			shadows.restoreStatic(i);
+		} else {
+			shadows.bindCascade(i);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			renderStaticDepth(b, robot, visible);
+			++shadowStaticDraws;
+		}
+		if (visible.ufo) {
+			u.submitDepth(renderQueue.list(LIST_UFO));
+			renderQueue.flush();
+		}
+	}
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	profiler.endPass(shadowPassID);
+
+	// Save the depth texture of the nearest cascade
+	if (saveDepth) {
+		shadows.bindCascade(0);
+		readback.capture(shadows.framebufferID, shadows.cascades[0].resolution, shadows.cascades[0].resolution, AsyncReadback::READBACK_DEPTH, "depth_light.png");
+	}
+
+	profiler.beginPass(mainPassID);
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+	glViewport(0, 0, framebufferWidth, framebufferHeight);
+
+	// Second pass: Render the scene to the default framebuffer (or the offscreen one when headless)
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	mainVisibleObjects += mainVisible.proxies.size();
+	renderQueue.begin(cameraView, &shadows);
+	recordPass(b, &u, robot, mainVisible, false);
+	renderQueue.flush();
+	profiler.endPass(mainPassID);
+
+	if (saveDepth) {
+		readback.capture(sceneFBO, framebufferWidth, framebufferHeight, AsyncReadback::READBACK_DEPTH, "depth_camera.png");
+		saveDepth = false;
+	}
+	readback.update();
+
+	renderQueue.endFrame();
+	profiler.setCounter(latencyCounterID, frameLatency.lastLatency);
+	profiler.endFrame();
+}
 
-int main(void)
+// Offscreen color + depth target that replaces the default framebuffer in headless mode
+static bool createSceneFramebuffer(int width, int height)
 {
-	// Initialise GLFW
-	if (!glfwInit())
+	glGenRenderbuffers(1, &sceneColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, sceneColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &sceneDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, sceneDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &sceneFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sceneColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, sceneDepthBuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Offscreen framebuffer is incomplete (0x" << std::hex << status << std::dec << ")." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Renders warmupFrames + benchmarkFrames frames and reports frame time statistics.
+// Each frame is finished with glFinish so the numbers include the GPU work.
+// The simulation takes one step per frame, so every run draws the same frames.
+static void runBenchmark(Ground &b, UFO &u, GLTFModel &robot, const glm::mat4 &projectionMatrix)
+{
+	FrameStats frameTimes;
+	for (int frame = 0; frame < warmupFrames + benchmarkFrames; ++frame)
 	{
-		std::cerr << "Failed to initialize GLFW." << std::endl;
-		return -1;
+		frameLimiter.wait();
+		framePacing.tick();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		advanceSimulation(u, simulation.step);
+		renderFrame(b, u, robot, projectionMatrix);
+		if (frame >= warmupFrames) recorder.update(sceneFBO);
+		if (!headless) {
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+		frameLatency.endFrame();
+		glFinish();
+
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		if (frame >= warmupFrames) frameTimes.add(elapsed.count());
+		if (frame + 1 == warmupFrames) {
+			profiler.reset();
+			cullFrames = shadowVisibleObjects = mainVisibleObjects = 0;
+			shadowCascadeDraws = shadowStaticDraws = 0;
+			renderQueue.resetStatistics();
+			jobs.resetStatistics();
+			framePacing.clear();
+			frameLatency.reset();
+		}
+
+		if (!headless && glfwWindowShouldClose(window)) break;
 	}
 
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // For MacOS
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	printf("Benchmark: %d x %d, %d warm-up frames, renderer %s\n", framebufferWidth, framebufferHeight, warmupFrames, glGetString(GL_RENDERER));
+	frameTimes.print("Frame time");
+	if (frameTimes.avg() > 0.0) printf("Average frame rate: %.1f fps\n", 1000.0 / frameTimes.avg());
+	framePacing.print();
+	frameLatency.print();
+	printf("Simulation: %lld steps at %d Hz, one per frame\n", simulation.steps, tickRate);
+	if (frustumCulling && cullFrames > 0) {
+		printf("Frustum culling: %.1f of %d objects in the main pass, %.1f in the shadow pass (tree height %d)\n", 
+			(double)mainVisibleObjects / cullFrames, cullingTree.leafCount, (double)shadowVisibleObjects / cullFrames, cullingTree.height());
+	}
+	printf("Shadow cascades: %d, %.0f depth texels written per frame on average\n", shadows.cascadeCount, shadows.averageFill());
+	if (shadowFilter == 0) printf("Shadow filter: 8-tap rotated Poisson PCF\n");
+	else printf("Shadow filter: %d-tap PCF\n", shadowFilter);
+	if (shadowCascadeDraws > 0) {
+		printf("Shadow cache: static casters drawn in %lld of %lld cascade updates\n", shadowStaticDraws, shadowCascadeDraws);
+	}
+	readback.finish();
+	geometry.printStatistics();
+	renderQueue.printStatistics();
+	jobs.printStatistics();
+	printf("Readback: %d images written, %d dropped\n", (int)readback.written, (int)readback.dropped);
+	if (recorder.initialized) {
+		recorder.finish();
+		recorder.printStatistics();
+	}
+	profiler.print();
+}
 
-	// Open a window and create its OpenGL context
-	window = glfwCreateWindow(windowWidth, windowHeight, "Final Project", NULL, NULL);
-	if (window == NULL)
-	{
-		std::cerr << "Failed to open a GLFW window." << std::endl;
-		glfwTerminate();
-		return -1;
+static void parseArguments(int argc, char **argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--headless") {
+			headless = true;
+		} else if (arg == "--frames" && i + 1 < argc) {
+			benchmarkFrames = atoi(argv[++i]);
+		} else if (arg == "--warmup" && i + 1 < argc) {
+			warmupFrames = atoi(argv[++i]);
+		} else if (arg == "--texture-cache" && i + 1 < argc) {
+			SetTextureCacheDirectory(argv[++i]);
+		} else if (arg == "--no-texture-cache") {
+			SetTextureCacheDirectory("");
+		} else if (arg == "--sync-textures") {
+			asyncTextures = false;
+		} else if (arg == "--shader-cache" && i + 1 < argc) {
+			shaderCacheDirectory = argv[++i];
+		} else if (arg == "--no-shader-cache") {
+			shaderCacheDirectory.clear();
+		} else if (arg == "--baked" && i + 1 < argc) {
+			bakedDirectory = argv[++i];
+		} else if (arg == "--no-baked") {
+			bakedDirectory.clear();
+		} else if (arg == "--jobs" && i + 1 < argc) {
+			jobThreads = atoi(argv[++i]);
+			if (jobThreads < 0) jobThreads = 0;
+		} else if (arg == "--buildings" && i + 1 < argc) {
+			buildingCount = atoi(argv[++i]);
+		} else if (arg == "--no-culling") {
+			frustumCulling = false;
+		} else if (arg == "--shadow-size" && i + 1 < argc) {
+			shadowMapSize = atoi(argv[++i]);
+		} else if (arg == "--no-shadow-cache") {
+			shadowCaching = false;
+		} else if (arg == "--shadow-filter" && i + 1 < argc) {
+			std::string filter = argv[++i];
+			shadowFilter = filter == "poisson" ? 0 : atoi(filter.c_str());
+			if (shadowFilter != 0 && shadowFilter != 1 && shadowFilter != 4 && shadowFilter != 9 && shadowFilter != 16) {
+				std::cerr << "--shadow-filter takes 1, 4, 9, 16 or poisson, using 1" << std::endl;
+				shadowFilter = 1;
+			}
+		} else if (arg == "--resolution" && i + 1 < argc) {
+			int width = 0, height = 0;
+			if (sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+				windowWidth = width;
+				windowHeight = height;
+				lastX = width / 2.0;
+				lastY = height / 2.0;
+			} else {
+				std::cerr << "--resolution takes WIDTHxHEIGHT, such as 1920x1080" << std::endl;
+			}
+		} else if (arg == "--record" && i + 1 < argc) {
+			recordPath = argv[++i];
+		} else if (arg == "--record-format" && i + 1 < argc) {
+			recordFormat = argv[++i];
+		} else if (arg == "--record-every" && i + 1 < argc) {
+			recordInterval = atoi(argv[++i]);
+		} else if (arg == "--encoders" && i + 1 < argc) {
+			recordEncoders = atoi(argv[++i]);
+		} else if (arg == "--tick-rate" && i + 1 < argc) {
+			tickRate = atoi(argv[++i]);
+			if (tickRate <= 0) {
+				std::cerr << "--tick-rate takes a positive rate in Hz, using 60" << std::endl;
+				tickRate = 60;
+			}
+		} else if (arg == "--swap-interval" && i + 1 < argc) {
+			swapInterval = atoi(argv[++i]);
+		} else if (arg == "--max-fps" && i + 1 < argc) {
+			maxFrameRate = atof(argv[++i]);
+		} else if (arg == "--frames-in-flight" && i + 1 < argc) {
+			framesInFlight = atoi(argv[++i]);
+			if (framesInFlight < 1 || framesInFlight > FRAME_LATENCY_MAX_FRAMES) {
+				std::cerr << "--frames-in-flight takes 1 to " << FRAME_LATENCY_MAX_FRAMES << ", using 2" << std::endl;
+				framesInFlight = 2;
+			}
+		} else if (arg == "--no-stream-gltf") {
+			SetGLTFStreamingParser(false);
+		} else if (arg == "--profile") {
+			profiling = true;
+		} else if (arg == "--profile-csv" && i + 1 < argc) {
+			profiling = true;
+			profileCSVPath = argv[++i];
+		} else {
+			std::cerr << "Unknown argument " << arg << std::endl;
+			std::cerr << "Usage: final_project [--headless] [--frames N] [--warmup N] [--profile] [--profile-csv FILE]" 
+				<< " [--texture-cache DIR | --no-texture-cache] [--sync-textures]"
+				<< " [--shader-cache DIR | --no-shader-cache]"
+				<< " [--baked DIR | --no-baked] [--no-stream-gltf] [--buildings N] [--jobs N] [--no-culling] [--shadow-size N] [--no-shadow-cache] [--shadow-filter 1|4|9|16|poisson]"
+				<< " [--tick-rate HZ] [--swap-interval N] [--max-fps N] [--frames-in-flight N]"
+				<< " [--resolution WxH] [--record PATTERN|- [--record-format png|qoi|rgb|yuv] [--record-every N] [--encoders N]]" << std::endl;
+		}
 	}
-	glfwMakeContextCurrent(window);
 
-	// Ensure we can capture the escape key being pressed below
-	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
-	glfwSetKeyCallback(window, key_callback);
+	// Headless mode has no window to close, so it always runs a fixed number of frames
+	if (headless && benchmarkFrames <= 0) benchmarkFrames = 300;
+	if (warmupFrames < 0) warmupFrames = 0;
+}
 
-	setupMouseControl();
-	glfwSetCursorPosCallback(window, cursor_callback);
+// Opens the recording before anything is printed, since a raw stream takes over stdout
+static void openRecording()
+{
+	if (recordPath.empty()) return;
+
+	// The format follows the file extension unless --record-format is given
+	std::string format = recordFormat;
+	if (format.empty()) {
+		size_t dot = recordPath.rfind('.');
+		std::string extension = dot == std::string::npos ? std::string() : recordPath.substr(dot + 1);
+		format = recordPath == "-" ? "yuv" : extension == "qoi" ? "qoi" : "png";
+	}
+
+	FrameRecorder::Format recorderFormat;
+	if (format == "png") recorderFormat = FrameRecorder::RECORD_PNG;
+	else if (format == "qoi") recorderFormat = FrameRecorder::RECORD_QOI;
+	else if (format == "rgb") recorderFormat = FrameRecorder::RECORD_RGB;
+	else if (format == "yuv") recorderFormat = FrameRecorder::RECORD_YUV;
+	else {
+		std::cerr << "--record-format takes png, qoi, rgb or yuv, not recording" << std::endl;
+		return;
+	}
+	recorder.open(recorderFormat, recordPath, recordInterval, recordEncoders);
+}
+
+int main(int argc, char **argv)
+{
+	parseArguments(argc, argv);
+	openRecording();
 
-	// Load OpenGL functions, gladLoadGL returns the loaded version, 0 on error.
-	int version = gladLoadGL(glfwGetProcAddress);
-	if (version == 0)
+	if (headless)
 	{
-		std::cerr << "Failed to initialize OpenGL context." << std::endl;
-		return -1;
+		if (!CreateHeadlessContext())
+		{
+			std::cerr << "Failed to create a headless OpenGL context." << std::endl;
+			return -1;
+		}
+
+		if (gladLoadGL(GetHeadlessProcAddress) == 0)
+		{
+			std::cerr << "Failed to initialize OpenGL context." << std::endl;
+			DestroyHeadlessContext();
+			return -1;
+		}
+
+		framebufferWidth = windowWidth;
+		framebufferHeight = windowHeight;
+		if (!createSceneFramebuffer(framebufferWidth, framebufferHeight))
+		{
+			DestroyHeadlessContext();
+			return -1;
+		}
 	}
+	else
+	{
+		// Initialise GLFW
+		if (!glfwInit())
+		{
+			std::cerr << "Failed to initialize GLFW." << std::endl;
+			return -1;
+		}
 
-	// Prepare shadow map size for shadow mapping. Usually this is the size of the window itself, but on some platforms like Mac this can be 2x the size of the window. Use glfwGetFramebufferSize to get the shadow map size properly. 
-    glfwGetFramebufferSize(window, &shadowMapWidth, &shadowMapHeight);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // For MacOS
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+		// Open a window and create its OpenGL context
+		window = glfwCreateWindow(windowWidth, windowHeight, "Final Project", NULL, NULL);
+		if (window == NULL)
+		{
+			std::cerr << "Failed to open a GLFW window." << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+
+		// 1 waits for vertical blank on every swap, 0 never waits
+		if (swapInterval >= 0) glfwSwapInterval(swapInterval);
+
+		// Ensure we can capture the escape key being pressed below
+		glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+		glfwSetKeyCallback(window, key_callback);
+
+		setupMouseControl();
+
+		// Load OpenGL functions, gladLoadGL returns the loaded version, 0 on error.
+		int version = gladLoadGL(glfwGetProcAddress);
+		if (version == 0)
+		{
+			std::cerr << "Failed to initialize OpenGL context." << std::endl;
+			return -1;
+		}
+
+		// Usually the framebuffer is the size of the window itself, but on some platforms like Mac this can be 2x the size of the window.
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+	}
 
 	// Background
 	glClearColor(0.2f, 0.2f, 0.25f, 0.0f);
@@ -1263,119 +1009,161 @@ int main(void)
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
 
+	// Three cascades that write as many texels per frame, on average, as one
+	// framebuffer-sized shadow map at the default 1024 x 768
+	int cascadeResolutions[3] = { shadowMapSize, shadowMapSize * 2 / 3, shadowMapSize * 2 / 3 };
+	int cascadeIntervals[3] = { 1, 2, 4 };
+	if (!shadows.initialize(3, cascadeResolutions, cascadeIntervals))
+	{
+		std::cerr << "Failed to create the shadow maps." << std::endl;
+	}
+
+	if (asyncTextures) textureLoader.initialize();
+	readback.initialize();
+	frameLatency.initialize(framesInFlight);
+	simulation.setRate(tickRate);
+	frameLimiter.setRate(maxFrameRate);
+	if (maxFrameRate > 0.0) framePacing.targetMs = 1000.0 / maxFrameRate;
+	if (recorder.initialize(framebufferWidth, framebufferHeight) && recorder.stream != NULL)
+	{
+		fprintf(stderr, "Pipe into an encoder, e.g. | ffmpeg -f rawvideo -pix_fmt %s -s %dx%d -r %g -i - out.mp4\n",
+			recorder.format == FrameRecorder::RECORD_YUV ? "yuv420p" : "rgb24", framebufferWidth, framebufferHeight, (double)tickRate / recorder.interval);
+	}
+	jobs.initialize(jobThreads);
+	shaderLibrary.initialize(headless ? GetHeadlessProcAddress : glfwGetProcAddress, shaderCacheDirectory);
+	char shaderDefines[64];
+	snprintf(shaderDefines, sizeof(shaderDefines), "#define SHADOW_FILTER %d\n", shadowFilter);
+	shaderLibrary.defines = shaderDefines;
+	shaderLibrary.loadPrelude("/Users/selinawang/Downloads/Graphics Final Project/final_project/common.glsl");
+
+	if (bakedDirectory.empty() || !OpenMeshBlob((bakedDirectory + "/scene.mesh").c_str(), sceneBlob, NULL, SceneGeometryHash()))
+	{
+		std::cout << "No baked scene meshes, building them at startup (run asset_bake to bake them)" << std::endl;
+	}
+
+	geometry.initialize();
+	renderQueue.initialize();
+	if (!materials.initialize(SCENE_MATERIAL_COUNT)) {
+		std::cerr << "Failed to create the material array." << std::endl;
+	}
+
     // Create the ground plane
 	Ground b;
 	b.initialize();
 
 	UFO u;
 	u.initialize();
+	CloseMeshBlob(sceneBlob);
 
-	/*
 	// Load the GLTF model
-    std::string gltfFilePath = "/Users/selinawang/Downloads/glTF test/final_project/model/Robot_dog.gltf";
-    auto meshes = LoadGLTFModel(gltfFilePath);
-*/
-    glm::mat4 viewMatrix, projectionMatrix;
-	projectionMatrix = glm::perspective(glm::radians(FoV), (float)windowWidth / windowHeight, zNear, zFar);
-	
-	do
+	std::string gltfFilePath = "/Users/selinawang/Downloads/Graphics Final Project/final_project/model/Robot_dog.gltf";
+	std::string robotBlobPath = bakedDirectory.empty() ? std::string() : bakedDirectory + "/Robot_dog.mesh";
+	GLuint robotProgramID = shaderLibrary.load("/Users/selinawang/Downloads/Graphics Final Project/final_project/robot.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/robot.frag");
+	GLuint robotDepthProgramID = shaderLibrary.load("/Users/selinawang/Downloads/Graphics Final Project/final_project/depth.vert", "/Users/selinawang/Downloads/Graphics Final Project/final_project/depth.frag");
+	GLTFModel robot;
+	if (robot.load(geometry, gltfFilePath, robotBlobPath, renderQueue.registerProgram(robotProgramID), renderQueue.registerProgram(robotDepthProgramID)))
 	{
-		// First pass: Render depth to the FBO
-		glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// Set up light's view and projection matrix
-		glm::mat4 lightProjection = glm::perspective(glm::radians(depthFoV), (float)windowWidth / windowHeight, depthNear, depthFar);
-		glm::mat4 lightView = glm::lookAt(lightPosition, lightTarget, lightUp);
-		glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-
-		b.renderDepth(lightSpaceMatrix);
-
-		// Save the depth texture from the light's perspective (shadowFBO)
-		if (saveDepth) {
-			std::string lightFilename = "depth_light.png";
-			saveDepthTexture(shadowFBO, lightFilename);
-			std::cout << "Depth texture from light's perspective saved to " << lightFilename << std::endl;
-		}
+		robot.placeOnGround(glm::vec3(-278.0f, 0.0f, 300.0f), 250.0f);
+		robotCasterMatrix = robot.modelMatrix;
+		robotCullProxy = cullingTree.insert(TransformAABB(AABB(robot.boundsMin, robot.boundsMax), robot.modelMatrix), cullID(CULL_ROBOT, 0));
+	}
+	shaderLibrary.printStatistics();
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (profiling)
+	{
+		profiler.initialize();
+		shadowPassID = profiler.addPass("shadow");
+		mainPassID = profiler.addPass("main");
+		latencyCounterID = profiler.addCounter("Frame latency (ms)");
+		if (!profileCSVPath.empty()) profiler.openCSV(profileCSVPath.c_str());
+	}
 
-		// Second pass: Render the scene to the default framebuffer
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glm::mat4 projectionMatrix;
+	projectionMatrix = glm::perspective(glm::radians(FoV), (float)windowWidth / windowHeight, zNear, zFar);
+	
+	if (benchmarkFrames > 0)
+	{
+		// Measure the scene with its real textures, not the placeholders
+		textureLoader.finish();
+		runBenchmark(b, u, robot, projectionMatrix);
+	}
+	else
+	{
+		unsigned long long frameCount = 0;
+		std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+		pollInput = true; // Headless runs always benchmark
+		lastInputTime = last;
+		do
+		{
+			frameLimiter.wait();
+			framePacing.tick();
 
-		viewMatrix = glm::lookAt(eye_center, lookat, up);
-		glm::mat4 vp = projectionMatrix * viewMatrix;
+			// A recording is paced by its frames, not by the wall clock
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			double elapsed = std::chrono::duration<double>(now - last).count();
+			last = now;
+			advanceSimulation(u, recorder.initialized ? simulation.step : elapsed);
 
-		// RenderGLTFModel(meshes,vp);
-		b.render(vp, lightSpaceMatrix);
+			textureLoader.update();
+			renderFrame(b, u, robot, projectionMatrix);
+			recorder.update(sceneFBO);
 
-		// Increment the UFO's rotation angle
-    	u.rotationAngle += 0.12f; // Adjust speed as needed
-    	if (u.rotationAngle >= 360.0f) u.rotationAngle -= 360.0f;
-		u.render(vp, lightSpaceMatrix);
+			// Swap buffers; events are processed when the next frame latches the camera
+			glfwSwapBuffers(window);
+			frameLatency.endFrame();
 
-		if (saveDepth) {
-            std::string filename = "depth_camera.png";
-            saveDepthTexture(0, filename);
-            std::cout << "Depth texture from camera's perspective saved to " << filename << std::endl;
-            saveDepth = false;
-        }
+			if (profiling && ++frameCount % profileInterval == 0) profiler.print();
 
-		// Swap buffers
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		} // Check if the ESC key was pressed or the window was closed
+		while (!glfwWindowShouldClose(window));
 
-	} // Check if the ESC key was pressed or the window was closed
-	while (!glfwWindowShouldClose(window));
+		framePacing.print();
+		frameLatency.print();
+	}
 
 	// Clean up
 	b.cleanup();
 	u.cleanup();
-
-	// Close OpenGL window and terminate GLFW
-	glfwTerminate();
+	robot.cleanup();
+	geometry.cleanup();
+	renderQueue.cleanup();
+	shadows.cleanup();
+	readback.cleanup();
+	frameLatency.cleanup();
+	recorder.cleanup();
+	shaderLibrary.release(robotProgramID);
+	shaderLibrary.release(robotDepthProgramID);
+	profiler.cleanup();
+	textureLoader.cleanup();
+	jobs.cleanup();
+	materials.cleanup();
+	shaderLibrary.cleanup();
+
+	if (headless)
+	{
+		glDeleteFramebuffers(1, &sceneFBO);
+		glDeleteRenderbuffers(1, &sceneColorBuffer);
+		glDeleteRenderbuffers(1, &sceneDepthBuffer);
+		DestroyHeadlessContext();
+	}
+	else
+	{
+		// Close OpenGL window and terminate GLFW
+		glfwTerminate();
+	}
 
 	return 0;
 }
 
 static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode)
 {
-	static float moveSpeed = 80.0f;
+	// Movement is polled every frame (see sampleInput); only one-off actions are events
 	if (key == GLFW_KEY_R && action == GLFW_PRESS)
 	{
-		eye_center = glm::vec3(-278.0f, 273.0f, 800.0f);
+		camera.position = glm::vec3(-278.0f, 273.0f, 800.0f);
 		lightPosition = glm::vec3(-275.0f, 500.0f, -275.0f);
 	}
 
-	if ((key == GLFW_KEY_UP || key == GLFW_KEY_W) && (action == GLFW_REPEAT || action == GLFW_PRESS))
-	{
-        glm::vec3 forward = glm::normalize(lookat - eye_center);
-		forward.y = 0; // Keep movement horizontal
-        eye_center += forward * moveSpeed;
-        lookat += forward * moveSpeed;
-	}
-
-	if ((key == GLFW_KEY_DOWN || key == GLFW_KEY_S) && (action == GLFW_REPEAT || action == GLFW_PRESS))
-	{
-        glm::vec3 backward = glm::normalize(eye_center - lookat);
-		backward.y = 0; // Keep movement horizontal
-        eye_center += backward * moveSpeed;
-        lookat += backward * moveSpeed;
-	}
-
-	if ((key == GLFW_KEY_LEFT || key == GLFW_KEY_A) && (action == GLFW_REPEAT || action == GLFW_PRESS))
-	{
-        glm::vec3 left = glm::normalize(glm::cross(up, lookat - eye_center));
-        eye_center += left * moveSpeed;
-        lookat += left * moveSpeed;
-	}
-
-	if ((key == GLFW_KEY_RIGHT || key == GLFW_KEY_D) && (action == GLFW_REPEAT || action == GLFW_PRESS))
-	{
-        glm::vec3 right = glm::normalize(glm::cross(lookat - eye_center, up));
-        eye_center += right * moveSpeed;
-        lookat += right * moveSpeed;
-	}
 	if (key == GLFW_KEY_SPACE && (action == GLFW_REPEAT || action == GLFW_PRESS)) 
     {
         saveDepth = true;
@@ -1384,27 +1172,3 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
 }
-
-static void cursor_callback(GLFWwindow *window, double xpos, double ypos) {
-    // Calculate mouse offsets
-    float xOffset = (float)(xpos - lastX) * mouseSensitivity;
-    float yOffset = (float)(lastY - ypos) * mouseSensitivity; // Reversed since y-coordinates go from bottom to top
-
-    lastX = xpos;
-    lastY = ypos;
-
-    // Update yaw and pitch
-    yaw += xOffset;
-    pitch += yOffset;
-
-    // Constrain pitch to avoid screen flipping
-    if (pitch > 89.0f) pitch = 89.0f;
-    if (pitch < -89.0f) pitch = -89.0f;
-
-    // Calculate the new direction vector
-    glm::vec3 front;
-    front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-    front.y = sin(glm::radians(pitch));
-    front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-    lookat = eye_center + glm::normalize(front);
-}
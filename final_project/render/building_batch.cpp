@@ -0,0 +1,114 @@
+#include "building_batch.h"
+
+#include <cmath>
+#include <cstddef>
+
+AABB BuildingBounds(const BuildingInstance &building)
+{
+	// The unit box spans [-0.5, 0.5] x [0, 1] x [-0.5, 0.5] before the yaw
+	float c = std::fabs(std::cos(building.yaw));
+	float s = std::fabs(std::sin(building.yaw));
+	float halfX = 0.5f * (c * building.size[0] + s * building.size[2]);
+	float halfZ = 0.5f * (s * building.size[0] + c * building.size[2]);
+	glm::vec3 position(building.position[0], building.position[1], building.position[2]);
+	return AABB(position - glm::vec3(halfX, 0.0f, halfZ), position + glm::vec3(halfX, building.size[1], halfZ));
+}
+
+BuildingBatch::BuildingBatch()
+	: arena(NULL), indexCount(0), instanceBufferID(0), program(NULL), depthProgram(NULL), jobs(NULL)
+{
+}
+
+bool BuildingBatch::initialize(GeometryArena &geometry, const MeshRef &box, const std::vector<BuildingInstance> &buildings,
+	RenderProgram *mainProgram, RenderProgram *shadowProgram)
+{
+	arena = &geometry;
+	program = mainProgram;
+	depthProgram = shadowProgram;
+
+	instances = buildings;
+
+	if (!arena->allocate(box, mesh)) return false;
+	indexCount = box.mesh->rangeCount > 0 ? (GLsizei)box.ranges[0].indexCount : (GLsizei)box.mesh->indexCount;
+	for (int k = 0; k < 3; ++k) baseColor[k] = box.mesh->rangeCount > 0 ? box.ranges[0].baseColor[k] : 1.0f;
+
+	// The divisors are recorded in the arena's vertex array once; every pass
+	// streams the instance buffer's contents, and the render queue enables 
+	// the attributes for the draws that name the stream
+	glGenBuffers(1, &instanceBufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+	glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(BuildingInstance), NULL, GL_STREAM_DRAW);
+	arena->bind();
+	for (GLuint location = 4; location <= 6; ++location) glVertexAttribDivisor(location, 1);
+	glBindVertexArray(0);
+
+	stream.bufferID = instanceBufferID;
+	stream.stride = sizeof(BuildingInstance);
+	stream.addAttribute(4, 4, GL_FLOAT, offsetof(BuildingInstance, position));
+	stream.addAttribute(5, 4, GL_FLOAT, offsetof(BuildingInstance, size));
+	stream.addAttribute(6, 2, GL_FLOAT, offsetof(BuildingInstance, uvScale));
+
+	return true;
+}
+
+void BuildingBatch::gather(const std::vector<int> &visible)
+{
+	drawInstances.resize(visible.size());
+	BuildingInstance *destination = drawInstances.data();
+	const BuildingInstance *source = instances.data();
+	const int *indices = visible.data();
+	if (jobs != NULL) {
+		jobs->parallelFor((int)visible.size(), 1024, [=](int begin, int end) {
+			for (int i = begin; i < end; ++i) destination[i] = source[indices[i]];
+		});
+	} else {
+		for (size_t i = 0; i < visible.size(); ++i) destination[i] = source[indices[i]];
+	}
+}
+
+void BuildingBatch::upload()
+{
+	if (drawInstances.empty()) return;
+
+	// Orphan the previous contents so the driver need not wait for the last pass
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+	glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(BuildingInstance), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, drawInstances.size() * sizeof(BuildingInstance), drawInstances.data());
+}
+
+void BuildingBatch::submit(CommandList &list, GLuint materials, const std::vector<int> &visible)
+{
+	gather(visible);
+	if (visible.empty()) return;
+
+	DrawPacket packet;
+	packet.program = program;
+	packet.setGeometry(*arena, mesh, GL_TRIANGLES, 0, indexCount);
+	packet.setTexture(GL_TEXTURE_2D_ARRAY, materials);
+	packet.instances = &stream;
+	packet.instanceCount = (GLsizei)drawInstances.size();
+	packet.object = list.addObject(glm::mat4(1.0f), baseColor, 3);
+	list.submit(packet);
+}
+
+void BuildingBatch::submitDepth(CommandList &list, const std::vector<int> &visible)
+{
+	gather(visible);
+	if (visible.empty()) return;
+
+	DrawPacket packet;
+	packet.program = depthProgram;
+	packet.setGeometry(*arena, mesh, GL_TRIANGLES, 0, indexCount);
+	packet.instances = &stream;
+	packet.instanceCount = (GLsizei)drawInstances.size();
+	list.submit(packet);
+}
+
+void BuildingBatch::cleanup()
+{
+	if (arena != NULL) arena->free(mesh);
+	glDeleteBuffers(1, &instanceBufferID);
+	instanceBufferID = 0;
+	instances.clear();
+	drawInstances.clear();
+}
@@ -0,0 +1,76 @@
+#ifndef _BUILDING_BATCH_H_
+#define _BUILDING_BATCH_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "mesh_blob.h"
+#include "geometry_arena.h"
+#include "render_queue.h"
+#include <core/bvh.h>
+#include <core/job_system.h>
+
+#include <vector>
+
+// Per-instance attributes of one building (locations 4-6 of building.vert)
+struct BuildingInstance {
+	float position[3]; // Centre of the footprint on the ground
+	float yaw;         // Rotation about +y in radians
+	float size[3];     // Width, height and depth
+	float layer;       // Wall material, a layer of the material array
+	float uvScale[2];  // Wall texture repeats across and up
+	float padding[2];
+};
+
+// World-space bounds of one building
+AABB BuildingBounds(const BuildingInstance &building);
+
+// Buildings drawn as instances of one unit box in the geometry arena. Each 
+// pass gathers the instances it can see and records a single instanced 
+// draw, however many buildings and wall textures there are: the walls 
+// sample the material array at the instance's layer. Recording can run on
+// any thread; the GL thread then calls upload() before flushing the pass.
+// The instance buffer is overwritten by every pass, so passes cannot be
+// recorded ahead of one another.
+struct BuildingBatch {
+	GeometryArena *arena;
+	GeometryAllocation mesh;
+	GLsizei indexCount;
+	GLuint instanceBufferID;
+
+	// Indices into this array name buildings
+	std::vector<BuildingInstance> instances;
+
+	// The visible instances of the current pass
+	std::vector<BuildingInstance> drawInstances;
+
+	// The instance buffer as the render queue binds it
+	InstanceStream stream;
+
+	RenderProgram *program;
+	RenderProgram *depthProgram;
+	float baseColor[3]; // From the box's draw range
+
+	// Gathers the visible instances on every thread when set
+	JobSystem *jobs;
+
+	BuildingBatch();
+
+	// Uploads the box mesh into arena and creates the instance buffer; the 
+	// arena and programs are owned by the caller
+	bool initialize(GeometryArena &geometry, const MeshRef &box, const std::vector<BuildingInstance> &buildings,
+		RenderProgram *mainProgram, RenderProgram *shadowProgram);
+
+	// Records the buildings listed in visible (indices into instances);
+	// materials is the GL_TEXTURE_2D_ARRAY their layers index
+	void submit(CommandList &list, GLuint materials, const std::vector<int> &visible);
+	void submitDepth(CommandList &list, const std::vector<int> &visible);
+
+	// Streams the instances of the last recording into the instance buffer
+	void upload();
+	void cleanup();
+
+	// Copies the visible instances into drawInstances
+	void gather(const std::vector<int> &visible);
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "frame_latency.h"
+
+#include <cstdio>
+
+FrameLatency::FrameLatency()
+	: maxFramesInFlight(2), initialized(false), oldest(0), inFlight(0), lastLatency(0.0), submitted(0), throttled(0)
+{
+	for (int i = 0; i <= FRAME_LATENCY_MAX_FRAMES; ++i) {
+		frames[i].fence = 0;
+		frames[i].query = 0;
+		frames[i].submitted = 0;
+	}
+}
+
+void FrameLatency::initialize(int framesInFlight)
+{
+	if (framesInFlight < 1) framesInFlight = 1;
+	if (framesInFlight > FRAME_LATENCY_MAX_FRAMES) framesInFlight = FRAME_LATENCY_MAX_FRAMES;
+	maxFramesInFlight = framesInFlight;
+
+	for (int i = 0; i <= FRAME_LATENCY_MAX_FRAMES; ++i) glGenQueries(1, &frames[i].query);
+	oldest = 0;
+	inFlight = 0;
+	initialized = true;
+}
+
+// Collects the oldest frame in flight once its fence has signalled, or
+// after waiting for it when wait is set
+void FrameLatency::retire(bool wait)
+{
+	Frame &f = frames[oldest];
+	if (wait) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		glClientWaitSync(f.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		waits.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	} else {
+		GLenum status = glClientWaitSync(f.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+	}
+
+	// The query was issued before the fence, so its result is ready now
+	GLint64 completed = 0;
+	glGetQueryObjecti64v(f.query, GL_QUERY_RESULT, &completed);
+	lastLatency = (completed - f.submitted) / 1000000.0;
+	latency.add(lastLatency);
+
+	glDeleteSync(f.fence);
+	f.fence = 0;
+	oldest = (oldest + 1) % (FRAME_LATENCY_MAX_FRAMES + 1);
+	inFlight--;
+}
+
+void FrameLatency::endFrame()
+{
+	if (!initialized) return;
+
+	Frame &f = frames[(oldest + inFlight) % (FRAME_LATENCY_MAX_FRAMES + 1)];
+	glGetInteger64v(GL_TIMESTAMP, &f.submitted);
+	glQueryCounter(f.query, GL_TIMESTAMP);
+	f.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+	inFlight++;
+	submitted++;
+
+	// Take what has finished, then hold the CPU back until the limit is met
+	while (inFlight > 0) {
+		int before = inFlight;
+		retire(false);
+		if (inFlight == before) break;
+	}
+	if (inFlight > maxFramesInFlight) {
+		throttled++;
+		while (inFlight > maxFramesInFlight) retire(true);
+	} else {
+		waits.add(0.0);
+	}
+}
+
+void FrameLatency::finish()
+{
+	if (!initialized) return;
+	while (inFlight > 0) retire(true);
+}
+
+void FrameLatency::reset()
+{
+	latency.clear();
+	waits.clear();
+	submitted = throttled = 0;
+}
+
+void FrameLatency::print() const
+{
+	if (!initialized || latency.count() == 0) return;
+	latency.print("Frame latency (submit to GPU complete)");
+	printf("Frames in flight: at most %d, %lld of %lld frames waited for the GPU, %.3f ms per frame on average\n",
+		maxFramesInFlight, throttled, submitted, waits.avg());
+}
+
+void FrameLatency::cleanup()
+{
+	if (!initialized) return;
+	finish();
+	for (int i = 0; i <= FRAME_LATENCY_MAX_FRAMES; ++i) {
+		glDeleteQueries(1, &frames[i].query);
+		frames[i].query = 0;
+	}
+	initialized = false;
+}
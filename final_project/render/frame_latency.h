@@ -0,0 +1,64 @@
+#ifndef _FRAME_LATENCY_H_
+#define _FRAME_LATENCY_H_
+
+#include <glad/gl.h>
+#include <core/frame_stats.h>
+
+#include <chrono>
+
+// Most frames the controller lets the GPU fall behind by
+#define FRAME_LATENCY_MAX_FRAMES 3
+
+// Bounds how far the CPU runs ahead of the GPU. Left alone, the driver
+// queues several frames behind glfwSwapBuffers, and every queued frame adds
+// to the time between reading the input and showing its result.
+// endFrame() fences each frame once it is submitted and, when more than
+// maxFramesInFlight are unfinished, waits for the oldest one.
+//
+// Each frame's latency, from submission on the CPU to completion on the
+// GPU, is measured on the GPU clock: the GL_TIMESTAMP at submission against
+// a timestamp query issued with the fence. Both are collected once the
+// fence has signalled, so measuring never stalls.
+struct FrameLatency {
+	struct Frame {
+		GLsync fence;
+		GLuint query;
+		GLint64 submitted;  // GPU clock when the frame was submitted, in ns
+	};
+
+	int maxFramesInFlight;
+	bool initialized;
+
+	// One more than the limit: the frame just submitted is fenced before
+	// the oldest is waited for
+	Frame frames[FRAME_LATENCY_MAX_FRAMES + 1];
+	int oldest;
+	int inFlight;
+
+	FrameStats latency;   // Submission to completion, ms
+	FrameStats waits;     // Time endFrame blocked, ms, over every frame
+	double lastLatency;   // Most recent measurement, ms
+	long long submitted;
+	long long throttled;  // Frames that had to wait
+
+	FrameLatency();
+
+	// framesInFlight is clamped to 1 .. FRAME_LATENCY_MAX_FRAMES
+	void initialize(int framesInFlight);
+
+	// Call once per frame after its last command (the swap) is submitted
+	void endFrame();
+
+	// Waits for every frame in flight
+	void finish();
+
+	// Clears the statistics, e.g. after warm-up frames
+	void reset();
+	void print() const;
+	void cleanup();
+
+private:
+	void retire(bool wait);
+};
+
+#endif
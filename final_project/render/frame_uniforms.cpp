@@ -0,0 +1,148 @@
+#include "frame_uniforms.h"
+
+#include <cstring>
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+FrameUniforms::FrameUniforms()
+	: frameBufferID(0), objectBufferID(0), alignment(256), viewOffset(0), viewStride(0), objectStride(0), objectCapacity(0), objectHead(0),
+	frame(), viewCount(0), frameUploads(0), objectUploads(0), objectBytes(0), orphans(0)
+{
+}
+
+bool FrameUniforms::initialize(size_t capacity)
+{
+	GLint offsetAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+	alignment = offsetAlignment > 0 ? (size_t)offsetAlignment : 256;
+
+	viewOffset = alignUp(sizeof(FrameUniformBlock), alignment);
+	viewStride = alignUp(sizeof(ViewUniformBlock), alignment);
+	objectStride = alignUp(sizeof(ObjectUniformBlock), alignment);
+	objectCapacity = alignUp(capacity, objectStride);
+	objectHead = 0;
+
+	glGenBuffers(1, &frameBufferID);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameBufferID);
+	glBufferData(GL_UNIFORM_BUFFER, viewOffset + MAX_FRAME_VIEWS * viewStride, NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &objectBufferID);
+	glBindBuffer(GL_UNIFORM_BUFFER, objectBufferID);
+	glBufferData(GL_UNIFORM_BUFFER, objectCapacity, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	staging.assign(viewOffset + MAX_FRAME_VIEWS * viewStride, 0);
+	return frameBufferID != 0 && objectBufferID != 0;
+}
+
+void FrameUniforms::cleanup()
+{
+	glDeleteBuffers(1, &frameBufferID);
+	glDeleteBuffers(1, &objectBufferID);
+	frameBufferID = objectBufferID = 0;
+	staging.clear();
+}
+
+void FrameUniforms::beginFrame()
+{
+	viewCount = 0;
+}
+
+void FrameUniforms::setLight(const glm::vec3 &position, const glm::vec3 &intensity)
+{
+	frame.lightPosition = glm::vec4(position, 1.0f);
+	frame.lightIntensity = glm::vec4(intensity, 0.0f);
+}
+
+void FrameUniforms::setShadows(const ShadowCascades &shadows)
+{
+	frame.lightSpaceMatrix = shadows.lightSpaceMatrix;
+	frame.cascadeCount = shadows.cascadeCount;
+	for (int i = 0; i < shadows.cascadeCount; ++i) {
+		frame.cascadeCrops[i] = shadows.cascades[i].crop;
+		frame.cascadeScales[i] = glm::vec4((float)shadows.cascades[i].resolution / shadows.size, 0.0f, 0.0f, 0.0f);
+	}
+}
+
+int FrameUniforms::addView(const glm::mat4 &viewProjection)
+{
+	if (viewCount >= MAX_FRAME_VIEWS) return MAX_FRAME_VIEWS - 1;
+	views[viewCount].viewProjection = viewProjection;
+	return viewCount++;
+}
+
+void FrameUniforms::upload()
+{
+	memcpy(&staging[0], &frame, sizeof(frame));
+	for (int i = 0; i < viewCount; ++i) memcpy(&staging[viewOffset + i * viewStride], &views[i], sizeof(ViewUniformBlock));
+
+	// Orphan last frame's copy, which the GPU may still be reading
+	size_t size = viewOffset + (size_t)viewCount * viewStride;
+	glBindBuffer(GL_UNIFORM_BUFFER, frameBufferID);
+	glBufferData(GL_UNIFORM_BUFFER, staging.size(), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, size, staging.data());
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, frameBufferID, 0, sizeof(FrameUniformBlock));
+	frameUploads++;
+}
+
+void FrameUniforms::bindView(int view)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, VIEW_UNIFORMS_BINDING, frameBufferID, viewOffset + (size_t)view * viewStride, sizeof(ViewUniformBlock));
+}
+
+size_t FrameUniforms::uploadObjects(const ObjectUniformBlock *objects, size_t count)
+{
+	size_t size = count * objectStride;
+	glBindBuffer(GL_UNIFORM_BUFFER, objectBufferID);
+	if (size > objectCapacity) {
+		objectCapacity = alignUp(size * 2, objectStride);
+		objectHead = objectCapacity;
+	}
+	if (objectHead + size > objectCapacity) {
+		glBufferData(GL_UNIFORM_BUFFER, objectCapacity, NULL, GL_STREAM_DRAW);
+		objectHead = 0;
+		orphans++;
+	}
+
+	size_t offset = objectHead;
+	unsigned char *mapped = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, offset, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped != NULL) {
+		for (size_t i = 0; i < count; ++i) memcpy(mapped + i * objectStride, &objects[i], sizeof(ObjectUniformBlock));
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	objectHead += size;
+	objectUploads++;
+	objectBytes += (long long)size;
+	return offset;
+}
+
+void FrameUniforms::bindObject(size_t offset)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_UNIFORMS_BINDING, objectBufferID, offset, sizeof(ObjectUniformBlock));
+}
+
+void BindFrameUniformBlocks(GLuint program)
+{
+	static const char *names[3] = { "FrameUniforms", "ViewUniforms", "ObjectUniforms" };
+	static const GLuint bindings[3] = { FRAME_UNIFORMS_BINDING, VIEW_UNIFORMS_BINDING, OBJECT_UNIFORMS_BINDING };
+	for (int i = 0; i < 3; ++i) {
+		GLuint index = glGetUniformBlockIndex(program, names[i]);
+		if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, bindings[i]);
+	}
+
+	// Samplers never change unit, so they are set once here
+	glUseProgram(program);
+	GLint textureSampler = glGetUniformLocation(program, "textureSampler");
+	GLint shadowMap = glGetUniformLocation(program, "shadowMap");
+	if (textureSampler >= 0) glUniform1i(textureSampler, 0);
+	if (shadowMap >= 0) glUniform1i(shadowMap, 1);
+	glUseProgram(0);
+}
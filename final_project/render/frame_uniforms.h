@@ -0,0 +1,95 @@
+#ifndef _FRAME_UNIFORMS_H_
+#define _FRAME_UNIFORMS_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "shadow_cascades.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Uniform buffers shared by every program. common.glsl declares three
+// std140 blocks, each read from a fixed binding point:
+//
+//   FrameUniforms   light and shadow cascades, written once per frame
+//   ViewUniforms    view-projection of the camera or one shadow cascade,
+//                   written once per frame together with the frame block
+//   ObjectUniforms  model matrix and base color of one draw, sub-allocated
+//                   from a ring and bound with glBindBufferRange per draw
+//
+// so a draw changes one buffer range instead of uploading loose uniforms
+// into every program.
+
+#define FRAME_UNIFORMS_BINDING 0
+#define VIEW_UNIFORMS_BINDING 1
+#define OBJECT_UNIFORMS_BINDING 2
+
+#define MAX_FRAME_VIEWS 8
+
+// std140 mirrors of the blocks; must match the declarations in common.glsl
+struct FrameUniformBlock {
+	glm::mat4 lightSpaceMatrix;
+	glm::vec4 lightPosition;  // vec3 in the shaders
+	glm::vec4 lightIntensity; // vec3 in the shaders
+	glm::vec4 cascadeCrops[MAX_SHADOW_CASCADES];
+	glm::vec4 cascadeScales[MAX_SHADOW_CASCADES]; // x only; std140 pads float arrays to 16 bytes
+	int32_t cascadeCount;
+	int32_t padding[3];
+};
+
+struct ViewUniformBlock {
+	glm::mat4 viewProjection;
+};
+
+struct ObjectUniformBlock {
+	glm::mat4 model;
+	glm::vec4 baseColor;
+};
+
+struct FrameUniforms {
+	GLuint frameBufferID;  // The frame block followed by the views
+	GLuint objectBufferID; // Ring of object blocks
+	size_t alignment;      // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	size_t viewOffset;
+	size_t viewStride;
+	size_t objectStride;
+	size_t objectCapacity;
+	size_t objectHead;
+
+	FrameUniformBlock frame;
+	ViewUniformBlock views[MAX_FRAME_VIEWS];
+	int viewCount;
+	std::vector<unsigned char> staging;
+
+	long long frameUploads;
+	long long objectUploads;
+	long long objectBytes;
+	long long orphans;
+
+	FrameUniforms();
+
+	bool initialize(size_t objectCapacity = 256 * 1024);
+	void cleanup();
+
+	// Frame data, kept until upload()
+	void beginFrame();
+	void setLight(const glm::vec3 &position, const glm::vec3 &intensity);
+	void setShadows(const ShadowCascades &shadows);
+	int addView(const glm::mat4 &viewProjection);
+
+	// Writes the frame block and every view in one upload and binds the frame block
+	void upload();
+	void bindView(int view);
+
+	// Copies count blocks into the ring, each at its own aligned offset, and
+	// returns the offset of the first. The ring is orphaned when it wraps, so
+	// a range is never rewritten while the GPU may still read it.
+	size_t uploadObjects(const ObjectUniformBlock *objects, size_t count);
+	void bindObject(size_t offset);
+};
+
+// Points the blocks of program at the binding points above and its
+// samplers at their texture units (textureSampler 0, shadowMap 1)
+void BindFrameUniformBlocks(GLuint program);
+
+#endif
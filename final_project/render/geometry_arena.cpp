@@ -0,0 +1,273 @@
+#include "geometry_arena.h"
+#include "vertex_format.h"
+
+#include <cstdio>
+
+RangeAllocator::RangeAllocator() : capacity(0), used(0)
+{
+}
+
+void RangeAllocator::reset(size_t newCapacity)
+{
+	freeRanges.clear();
+	capacity = newCapacity;
+	used = 0;
+	if (capacity > 0) {
+		Range range = { 0, capacity };
+		freeRanges.push_back(range);
+	}
+}
+
+// Inserts [offset, offset + size) into the sorted free list, merging it with
+// the ranges it touches
+static void insertFree(std::vector<RangeAllocator::Range> &freeRanges, size_t offset, size_t size)
+{
+	size_t i = 0;
+	while (i < freeRanges.size() && freeRanges[i].offset < offset) ++i;
+
+	bool mergesPrevious = i > 0 && freeRanges[i - 1].offset + freeRanges[i - 1].size == offset;
+	bool mergesNext = i < freeRanges.size() && offset + size == freeRanges[i].offset;
+	if (mergesPrevious && mergesNext) {
+		freeRanges[i - 1].size += size + freeRanges[i].size;
+		freeRanges.erase(freeRanges.begin() + i);
+	} else if (mergesPrevious) {
+		freeRanges[i - 1].size += size;
+	} else if (mergesNext) {
+		freeRanges[i].offset = offset;
+		freeRanges[i].size += size;
+	} else {
+		RangeAllocator::Range range = { offset, size };
+		freeRanges.insert(freeRanges.begin() + i, range);
+	}
+}
+
+void RangeAllocator::grow(size_t newCapacity)
+{
+	if (newCapacity <= capacity) return;
+	insertFree(freeRanges, capacity, newCapacity - capacity);
+	capacity = newCapacity;
+}
+
+bool RangeAllocator::allocate(size_t size, size_t alignment, size_t &offset)
+{
+	if (size == 0) {
+		offset = 0;
+		return true;
+	}
+
+	for (size_t i = 0; i < freeRanges.size(); ++i) {
+		Range &range = freeRanges[i];
+		size_t start = (range.offset + alignment - 1) / alignment * alignment;
+		size_t end = range.offset + range.size;
+		if (start + size > end) continue;
+
+		// Whatever alignment skipped stays free in front of the allocation
+		size_t head = start - range.offset;
+		size_t tail = end - (start + size);
+		if (head == 0 && tail == 0) {
+			freeRanges.erase(freeRanges.begin() + i);
+		} else if (head == 0) {
+			range.offset = start + size;
+			range.size = tail;
+		} else if (tail == 0) {
+			range.size = head;
+		} else {
+			range.size = head;
+			Range after = { start + size, tail };
+			freeRanges.insert(freeRanges.begin() + i + 1, after);
+		}
+
+		used += size;
+		offset = start;
+		return true;
+	}
+	return false;
+}
+
+void RangeAllocator::free(size_t offset, size_t size)
+{
+	if (size == 0) return;
+	insertFree(freeRanges, offset, size);
+	used -= size;
+}
+
+size_t RangeAllocator::largestFree() const
+{
+	size_t largest = 0;
+	for (size_t i = 0; i < freeRanges.size(); ++i) {
+		if (freeRanges[i].size > largest) largest = freeRanges[i].size;
+	}
+	return largest;
+}
+
+GeometryAllocation::GeometryAllocation()
+	: baseVertex(0), vertexCount(0), indexOffset(0), indexCount(0), indexType(GL_UNSIGNED_INT), indexSize(4)
+{
+}
+
+GeometryArena::GeometryArena()
+	: vertexArrayID(0), vertexBufferID(0), indexBufferID(0), allocationCount(0), growCount(0)
+{
+}
+
+void GeometryArena::initialize(size_t vertexCapacity, size_t indexCapacity)
+{
+	glGenVertexArrays(1, &vertexArrayID);
+	glBindVertexArray(vertexArrayID);
+
+	glGenBuffers(1, &vertexBufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+	glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(PackedVertex), NULL, GL_STATIC_DRAW);
+	setVertexBuffer();
+
+	glGenBuffers(1, &indexBufferID);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity, NULL, GL_STATIC_DRAW);
+	glBindVertexArray(0);
+
+	vertices.reset(vertexCapacity);
+	indices.reset(indexCapacity);
+	allocationCount = 0;
+	growCount = 0;
+}
+
+void GeometryArena::cleanup()
+{
+	glDeleteBuffers(1, &vertexBufferID);
+	glDeleteBuffers(1, &indexBufferID);
+	glDeleteVertexArrays(1, &vertexArrayID);
+	vertexArrayID = vertexBufferID = indexBufferID = 0;
+	vertices.reset(0);
+	indices.reset(0);
+	allocationCount = 0;
+}
+
+// Points the vertex array, which must be bound, at the vertex buffer bound to GL_ARRAY_BUFFER
+void GeometryArena::setVertexBuffer()
+{
+	MeshBlobSource layout("");
+	SetPackedVertexLayout(layout);
+	for (uint32_t i = 0; i < layout.mesh.attributeCount; ++i) {
+		const MeshBlobAttribute &attribute = layout.mesh.attributes[i];
+		glEnableVertexAttribArray(attribute.location);
+		glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE,
+			layout.mesh.vertexStride, (void *)(size_t)attribute.offset);
+	}
+}
+
+// Replaces buffer by one of newSize bytes holding the first oldSize bytes of it
+static GLuint growBuffer(GLuint buffer, size_t oldSize, size_t newSize)
+{
+	GLuint grown;
+	glGenBuffers(1, &grown);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &buffer);
+	return grown;
+}
+
+void GeometryArena::growVertices(size_t minimum)
+{
+	size_t capacity = vertices.capacity * 2 > vertices.capacity + minimum ? vertices.capacity * 2 : vertices.capacity + minimum;
+	vertexBufferID = growBuffer(vertexBufferID, vertices.capacity * sizeof(PackedVertex), capacity * sizeof(PackedVertex));
+	vertices.grow(capacity);
+	growCount++;
+
+	glBindVertexArray(vertexArrayID);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+	setVertexBuffer();
+	glBindVertexArray(0);
+}
+
+void GeometryArena::growIndices(size_t minimum)
+{
+	size_t capacity = indices.capacity * 2 > indices.capacity + minimum ? indices.capacity * 2 : indices.capacity + minimum;
+	indexBufferID = growBuffer(indexBufferID, indices.capacity, capacity);
+	indices.grow(capacity);
+	growCount++;
+
+	glBindVertexArray(vertexArrayID);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+	glBindVertexArray(0);
+}
+
+bool GeometryArena::allocate(const MeshRef &ref, GeometryAllocation &allocation)
+{
+	const MeshBlobMesh &mesh = *ref.mesh;
+
+	// Baked meshes are already packed; only meshes built in memory in 
+	// another layout are converted on the way in
+	std::vector<PackedVertex> packed;
+	const void *vertexData = ref.vertices;
+	if (!HasPackedVertexLayout(mesh)) {
+		if (!PackVertices(ref, packed)) {
+			printf("Mesh %s has no float positions, it cannot go into the geometry arena\n", mesh.name);
+			return false;
+		}
+		vertexData = packed.data();
+	}
+
+	size_t indexSize = mesh.indexType == GL_UNSIGNED_BYTE ? 1 : mesh.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	size_t indexBytes = (size_t)mesh.indexCount * indexSize;
+
+	// Index ranges stay 4-byte aligned whatever their type
+	size_t vertexOffset, indexOffset;
+	if (!vertices.allocate(mesh.vertexCount, 1, vertexOffset)) {
+		growVertices(mesh.vertexCount);
+		vertices.allocate(mesh.vertexCount, 1, vertexOffset);
+	}
+	if (!indices.allocate(indexBytes, 4, indexOffset)) {
+		growIndices(indexBytes + 4);
+		indices.allocate(indexBytes, 4, indexOffset);
+	}
+
+	// Upload through the copy target, which leaves every vertex array alone
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBufferID);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * sizeof(PackedVertex), (size_t)mesh.vertexCount * sizeof(PackedVertex), vertexData);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBufferID);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, indexBytes, ref.indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	allocation.baseVertex = (GLint)vertexOffset;
+	allocation.vertexCount = mesh.vertexCount;
+	allocation.indexOffset = indexOffset;
+	allocation.indexCount = mesh.indexCount;
+	allocation.indexType = mesh.indexType;
+	allocation.indexSize = indexSize;
+	allocationCount++;
+	return true;
+}
+
+void GeometryArena::free(GeometryAllocation &allocation)
+{
+	if (allocation.vertexCount == 0 && allocation.indexCount == 0) return;
+	vertices.free((size_t)allocation.baseVertex, allocation.vertexCount);
+	indices.free(allocation.indexOffset, (size_t)allocation.indexCount * allocation.indexSize);
+	allocation = GeometryAllocation();
+	allocationCount--;
+}
+
+void GeometryArena::bind() const
+{
+	glBindVertexArray(vertexArrayID);
+}
+
+void GeometryArena::draw(const GeometryAllocation &allocation, GLenum mode, GLuint firstIndex, GLsizei indexCount) const
+{
+	glDrawElementsBaseVertex(mode, indexCount, allocation.indexType, (void *)allocation.indices(firstIndex), allocation.baseVertex);
+}
+
+void GeometryArena::drawInstanced(const GeometryAllocation &allocation, GLenum mode, GLuint firstIndex, GLsizei indexCount, GLsizei instanceCount) const
+{
+	glDrawElementsInstancedBaseVertex(mode, indexCount, allocation.indexType, (void *)allocation.indices(firstIndex), instanceCount, allocation.baseVertex);
+}
+
+void GeometryArena::printStatistics() const
+{
+	printf("Geometry arena: %d meshes, %zu of %zu vertices and %zu of %zu index bytes used, %zu + %zu free ranges, grown %d times\n",
+		allocationCount, vertices.used, vertices.capacity, indices.used, indices.capacity, vertices.freeRanges.size(), indices.freeRanges.size(), growCount);
+}
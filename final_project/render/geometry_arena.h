@@ -0,0 +1,90 @@
+#ifndef _GEOMETRY_ARENA_H_
+#define _GEOMETRY_ARENA_H_
+
+#include <glad/gl.h>
+#include "mesh_blob.h"
+
+#include <cstddef>
+#include <vector>
+
+// First-fit sub-allocator of ranges inside [0, capacity). Freed ranges are
+// merged with their neighbours, so the free list stays short and holes left
+// by unloaded meshes are reused.
+struct RangeAllocator {
+	struct Range {
+		size_t offset;
+		size_t size;
+	};
+
+	std::vector<Range> freeRanges; // Sorted by offset
+	size_t capacity;
+	size_t used;
+
+	RangeAllocator();
+
+	void reset(size_t capacity);
+
+	// Adds [capacity, newCapacity) to the free space
+	void grow(size_t newCapacity);
+
+	bool allocate(size_t size, size_t alignment, size_t &offset);
+	void free(size_t offset, size_t size);
+
+	size_t largestFree() const;
+};
+
+// Where one mesh lives in the arena
+struct GeometryAllocation {
+	GLint baseVertex;   // Added to every index by the BaseVertex draws
+	GLuint vertexCount;
+	size_t indexOffset; // Bytes into the index buffer
+	GLuint indexCount;
+	GLenum indexType;
+	size_t indexSize;
+
+	GeometryAllocation();
+
+	// The offset draw calls take for index firstIndex of the mesh
+	const void *indices(GLuint firstIndex) const { return (const void *)(indexOffset + firstIndex * indexSize); }
+};
+
+// Scene-wide vertex and index buffers that hold every static mesh in the
+// PackedVertex layout (see vertex_format.h), described once by a single
+// vertex array. Meshes are sub-allocated from the two buffers and drawn
+// with glDrawElementsBaseVertex, so going from one mesh to the next never
+// rebinds a buffer or vertex array. Meshes keep their own index type; the
+// buffers double in size, copied on the GPU, when they run out of room.
+struct GeometryArena {
+	GLuint vertexArrayID;
+	GLuint vertexBufferID;
+	GLuint indexBufferID;
+	RangeAllocator vertices; // In vertices
+	RangeAllocator indices;  // In bytes
+	int allocationCount;
+	int growCount;
+
+	GeometryArena();
+
+	void initialize(size_t vertexCapacity = 65536, size_t indexCapacity = 1 << 20);
+	void cleanup();
+
+	// Copies ref's vertices, converted to PackedVertex when stored otherwise,
+	// and its indices into the arena
+	bool allocate(const MeshRef &ref, GeometryAllocation &allocation);
+	void free(GeometryAllocation &allocation);
+
+	// Binds the arena's vertex array, which the draws below expect
+	void bind() const;
+
+	void draw(const GeometryAllocation &allocation, GLenum mode, GLuint firstIndex, GLsizei indexCount) const;
+	void drawInstanced(const GeometryAllocation &allocation, GLenum mode, GLuint firstIndex, GLsizei indexCount, GLsizei instanceCount) const;
+
+	void printStatistics() const;
+
+private:
+	void setVertexBuffer();
+	void growVertices(size_t minimum);
+	void growIndices(size_t minimum);
+};
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef _GL_EXTENSIONS_H_
+#define _GL_EXTENSIONS_H_
+
+#include <glad/gl.h>
+
+// True when the current context is at least the given OpenGL version
+bool HasGLVersion(int major, int minor);
+
+// True when the current context advertises the extension (e.g. "GL_ARB_timer_query")
+bool HasGLExtension(const char *name);
+
+#endif
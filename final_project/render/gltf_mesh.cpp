@@ -0,0 +1,408 @@
+#include "gltf_mesh.h"
+#include "gltf_parser.h"
+#include "vertex_format.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <tiny_gltf.h>
+
+#include <cfloat>
+#include <cstddef>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+
+static bool streamingParser = true;
+
+void SetGLTFStreamingParser(bool enabled)
+{
+	streamingParser = enabled;
+}
+
+// Reads one accessor component as float, applying glTF's normalization rules
+static float readComponent(const unsigned char *element, int componentType, int component, bool normalized)
+{
+	switch (componentType) {
+	case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+		float value;
+		memcpy(&value, element + component * 4, 4);
+		return value;
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+		float value = element[component];
+		return normalized ? value / 255.0f : value;
+	}
+	case TINYGLTF_COMPONENT_TYPE_BYTE: {
+		float value = (signed char)element[component];
+		return normalized ? glm::max(value / 127.0f, -1.0f) : value;
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+		unsigned short value;
+		memcpy(&value, element + component * 2, 2);
+		return normalized ? value / 65535.0f : (float)value;
+	}
+	case TINYGLTF_COMPONENT_TYPE_SHORT: {
+		short value;
+		memcpy(&value, element + component * 2, 2);
+		return normalized ? glm::max(value / 32767.0f, -1.0f) : (float)value;
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+		unsigned int value;
+		memcpy(&value, element + component * 4, 4);
+		return (float)value;
+	}
+	}
+	return 0.0f;
+}
+
+// Returns the first byte of an accessor's data after checking that count
+// elements of elementSize bytes at the accessor's stride fit in the buffer
+static const unsigned char *accessorData(const tinygltf::Model &model, const tinygltf::Accessor &accessor, size_t elementSize, int &stride)
+{
+	if (accessor.bufferView < 0 || accessor.bufferView >= (int)model.bufferViews.size()) return NULL;
+	const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
+	if (view.buffer < 0 || view.buffer >= (int)model.buffers.size()) return NULL;
+	const tinygltf::Buffer &buffer = model.buffers[view.buffer];
+
+	stride = accessor.ByteStride(view);
+	if (stride <= 0) return NULL;
+
+	size_t start = view.byteOffset + accessor.byteOffset;
+	if (accessor.count > 0 && start + (accessor.count - 1) * (size_t)stride + elementSize > buffer.data.size()) return NULL;
+	return buffer.data.data() + start;
+}
+
+// Reads up to components values per element; missing components are zero
+static bool readFloats(const tinygltf::Model &model, int accessorIndex, int components, std::vector<float> &out)
+{
+	if (accessorIndex < 0 || accessorIndex >= (int)model.accessors.size()) return false;
+	const tinygltf::Accessor &accessor = model.accessors[accessorIndex];
+
+	int available = tinygltf::GetNumComponentsInType((uint32_t)accessor.type);
+	int componentSize = tinygltf::GetComponentSizeInBytes((uint32_t)accessor.componentType);
+	if (available <= 0 || componentSize <= 0) return false;
+
+	int stride = 0;
+	const unsigned char *data = accessorData(model, accessor, (size_t)available * componentSize, stride);
+	if (data == NULL) return false;
+
+	out.assign(accessor.count * components, 0.0f);
+	for (size_t i = 0; i < accessor.count; ++i) {
+		const unsigned char *element = data + i * stride;
+		for (int c = 0; c < components && c < available; ++c) {
+			out[i * components + c] = readComponent(element, accessor.componentType, c, accessor.normalized);
+		}
+	}
+	return true;
+}
+
+static bool readIndices(const tinygltf::Model &model, int accessorIndex, std::vector<unsigned int> &out)
+{
+	if (accessorIndex < 0 || accessorIndex >= (int)model.accessors.size()) return false;
+	const tinygltf::Accessor &accessor = model.accessors[accessorIndex];
+
+	int componentSize = tinygltf::GetComponentSizeInBytes((uint32_t)accessor.componentType);
+	if (componentSize <= 0) return false;
+
+	int stride = 0;
+	const unsigned char *data = accessorData(model, accessor, componentSize, stride);
+	if (data == NULL) return false;
+
+	out.resize(accessor.count);
+	for (size_t i = 0; i < accessor.count; ++i) {
+		const unsigned char *element = data + i * stride;
+		switch (accessor.componentType) {
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+			out[i] = element[0];
+			break;
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+			unsigned short value;
+			memcpy(&value, element, 2);
+			out[i] = value;
+			break;
+		}
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+			unsigned int value;
+			memcpy(&value, element, 4);
+			out[i] = value;
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+// Area-weighted vertex normals for primitives that come without them
+static void generateNormals(std::vector<GLTFVertex> &vertices, size_t firstVertex, const std::vector<unsigned int> &indices, size_t firstIndex, size_t indexCount)
+{
+	for (size_t i = firstIndex; i + 2 < firstIndex + indexCount; i += 3) {
+		GLTFVertex &a = vertices[indices[i]];
+		GLTFVertex &b = vertices[indices[i + 1]];
+		GLTFVertex &c = vertices[indices[i + 2]];
+		glm::vec3 pa(a.position[0], a.position[1], a.position[2]);
+		glm::vec3 pb(b.position[0], b.position[1], b.position[2]);
+		glm::vec3 pc(c.position[0], c.position[1], c.position[2]);
+		glm::vec3 n = glm::cross(pb - pa, pc - pa);
+		for (int k = 0; k < 3; ++k) {
+			a.normal[k] += n[k];
+			b.normal[k] += n[k];
+			c.normal[k] += n[k];
+		}
+	}
+	for (size_t v = firstVertex; v < vertices.size(); ++v) {
+		glm::vec3 n(vertices[v].normal[0], vertices[v].normal[1], vertices[v].normal[2]);
+		float length = glm::length(n);
+		n = length > 0.0f ? n / length : glm::vec3(0.0f, 1.0f, 0.0f);
+		for (int k = 0; k < 3; ++k) vertices[v].normal[k] = n[k];
+	}
+}
+
+static bool buildMesh(const tinygltf::Model &model, const tinygltf::Mesh &mesh, GLTFMeshData &data)
+{
+	data.name = mesh.name;
+	data.boundsMin = glm::vec3(FLT_MAX);
+	data.boundsMax = glm::vec3(-FLT_MAX);
+
+	for (size_t p = 0; p < mesh.primitives.size(); ++p) {
+		const tinygltf::Primitive &primitive = mesh.primitives[p];
+
+		std::map<std::string, int>::const_iterator position = primitive.attributes.find("POSITION");
+		if (position == primitive.attributes.end()) continue;
+
+		std::vector<float> positions, normals, uvs;
+		if (!readFloats(model, position->second, 3, positions)) {
+			std::cerr << "glTF mesh " << mesh.name << ": unreadable POSITION accessor" << std::endl;
+			return false;
+		}
+		size_t vertexCount = positions.size() / 3;
+
+		std::map<std::string, int>::const_iterator normal = primitive.attributes.find("NORMAL");
+		bool hasNormals = normal != primitive.attributes.end() && readFloats(model, normal->second, 3, normals) && normals.size() == vertexCount * 3;
+
+		std::map<std::string, int>::const_iterator uv = primitive.attributes.find("TEXCOORD_0");
+		bool hasUVs = uv != primitive.attributes.end() && readFloats(model, uv->second, 2, uvs) && uvs.size() == vertexCount * 2;
+
+		// Append this primitive's vertices to the mesh's interleaved array
+		size_t firstVertex = data.vertices.size();
+		data.vertices.resize(firstVertex + vertexCount);
+		for (size_t i = 0; i < vertexCount; ++i) {
+			GLTFVertex &vertex = data.vertices[firstVertex + i];
+			for (int k = 0; k < 3; ++k) {
+				vertex.position[k] = positions[i * 3 + k];
+				vertex.normal[k] = hasNormals ? normals[i * 3 + k] : 0.0f;
+				data.boundsMin[k] = glm::min(data.boundsMin[k], vertex.position[k]);
+				data.boundsMax[k] = glm::max(data.boundsMax[k], vertex.position[k]);
+			}
+			vertex.uv[0] = hasUVs ? uvs[i * 2] : 0.0f;
+			vertex.uv[1] = hasUVs ? uvs[i * 2 + 1] : 0.0f;
+		}
+
+		// Indices are rebased onto the shared vertex array
+		std::vector<unsigned int> indices;
+		if (primitive.indices >= 0) {
+			if (!readIndices(model, primitive.indices, indices)) {
+				std::cerr << "glTF mesh " << mesh.name << ": unreadable index accessor" << std::endl;
+				return false;
+			}
+		} else {
+			indices.resize(vertexCount);
+			for (size_t i = 0; i < vertexCount; ++i) indices[i] = (unsigned int)i;
+		}
+
+		GLTFPrimitive range;
+		range.mode = primitive.mode >= 0 ? (GLenum)primitive.mode : GL_TRIANGLES;
+		range.indexCount = (GLsizei)indices.size();
+		range.firstIndex = data.indices.size();
+		range.baseColor = glm::vec4(1.0f);
+		range.doubleSided = false;
+		if (primitive.material >= 0 && primitive.material < (int)model.materials.size()) {
+			const tinygltf::Material &material = model.materials[primitive.material];
+			const std::vector<double> &factor = material.pbrMetallicRoughness.baseColorFactor;
+			if (factor.size() == 4) range.baseColor = glm::vec4((float)factor[0], (float)factor[1], (float)factor[2], (float)factor[3]);
+			range.doubleSided = material.doubleSided;
+		}
+
+		for (size_t i = 0; i < indices.size(); ++i) {
+			if (indices[i] >= vertexCount) {
+				std::cerr << "glTF mesh " << mesh.name << ": index out of range" << std::endl;
+				return false;
+			}
+			data.indices.push_back(indices[i] + (unsigned int)firstVertex);
+		}
+
+		if (!hasNormals && range.mode == GL_TRIANGLES) {
+			generateNormals(data.vertices, firstVertex, data.indices, range.firstIndex, range.indexCount);
+		}
+		data.primitives.push_back(range);
+	}
+	return true;
+}
+
+static glm::mat4 nodeTransform(const tinygltf::Node &node)
+{
+	if (node.matrix.size() == 16) {
+		glm::mat4 matrix;
+		for (int c = 0; c < 4; ++c) {
+			for (int r = 0; r < 4; ++r) matrix[c][r] = (float)node.matrix[c * 4 + r];
+		}
+		return matrix;
+	}
+
+	glm::mat4 transform(1.0f);
+	if (node.translation.size() == 3) {
+		transform = glm::translate(transform, glm::vec3((float)node.translation[0], (float)node.translation[1], (float)node.translation[2]));
+	}
+	if (node.rotation.size() == 4) {
+		// glTF stores x, y, z, w; glm::quat takes w first
+		glm::quat rotation((float)node.rotation[3], (float)node.rotation[0], (float)node.rotation[1], (float)node.rotation[2]);
+		transform = transform * glm::mat4_cast(rotation);
+	}
+	if (node.scale.size() == 3) {
+		transform = glm::scale(transform, glm::vec3((float)node.scale[0], (float)node.scale[1], (float)node.scale[2]));
+	}
+	return transform;
+}
+
+static void collectInstances(const tinygltf::Model &model, int nodeIndex, const glm::mat4 &parent, int depth, std::vector<GLTFMeshInstance> &instances)
+{
+	// The depth limit guards against malformed files with cycles
+	if (nodeIndex < 0 || nodeIndex >= (int)model.nodes.size() || depth > 64) return;
+	const tinygltf::Node &node = model.nodes[nodeIndex];
+	glm::mat4 transform = parent * nodeTransform(node);
+
+	if (node.mesh >= 0 && node.mesh < (int)model.meshes.size()) {
+		GLTFMeshInstance instance;
+		instance.mesh = node.mesh;
+		instance.transform = transform;
+		instances.push_back(instance);
+	}
+	for (size_t i = 0; i < node.children.size(); ++i) {
+		collectInstances(model, node.children[i], transform, depth + 1, instances);
+	}
+}
+
+bool BuildGLTFMeshData(const tinygltf::Model &model, std::vector<GLTFMeshData> &meshes, std::vector<GLTFMeshInstance> &instances)
+{
+	meshes.resize(model.meshes.size());
+	for (size_t i = 0; i < model.meshes.size(); ++i) {
+		if (!buildMesh(model, model.meshes[i], meshes[i])) return false;
+	}
+
+	instances.clear();
+	if (!model.scenes.empty()) {
+		int scene = model.defaultScene >= 0 && model.defaultScene < (int)model.scenes.size() ? model.defaultScene : 0;
+		const std::vector<int> &roots = model.scenes[scene].nodes;
+		for (size_t i = 0; i < roots.size(); ++i) collectInstances(model, roots[i], glm::mat4(1.0f), 0, instances);
+	} else {
+		// No scene: every node that is nobody's child is a root
+		std::vector<bool> isChild(model.nodes.size(), false);
+		for (size_t i = 0; i < model.nodes.size(); ++i) {
+			for (size_t c = 0; c < model.nodes[i].children.size(); ++c) {
+				int child = model.nodes[i].children[c];
+				if (child >= 0 && child < (int)isChild.size()) isChild[child] = true;
+			}
+		}
+		for (size_t i = 0; i < model.nodes.size(); ++i) {
+			if (!isChild[i]) collectInstances(model, (int)i, glm::mat4(1.0f), 0, instances);
+		}
+	}
+
+	// Files with meshes but no nodes still show their meshes
+	if (instances.empty()) {
+		for (size_t i = 0; i < meshes.size(); ++i) {
+			GLTFMeshInstance instance;
+			instance.mesh = (int)i;
+			instance.transform = glm::mat4(1.0f);
+			instances.push_back(instance);
+		}
+	}
+	return true;
+}
+
+bool LoadGLTFMeshData(const std::string &path, std::vector<GLTFMeshData> &meshes, std::vector<GLTFMeshInstance> &instances)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	tinygltf::Model model;
+	std::string err;
+	std::string warn;
+
+	bool loaded = false;
+	bool ascii = path.size() >= 5 && path.compare(path.size() - 5, 5, ".gltf") == 0;
+	if (streamingParser && ascii) {
+		loaded = LoadGLTFStreaming(path, model, err);
+		if (!loaded) {
+			std::cerr << "Streaming glTF parser: " << err << ", falling back to tinygltf" << std::endl;
+			model = tinygltf::Model();
+			err.clear();
+		}
+	}
+
+	if (!loaded) {
+		tinygltf::TinyGLTF loader;
+		loaded = ascii ? loader.LoadASCIIFromFile(&model, &err, &warn, path) : loader.LoadBinaryFromFile(&model, &err, &warn, path);
+	}
+
+	if (!loaded) {
+		std::cerr << "Failed to load GLTF: " << err << std::endl;
+		return false;
+	}
+
+	if (!warn.empty()) {
+		std::cerr << "GLTF Warning: " << warn << std::endl;
+	}
+
+	bool built = BuildGLTFMeshData(model, meshes, instances);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Loaded " << path << " in " << ms << " ms" << std::endl;
+	return built;
+}
+
+void BuildGLTFMeshSource(const GLTFMeshData &data, MeshBlobSource &source)
+{
+	source = MeshBlobSource(data.name.c_str());
+
+	// Packed as the geometry arena stores it, so baked meshes upload as they are
+	std::vector<PackedVertex> vertices(data.vertices.size());
+	for (size_t i = 0; i < data.vertices.size(); ++i) {
+		const GLTFVertex &vertex = data.vertices[i];
+		PackedVertex &packed = vertices[i];
+		memcpy(packed.position, vertex.position, sizeof(packed.position));
+		packed.material = packed.padding = 0;
+		packed.normal = PackNormal(vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+		packed.uv[0] = PackHalf(vertex.uv[0]);
+		packed.uv[1] = PackHalf(vertex.uv[1]);
+	}
+	source.vertices.assign((const unsigned char *)vertices.data(), (const unsigned char *)(vertices.data() + vertices.size()));
+
+	// 16-bit indices whenever the mesh is small enough
+	if (data.vertices.size() <= 65535) {
+		std::vector<GLushort> indices(data.indices.begin(), data.indices.end());
+		source.indices.assign((const unsigned char *)indices.data(), (const unsigned char *)(indices.data() + indices.size()));
+		source.mesh.indexType = GL_UNSIGNED_SHORT;
+	} else {
+		source.indices.assign((const unsigned char *)data.indices.data(), (const unsigned char *)(data.indices.data() + data.indices.size()));
+		source.mesh.indexType = GL_UNSIGNED_INT;
+	}
+
+	source.mesh.vertexCount = (uint32_t)data.vertices.size();
+	source.mesh.indexCount = (uint32_t)data.indices.size();
+	SetPackedVertexLayout(source);
+	for (int k = 0; k < 3; ++k) {
+		source.mesh.boundsMin[k] = data.vertices.empty() ? 0.0f : data.boundsMin[k];
+		source.mesh.boundsMax[k] = data.vertices.empty() ? 0.0f : data.boundsMax[k];
+	}
+
+	for (size_t i = 0; i < data.primitives.size(); ++i) {
+		const GLTFPrimitive &primitive = data.primitives[i];
+		MeshBlobRange range;
+		range.mode = primitive.mode;
+		range.firstIndex = (uint32_t)primitive.firstIndex;
+		range.indexCount = (uint32_t)primitive.indexCount;
+		range.flags = primitive.doubleSided ? MESH_BLOB_DOUBLE_SIDED : 0;
+		for (int k = 0; k < 4; ++k) range.baseColor[k] = primitive.baseColor[k];
+		source.addRange(range);
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef _GLTF_MESH_H_
+#define _GLTF_MESH_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "mesh_blob.h"
+
+#include <string>
+#include <vector>
+
+namespace tinygltf {
+class Model;
+}
+
+// Interleaved vertex layout of glTF meshes (locations match scene.vert)
+struct GLTFVertex {
+	float position[3]; // location 0
+	float normal[3];   // location 2
+	float uv[2];       // location 3
+};
+
+// Draw range of one glTF primitive inside its mesh's index buffer
+struct GLTFPrimitive {
+	GLenum mode;
+	GLsizei indexCount;
+	size_t firstIndex;
+	glm::vec4 baseColor;
+	bool doubleSided;
+};
+
+// CPU-side geometry of one glTF mesh: every primitive's attributes appended 
+// into one interleaved vertex array and one index array
+struct GLTFMeshData {
+	std::string name;
+	std::vector<GLTFVertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<GLTFPrimitive> primitives;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
+// A mesh placed by the node hierarchy of the default scene
+struct GLTFMeshInstance {
+	int mesh;
+	glm::mat4 transform;
+};
+
+// Converts a parsed glTF model into interleaved mesh data. Honours accessor 
+// byte strides, normalized integer attributes and every index component 
+// type; missing normals are generated and missing UVs are zero.
+bool BuildGLTFMeshData(const tinygltf::Model &model, std::vector<GLTFMeshData> &meshes, std::vector<GLTFMeshInstance> &instances);
+
+// Repacks mesh data into blob layout: PackedVertex (see vertex_format.h) and 
+// 16-bit indices when they fit. Used both by tools/asset_bake and when no 
+// baked blob exists (see gltf_model.h)
+void BuildGLTFMeshSource(const GLTFMeshData &data, MeshBlobSource &source);
+
+// Parses path and builds its mesh data. .gltf files go through the 
+// streaming parser (see gltf_parser.h) and fall back to tinygltf when it 
+// meets something it does not handle; .glb files always use tinygltf.
+bool LoadGLTFMeshData(const std::string &path, std::vector<GLTFMeshData> &meshes, std::vector<GLTFMeshInstance> &instances);
+
+
+// Enables the streaming .gltf parser (default on)
+void SetGLTFStreamingParser(bool enabled);
+
+#endif
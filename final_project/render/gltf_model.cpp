@@ -0,0 +1,142 @@
+#include "gltf_model.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cfloat>
+#include <cstring>
+
+GLTFModel::GLTFModel() 
+	: arena(NULL), modelMatrix(1.0f), boundsMin(0.0f), boundsMax(0.0f), program(NULL), depthProgram(NULL)
+{
+}
+
+bool GLTFModel::initialize(GeometryArena &geometry, const std::vector<MeshRef> &meshRefs, const std::vector<GLTFMeshInstance> &meshInstances,
+	RenderProgram *mainProgram, RenderProgram *shadowProgram)
+{
+	arena = &geometry;
+	program = mainProgram;
+	depthProgram = shadowProgram;
+	instances = meshInstances;
+
+	for (size_t m = 0; m < meshRefs.size(); ++m) {
+		const MeshRef &ref = meshRefs[m];
+		GLTFMesh mesh;
+		for (uint32_t i = 0; i < ref.mesh->rangeCount; ++i) {
+			const MeshBlobRange &range = ref.ranges[i];
+			GLTFPrimitive primitive;
+			primitive.mode = range.mode;
+			primitive.indexCount = (GLsizei)range.indexCount;
+			primitive.firstIndex = range.firstIndex;
+			primitive.baseColor = glm::vec4(range.baseColor[0], range.baseColor[1], range.baseColor[2], range.baseColor[3]);
+			primitive.doubleSided = (range.flags & MESH_BLOB_DOUBLE_SIDED) != 0;
+			mesh.primitives.push_back(primitive);
+		}
+
+		// Converted to the arena's packed layout on the way in
+		if (!arena->allocate(ref, mesh.geometry)) mesh.primitives.clear();
+		meshes.push_back(mesh);
+	}
+
+	// Model-space bounds of every placed mesh
+	boundsMin = glm::vec3(FLT_MAX);
+	boundsMax = glm::vec3(-FLT_MAX);
+	for (size_t i = 0; i < instances.size(); ++i) {
+		const MeshBlobMesh &source = *meshRefs[instances[i].mesh].mesh;
+		if (source.vertexCount == 0) continue;
+		for (int corner = 0; corner < 8; ++corner) {
+			glm::vec3 p((corner & 1) ? source.boundsMax[0] : source.boundsMin[0],
+				(corner & 2) ? source.boundsMax[1] : source.boundsMin[1],
+				(corner & 4) ? source.boundsMax[2] : source.boundsMin[2]);
+			glm::vec3 world = glm::vec3(instances[i].transform * glm::vec4(p, 1.0f));
+			boundsMin = glm::min(boundsMin, world);
+			boundsMax = glm::max(boundsMax, world);
+		}
+	}
+
+	return !meshes.empty();
+}
+
+bool GLTFModel::load(GeometryArena &geometry, const std::string &path, const std::string &bakedPath, RenderProgram *mainProgram, RenderProgram *shadowProgram)
+{
+	std::vector<MeshRef> refs;
+	std::vector<GLTFMeshInstance> meshInstances;
+
+	// The baked blob is uploaded straight from its mapping
+	MeshBlob blob;
+	if (!bakedPath.empty() && OpenMeshBlob(bakedPath.c_str(), blob, path.c_str())) {
+		for (uint32_t i = 0; i < blob.header->meshCount; ++i) refs.push_back(GetMeshBlobMesh(blob, (int)i));
+		for (uint32_t i = 0; i < blob.header->instanceCount; ++i) {
+			GLTFMeshInstance instance;
+			instance.mesh = (int)blob.instances[i].mesh;
+			memcpy(&instance.transform[0][0], blob.instances[i].transform, sizeof(blob.instances[i].transform));
+			meshInstances.push_back(instance);
+		}
+		bool ok = initialize(geometry, refs, meshInstances, mainProgram, shadowProgram);
+		CloseMeshBlob(blob);
+		return ok;
+	}
+
+	std::vector<GLTFMeshData> data;
+	if (!LoadGLTFMeshData(path, data, meshInstances)) return false;
+	std::vector<MeshBlobSource> sources(data.size(), MeshBlobSource(""));
+	for (size_t i = 0; i < data.size(); ++i) {
+		BuildGLTFMeshSource(data[i], sources[i]);
+		refs.push_back(GetMeshSource(sources[i]));
+	}
+	return initialize(geometry, refs, meshInstances, mainProgram, shadowProgram);
+}
+
+void GLTFModel::placeOnGround(const glm::vec3 &position, float height)
+{
+	glm::vec3 size = boundsMax - boundsMin;
+	float scale = size.y > 0.0f ? height / size.y : 1.0f;
+	glm::vec3 anchor((boundsMin.x + boundsMax.x) * 0.5f, boundsMin.y, (boundsMin.z + boundsMax.z) * 0.5f);
+
+	modelMatrix = glm::translate(glm::mat4(1.0f), position);
+	modelMatrix = glm::scale(modelMatrix, glm::vec3(scale));
+	modelMatrix = glm::translate(modelMatrix, -anchor);
+}
+
+void GLTFModel::submit(CommandList &list)
+{
+	for (size_t i = 0; i < instances.size(); ++i) {
+		const GLTFMesh &mesh = meshes[instances[i].mesh];
+		glm::mat4 model = modelMatrix * instances[i].transform;
+
+		DrawPacket packet;
+		packet.program = program;
+		for (size_t p = 0; p < mesh.primitives.size(); ++p) {
+			const GLTFPrimitive &primitive = mesh.primitives[p];
+			packet.setGeometry(*arena, mesh.geometry, primitive.mode, (GLuint)primitive.firstIndex, primitive.indexCount);
+			packet.object = list.addObject(model, &primitive.baseColor[0], 4);
+			packet.doubleSided = primitive.doubleSided;
+			list.submit(packet);
+		}
+	}
+}
+
+void GLTFModel::submitDepth(CommandList &list)
+{
+	for (size_t i = 0; i < instances.size(); ++i) {
+		const GLTFMesh &mesh = meshes[instances[i].mesh];
+
+		DrawPacket packet;
+		packet.program = depthProgram;
+		packet.object = list.addObject(modelMatrix * instances[i].transform);
+		for (size_t p = 0; p < mesh.primitives.size(); ++p) {
+			const GLTFPrimitive &primitive = mesh.primitives[p];
+			packet.setGeometry(*arena, mesh.geometry, primitive.mode, (GLuint)primitive.firstIndex, primitive.indexCount);
+			packet.doubleSided = primitive.doubleSided;
+			list.submit(packet);
+		}
+	}
+}
+
+void GLTFModel::cleanup()
+{
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		arena->free(meshes[i].geometry);
+	}
+	meshes.clear();
+	instances.clear();
+}
@@ -0,0 +1,55 @@
+#ifndef _GLTF_MODEL_H_
+#define _GLTF_MODEL_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "gltf_mesh.h"
+#include "mesh_blob.h"
+#include "geometry_arena.h"
+#include "render_queue.h"
+
+#include <string>
+#include <vector>
+
+// The runtime side of glTF models: gltf_mesh.h loads and converts them,
+// which is all tools/asset_bake needs, and this uploads and draws them.
+
+struct GLTFMesh {
+	GeometryAllocation geometry;
+	std::vector<GLTFPrimitive> primitives;
+};
+
+// A glTF model uploaded once into the geometry arena and submitted to the 
+// render queue in both the main and shadow pass
+struct GLTFModel {
+	GeometryArena *arena;
+	std::vector<GLTFMesh> meshes;
+	std::vector<GLTFMeshInstance> instances;
+	glm::mat4 modelMatrix;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+
+	RenderProgram *program;
+	RenderProgram *depthProgram;
+
+	GLTFModel();
+
+	// Uploads meshes into arena, from a mapped blob or built in memory; the 
+	// arena and programs are owned by the caller
+	bool initialize(GeometryArena &geometry, const std::vector<MeshRef> &meshRefs, const std::vector<GLTFMeshInstance> &meshInstances,
+		RenderProgram *mainProgram, RenderProgram *shadowProgram);
+
+	// Uploads the blob at bakedPath when it was baked from the current path, 
+	// otherwise parses path
+	bool load(GeometryArena &geometry, const std::string &path, const std::string &bakedPath, RenderProgram *mainProgram, RenderProgram *shadowProgram);
+
+	// Scales and moves the model so it stands on the ground at position with the given height
+	void placeOnGround(const glm::vec3 &position, float height);
+
+	// Submit every placed mesh to the queue's current view
+	void submit(CommandList &list);
+	void submitDepth(CommandList &list);
+	void cleanup();
+};
+
+#endif
@@ -0,0 +1,717 @@
+#include "gltf_parser.h"
+
+#include <core/base64.h>
+#include <tiny_gltf.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+// Size of the window the JSON text is read through
+#define GLTF_PARSER_CHUNK_SIZE (64 * 1024)
+
+// Nesting limit when skipping unknown values
+#define GLTF_PARSER_MAX_DEPTH 64
+
+// Pull parser over a chunked file. Every parse function skips leading 
+// whitespace, consumes exactly one JSON value and returns false on error 
+// with the first error message kept in error.
+struct GLTFReader {
+	FILE *file;
+	std::vector<char> chunk;
+	size_t pos;
+	size_t end;
+	size_t consumed; // file offset of chunk[0]
+	size_t fileSize;
+	std::string directory;
+	std::string error;
+
+	GLTFReader() : file(NULL), chunk(GLTF_PARSER_CHUNK_SIZE), pos(0), end(0), consumed(0), fileSize(0) {}
+
+	bool fill()
+	{
+		if (pos < end) return true;
+		consumed += end;
+		pos = 0;
+		end = fread(chunk.data(), 1, chunk.size(), file);
+		return end > 0;
+	}
+
+	int peek()
+	{
+		if (pos == end && !fill()) return -1;
+		return (unsigned char)chunk[pos];
+	}
+
+	int get()
+	{
+		int c = peek();
+		if (c >= 0) ++pos;
+		return c;
+	}
+
+	// Next significant character, not consumed
+	int next()
+	{
+		for (;;) {
+			int c = peek();
+			if (c != ' ' && c != '\t' && c != '\n' && c != '\r') return c;
+			++pos;
+		}
+	}
+
+	bool fail(const std::string &message)
+	{
+		if (error.empty()) {
+			std::ostringstream stream;
+			stream << message << " at byte " << consumed + pos;
+			error = stream.str();
+		}
+		return false;
+	}
+
+	bool expect(char c)
+	{
+		if (next() != c) return fail(std::string("expected '") + c + "'");
+		++pos;
+		return true;
+	}
+
+	bool literal(const char *text)
+	{
+		for (; *text; ++text) {
+			if (get() != *text) return fail("invalid literal");
+		}
+		return true;
+	}
+
+	// Iterates the members of an object after its '{': returns false at 
+	// the closing '}' or on error
+	bool member(bool &first, std::string &key)
+	{
+		int c = next();
+		if (c == '}') {
+			++pos;
+			return false;
+		}
+		if (!first) {
+			if (c != ',') return fail("expected ',' or '}'");
+			++pos;
+		}
+		first = false;
+		return parseString(key) && expect(':');
+	}
+
+	// Iterates the elements of an array after its '['
+	bool element(bool &first)
+	{
+		int c = next();
+		if (c == ']') {
+			++pos;
+			return false;
+		}
+		if (!first) {
+			if (c != ',') return fail("expected ',' or ']'");
+			++pos;
+		}
+		first = false;
+		return true;
+	}
+
+	int hexDigit()
+	{
+		int c = get();
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		fail("invalid \\u escape");
+		return -1;
+	}
+
+	bool codeUnit(unsigned int &unit)
+	{
+		unit = 0;
+		for (int i = 0; i < 4; ++i) {
+			int digit = hexDigit();
+			if (digit < 0) return false;
+			unit = unit << 4 | digit;
+		}
+		return true;
+	}
+
+	// Decodes the escape sequence after a backslash and appends it as UTF-8
+	bool parseEscape(std::string &out)
+	{
+		int c = get();
+		switch (c) {
+		case '"': out += '"'; return true;
+		case '\\': out += '\\'; return true;
+		case '/': out += '/'; return true;
+		case 'b': out += '\b'; return true;
+		case 'f': out += '\f'; return true;
+		case 'n': out += '\n'; return true;
+		case 'r': out += '\r'; return true;
+		case 't': out += '\t'; return true;
+		case 'u': break;
+		default: return fail("invalid escape");
+		}
+
+		unsigned int code = 0;
+		if (!codeUnit(code)) return false;
+		if (code >= 0xD800 && code < 0xDC00) {
+			unsigned int low = 0;
+			if (get() != '\\' || get() != 'u' || !codeUnit(low) || low < 0xDC00 || low > 0xDFFF) return fail("invalid surrogate pair");
+			code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+		}
+
+		if (code < 0x80) {
+			out += (char)code;
+		} else if (code < 0x800) {
+			out += (char)(0xC0 | code >> 6);
+			out += (char)(0x80 | (code & 0x3F));
+		} else if (code < 0x10000) {
+			out += (char)(0xE0 | code >> 12);
+			out += (char)(0x80 | (code >> 6 & 0x3F));
+			out += (char)(0x80 | (code & 0x3F));
+		} else {
+			out += (char)(0xF0 | code >> 18);
+			out += (char)(0x80 | (code >> 12 & 0x3F));
+			out += (char)(0x80 | (code >> 6 & 0x3F));
+			out += (char)(0x80 | (code & 0x3F));
+		}
+		return true;
+	}
+
+	// Reads a string; with out == NULL the characters are only skipped
+	bool readString(std::string *out)
+	{
+		if (!expect('"')) return false;
+		for (;;) {
+			if (pos == end && !fill()) return fail("unterminated string");
+
+			// Copy the run up to the next quote or backslash in one go
+			const char *start = chunk.data() + pos;
+			size_t available = end - pos;
+			const char *quote = (const char *)memchr(start, '"', available);
+			size_t run = quote ? quote - start : available;
+			const char *backslash = (const char *)memchr(start, '\\', run);
+			if (backslash) run = backslash - start;
+
+			if (out) out->append(start, run);
+			pos += run;
+
+			if (backslash) {
+				++pos;
+				std::string escaped;
+				if (!parseEscape(escaped)) return false;
+				if (out) *out += escaped;
+			} else if (quote) {
+				++pos;
+				return true;
+			}
+		}
+	}
+
+	bool parseString(std::string &out)
+	{
+		out.clear();
+		return readString(&out);
+	}
+
+	bool parseNumber(double &value)
+	{
+		char text[64];
+		size_t length = 0;
+		next();
+		for (;;) {
+			int c = peek();
+			if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E')) break;
+			if (length + 1 == sizeof(text)) return fail("number too long");
+			text[length++] = (char)c;
+			++pos;
+		}
+		text[length] = '\0';
+
+		char *last = NULL;
+		value = strtod(text, &last);
+		if (length == 0 || last != text + length) return fail("invalid number");
+		return true;
+	}
+
+	bool parseInt(int &value)
+	{
+		double number = 0.0;
+		if (!parseNumber(number)) return false;
+		value = (int)number;
+		return true;
+	}
+
+	bool parseSize(size_t &value)
+	{
+		double number = 0.0;
+		if (!parseNumber(number)) return false;
+		if (number < 0.0) return fail("negative size");
+		value = (size_t)number;
+		return true;
+	}
+
+	bool parseBool(bool &value)
+	{
+		int c = next();
+		value = c == 't';
+		return literal(value ? "true" : "false");
+	}
+
+	bool parseNumbers(std::vector<double> &values)
+	{
+		values.clear();
+		if (!expect('[')) return false;
+		bool first = true;
+		while (element(first)) {
+			double value = 0.0;
+			if (!parseNumber(value)) return false;
+			values.push_back(value);
+		}
+		return error.empty();
+	}
+
+	bool parseInts(std::vector<int> &values)
+	{
+		values.clear();
+		if (!expect('[')) return false;
+		bool first = true;
+		while (element(first)) {
+			int value = 0;
+			if (!parseInt(value)) return false;
+			values.push_back(value);
+		}
+		return error.empty();
+	}
+
+	bool parseStrings(std::vector<std::string> &values)
+	{
+		values.clear();
+		if (!expect('[')) return false;
+		bool first = true;
+		while (element(first)) {
+			values.push_back(std::string());
+			if (!parseString(values.back())) return false;
+		}
+		return error.empty();
+	}
+
+	bool skipValue(int depth = 0)
+	{
+		if (depth > GLTF_PARSER_MAX_DEPTH) return fail("nesting too deep");
+
+		bool first = true;
+		std::string key;
+		switch (next()) {
+		case '{':
+			++pos;
+			while (member(first, key)) {
+				if (!skipValue(depth + 1)) return false;
+			}
+			return error.empty();
+		case '[':
+			++pos;
+			while (element(first)) {
+				if (!skipValue(depth + 1)) return false;
+			}
+			return error.empty();
+		case '"':
+			return readString(NULL);
+		case 't':
+			return literal("true");
+		case 'f':
+			return literal("false");
+		case 'n':
+			return literal("null");
+		default: {
+			double number = 0.0;
+			return parseNumber(number);
+		}
+		}
+	}
+
+	template <typename T>
+	bool parseArray(std::vector<T> &items, bool (GLTFReader::*parseItem)(T &))
+	{
+		items.clear();
+		if (!expect('[')) return false;
+		bool first = true;
+		while (element(first)) {
+			items.push_back(T());
+			if (!(this->*parseItem)(items.back())) return false;
+		}
+		return error.empty();
+	}
+
+	// Decodes the payload of a base64 data URI (after its ',') straight into 
+	// buffer.data as it is read. Without a byteLength the buffer is sized for 
+	// the rest of the file, an upper bound, and trimmed afterwards.
+	bool decodeDataURI(tinygltf::Buffer &buffer, size_t byteLength)
+	{
+		size_t capacity = byteLength > 0 ? byteLength : Base64DecodedSize(fileSize - (consumed + pos));
+		buffer.data.resize(capacity + 3);
+
+		Base64Stream stream;
+		size_t written = 0;
+		for (;;) {
+			if (pos == end && !fill()) return fail("unterminated data URI");
+
+			const char *start = chunk.data() + pos;
+			size_t available = end - pos;
+			const char *quote = (const char *)memchr(start, '"', available);
+			size_t run = quote ? quote - start : available;
+			const char *backslash = (const char *)memchr(start, '\\', run);
+			if (backslash) run = backslash - start;
+
+			if (written + Base64DecodedSize(run + 3) > buffer.data.size()) return fail("data URI is longer than byteLength");
+			size_t decoded = 0;
+			if (!stream.push(start, run, buffer.data.data() + written, decoded)) return fail("invalid base64 data");
+			written += decoded;
+			pos += run;
+
+			if (backslash) {
+				// JSON writers may escape '/' as "\/"
+				++pos;
+				if (get() != '/') return fail("unexpected escape in base64 data");
+				if (!stream.push("/", 1, buffer.data.data() + written, decoded)) return fail("invalid base64 data");
+				written += decoded;
+			} else if (quote) {
+				++pos;
+				break;
+			}
+		}
+		if (!stream.finish()) return fail("truncated base64 data");
+
+		// Shrinking keeps the allocation, so nothing is copied
+		buffer.data.resize(written);
+		return true;
+	}
+
+	// Reads a buffer's uri; data URIs are decoded in place and only their 
+	// header is kept in buffer.uri
+	bool parseBufferURI(tinygltf::Buffer &buffer, size_t byteLength)
+	{
+		std::string &uri = buffer.uri;
+		uri.clear();
+		if (!expect('"')) return false;
+		for (;;) {
+			int c = get();
+			if (c < 0) return fail("unterminated string");
+			if (c == '"') return true;
+			if (c == '\\') {
+				if (!parseEscape(uri)) return false;
+			} else if (c == ',' && uri.compare(0, 5, "data:") == 0) {
+				if (uri.size() < 7 || uri.compare(uri.size() - 7, 7, ";base64") != 0) return fail("data URI is not base64");
+				uri += ',';
+				return decodeDataURI(buffer, byteLength);
+			} else {
+				uri += (char)c;
+			}
+		}
+	}
+
+	bool loadExternalBuffer(tinygltf::Buffer &buffer)
+	{
+		// Undo percent-encoding of the relative path
+		std::string name;
+		for (size_t i = 0; i < buffer.uri.size(); ++i) {
+			if (buffer.uri[i] == '%' && i + 2 < buffer.uri.size()) {
+				name += (char)strtol(buffer.uri.substr(i + 1, 2).c_str(), NULL, 16);
+				i += 2;
+			} else {
+				name += buffer.uri[i];
+			}
+		}
+
+		std::string path = directory + name;
+		FILE *binary = fopen(path.c_str(), "rb");
+		if (binary == NULL) return fail("cannot open buffer " + path);
+		fseek(binary, 0, SEEK_END);
+		long size = ftell(binary);
+		fseek(binary, 0, SEEK_SET);
+
+		buffer.data.resize(size > 0 ? (size_t)size : 0);
+		bool ok = fread(buffer.data.data(), 1, buffer.data.size(), binary) == buffer.data.size();
+		fclose(binary);
+		if (!ok) return fail("cannot read buffer " + path);
+		return true;
+	}
+
+	bool parseBuffer(tinygltf::Buffer &buffer)
+	{
+		if (!expect('{')) return false;
+		size_t byteLength = 0;
+		bool external = false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			bool ok;
+			if (key == "byteLength") {
+				ok = parseSize(byteLength);
+			} else if (key == "uri") {
+				ok = parseBufferURI(buffer, byteLength);
+				external = buffer.uri.compare(0, 5, "data:") != 0;
+			} else if (key == "name") {
+				ok = parseString(buffer.name);
+			} else {
+				ok = skipValue();
+			}
+			if (!ok) return false;
+		}
+		if (!error.empty()) return false;
+
+		if (external && !loadExternalBuffer(buffer)) return false;
+		if (buffer.data.size() < byteLength) return fail("buffer is shorter than its byteLength");
+		buffer.data.resize(byteLength);
+		return true;
+	}
+
+	bool parseBufferView(tinygltf::BufferView &view)
+	{
+		if (!expect('{')) return false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			bool ok;
+			if (key == "buffer") ok = parseInt(view.buffer);
+			else if (key == "byteOffset") ok = parseSize(view.byteOffset);
+			else if (key == "byteLength") ok = parseSize(view.byteLength);
+			else if (key == "byteStride") ok = parseSize(view.byteStride);
+			else if (key == "target") ok = parseInt(view.target);
+			else if (key == "name") ok = parseString(view.name);
+			else ok = skipValue();
+			if (!ok) return false;
+		}
+		return error.empty();
+	}
+
+	bool parseAccessorType(int &type)
+	{
+		std::string name;
+		if (!parseString(name)) return false;
+		if (name == "SCALAR") type = TINYGLTF_TYPE_SCALAR;
+		else if (name == "VEC2") type = TINYGLTF_TYPE_VEC2;
+		else if (name == "VEC3") type = TINYGLTF_TYPE_VEC3;
+		else if (name == "VEC4") type = TINYGLTF_TYPE_VEC4;
+		else if (name == "MAT2") type = TINYGLTF_TYPE_MAT2;
+		else if (name == "MAT3") type = TINYGLTF_TYPE_MAT3;
+		else if (name == "MAT4") type = TINYGLTF_TYPE_MAT4;
+		else return fail("unknown accessor type " + name);
+		return true;
+	}
+
+	bool parseAccessor(tinygltf::Accessor &accessor)
+	{
+		if (!expect('{')) return false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			bool ok;
+			if (key == "bufferView") ok = parseInt(accessor.bufferView);
+			else if (key == "byteOffset") ok = parseSize(accessor.byteOffset);
+			else if (key == "componentType") ok = parseInt(accessor.componentType);
+			else if (key == "normalized") ok = parseBool(accessor.normalized);
+			else if (key == "count") ok = parseSize(accessor.count);
+			else if (key == "type") ok = parseAccessorType(accessor.type);
+			else if (key == "min") ok = parseNumbers(accessor.minValues);
+			else if (key == "max") ok = parseNumbers(accessor.maxValues);
+			else if (key == "name") ok = parseString(accessor.name);
+			else if (key == "sparse") ok = fail("sparse accessors are not supported");
+			else ok = skipValue();
+			if (!ok) return false;
+		}
+		return error.empty();
+	}
+
+	bool parseAttributes(std::map<std::string, int> &attributes)
+	{
+		if (!expect('{')) return false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			int accessor = -1;
+			if (!parseInt(accessor)) return false;
+			attributes[key] = accessor;
+		}
+		return error.empty();
+	}
+
+	bool parsePrimitive(tinygltf::Primitive &primitive)
+	{
+		primitive.mode = TINYGLTF_MODE_TRIANGLES;
+		if (!expect('{')) return false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			bool ok;
+			if (key == "attributes") ok = parseAttributes(primitive.attributes);
+			else if (key == "indices") ok = parseInt(primitive.indices);
+			else if (key == "material") ok = parseInt(primitive.material);
+			else if (key == "mode") ok = parseInt(primitive.mode);
+			else ok = skipValue();
+			if (!ok) return false;
+		}
+		return error.empty();
+	}
+
+	bool parseMesh(tinygltf::Mesh &mesh)
+	{
+		if (!expect('{')) return false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			bool ok;
+			if (key == "primitives") ok = parseArray(mesh.primitives, &GLTFReader::parsePrimitive);
+			else if (key == "name") ok = parseString(mesh.name);
+			else ok = skipValue();
+			if (!ok) return false;
+		}
+		return error.empty();
+	}
+
+	bool parsePbrMetallicRoughness(tinygltf::PbrMetallicRoughness &pbr)
+	{
+		if (!expect('{')) return false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			bool ok;
+			if (key == "baseColorFactor") ok = parseNumbers(pbr.baseColorFactor);
+			else if (key == "metallicFactor") ok = parseNumber(pbr.metallicFactor);
+			else if (key == "roughnessFactor") ok = parseNumber(pbr.roughnessFactor);
+			else ok = skipValue();
+			if (!ok) return false;
+		}
+		return error.empty();
+	}
+
+	bool parseMaterial(tinygltf::Material &material)
+	{
+		if (!expect('{')) return false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			bool ok;
+			if (key == "pbrMetallicRoughness") ok = parsePbrMetallicRoughness(material.pbrMetallicRoughness);
+			else if (key == "doubleSided") ok = parseBool(material.doubleSided);
+			else if (key == "alphaMode") ok = parseString(material.alphaMode);
+			else if (key == "alphaCutoff") ok = parseNumber(material.alphaCutoff);
+			else if (key == "emissiveFactor") ok = parseNumbers(material.emissiveFactor);
+			else if (key == "name") ok = parseString(material.name);
+			else ok = skipValue();
+			if (!ok) return false;
+		}
+		return error.empty();
+	}
+
+	bool parseNode(tinygltf::Node &node)
+	{
+		if (!expect('{')) return false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			bool ok;
+			if (key == "mesh") ok = parseInt(node.mesh);
+			else if (key == "children") ok = parseInts(node.children);
+			else if (key == "translation") ok = parseNumbers(node.translation);
+			else if (key == "rotation") ok = parseNumbers(node.rotation);
+			else if (key == "scale") ok = parseNumbers(node.scale);
+			else if (key == "matrix") ok = parseNumbers(node.matrix);
+			else if (key == "camera") ok = parseInt(node.camera);
+			else if (key == "skin") ok = parseInt(node.skin);
+			else if (key == "name") ok = parseString(node.name);
+			else ok = skipValue();
+			if (!ok) return false;
+		}
+		return error.empty();
+	}
+
+	bool parseScene(tinygltf::Scene &scene)
+	{
+		if (!expect('{')) return false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			bool ok;
+			if (key == "nodes") ok = parseInts(scene.nodes);
+			else if (key == "name") ok = parseString(scene.name);
+			else ok = skipValue();
+			if (!ok) return false;
+		}
+		return error.empty();
+	}
+
+	bool parseAsset(tinygltf::Asset &asset)
+	{
+		if (!expect('{')) return false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			bool ok;
+			if (key == "version") ok = parseString(asset.version);
+			else if (key == "generator") ok = parseString(asset.generator);
+			else if (key == "minVersion") ok = parseString(asset.minVersion);
+			else if (key == "copyright") ok = parseString(asset.copyright);
+			else ok = skipValue();
+			if (!ok) return false;
+		}
+		return error.empty();
+	}
+
+	bool parseModel(tinygltf::Model &model)
+	{
+		if (!expect('{')) return false;
+		bool first = true;
+		std::string key;
+		while (member(first, key)) {
+			bool ok;
+			if (key == "asset") ok = parseAsset(model.asset);
+			else if (key == "scene") ok = parseInt(model.defaultScene);
+			else if (key == "scenes") ok = parseArray(model.scenes, &GLTFReader::parseScene);
+			else if (key == "nodes") ok = parseArray(model.nodes, &GLTFReader::parseNode);
+			else if (key == "meshes") ok = parseArray(model.meshes, &GLTFReader::parseMesh);
+			else if (key == "materials") ok = parseArray(model.materials, &GLTFReader::parseMaterial);
+			else if (key == "accessors") ok = parseArray(model.accessors, &GLTFReader::parseAccessor);
+			else if (key == "bufferViews") ok = parseArray(model.bufferViews, &GLTFReader::parseBufferView);
+			else if (key == "buffers") ok = parseArray(model.buffers, &GLTFReader::parseBuffer);
+			else if (key == "extensionsUsed") ok = parseStrings(model.extensionsUsed);
+			else if (key == "extensionsRequired") ok = parseStrings(model.extensionsRequired);
+			else ok = skipValue();
+			if (!ok) return false;
+		}
+		if (!error.empty()) return false;
+
+		if (next() != -1) return fail("trailing characters");
+		if (model.asset.version.compare(0, 1, "2") != 0) return fail("unsupported glTF version '" + model.asset.version + "'");
+		if (!model.extensionsRequired.empty()) return fail("required extension " + model.extensionsRequired[0] + " is not supported");
+		return true;
+	}
+};
+
+bool LoadGLTFStreaming(const std::string &path, tinygltf::Model &model, std::string &err)
+{
+	GLTFReader reader;
+	reader.file = fopen(path.c_str(), "rb");
+	if (reader.file == NULL) {
+		err = "cannot open " + path;
+		return false;
+	}
+	fseek(reader.file, 0, SEEK_END);
+	long size = ftell(reader.file);
+	fseek(reader.file, 0, SEEK_SET);
+	reader.fileSize = size > 0 ? (size_t)size : 0;
+
+	size_t slash = path.find_last_of("/\\");
+	reader.directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+
+	bool ok = reader.parseModel(model);
+	fclose(reader.file);
+
+	if (!ok) err = path + ": " + reader.error;
+	return ok;
+}
@@ -0,0 +1,19 @@
+#ifndef _GLTF_PARSER_H_
+#define _GLTF_PARSER_H_
+
+#include <string>
+
+namespace tinygltf {
+class Model;
+}
+
+// Parses a .gltf file into model while reading it in fixed-size chunks; the 
+// JSON is never held in memory as a whole. Base64 data URIs are decoded 
+// straight into their Buffer as the characters arrive, and external .bin 
+// buffers are read into place. Fills buffers, bufferViews, accessors, 
+// meshes, materials (factors only), nodes and scenes; images, textures, 
+// skins and animations are skipped. Sparse accessors and required 
+// extensions are reported as errors so the caller can fall back to tinygltf.
+bool LoadGLTFStreaming(const std::string &path, tinygltf::Model &model, std::string &err);
+
+#endif
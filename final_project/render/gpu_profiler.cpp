@@ -0,0 +1,280 @@
+#include "gpu_profiler.h"
+#include "gl_extensions.h"
+
+#include <cstring>
+
+#ifndef GL_VERTICES_SUBMITTED_ARB
+#define GL_VERTICES_SUBMITTED_ARB 0x82EE
+#define GL_PRIMITIVES_SUBMITTED_ARB 0x82EF
+#define GL_VERTEX_SHADER_INVOCATIONS_ARB 0x82F0
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#define GL_CLIPPING_INPUT_PRIMITIVES_ARB 0x82F6
+#endif
+
+static const GLenum statisticTargets[GPU_STAT_COUNT] = {
+	GL_VERTICES_SUBMITTED_ARB,
+	GL_PRIMITIVES_SUBMITTED_ARB,
+	GL_VERTEX_SHADER_INVOCATIONS_ARB,
+	GL_CLIPPING_INPUT_PRIMITIVES_ARB,
+	GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+};
+
+static const char *statisticNames[GPU_STAT_COUNT] = {
+	"vertices",
+	"primitives",
+	"vs_invocations",
+	"clip_primitives",
+	"fs_invocations",
+};
+
+GpuProfiler::GpuProfiler() 
+	: enabled(false), pipelineStatistics(false), history(240), frame(0), droppedFrames(0), 
+	activePass(-1), csv(NULL), csvHeaderWritten(false)
+{
+	for (int i = 0; i < GPU_PROFILER_FRAMES; ++i) {
+		pending[i] = false;
+		slotFrame[i] = 0;
+	}
+}
+
+void GpuProfiler::initialize(size_t historyLength)
+{
+	enabled = true;
+	history = historyLength;
+	pipelineStatistics = HasGLExtension("GL_ARB_pipeline_statistics_query") || HasGLVersion(4, 6);
+	if (!pipelineStatistics) {
+		printf("GPU profiler: pipeline statistics queries are not supported, timing only.\n");
+	}
+}
+
+void GpuProfiler::cleanup()
+{
+	for (size_t i = 0; i < passes.size(); ++i) {
+		glDeleteQueries(GPU_PROFILER_FRAMES, passes[i].timeQueries);
+		if (pipelineStatistics) {
+			glDeleteQueries(GPU_PROFILER_FRAMES * GPU_STAT_COUNT, &passes[i].statQueries[0][0]);
+		}
+	}
+	passes.clear();
+	counters.clear();
+
+	if (csv != NULL) {
+		fclose(csv);
+		csv = NULL;
+	}
+	enabled = false;
+}
+
+void GpuProfiler::reset()
+{
+	for (size_t i = 0; i < passes.size(); ++i) {
+		passes[i].gpuTime.clear();
+		for (int s = 0; s < GPU_STAT_COUNT; ++s) passes[i].statistics[s].clear();
+	}
+	for (size_t i = 0; i < counters.size(); ++i) counters[i].stats.clear();
+	droppedFrames = 0;
+}
+
+int GpuProfiler::addPass(const char *name)
+{
+	Pass pass;
+	pass.name = name;
+	pass.gpuTime = FrameStats(history);
+	for (int s = 0; s < GPU_STAT_COUNT; ++s) {
+		pass.statistics[s] = FrameStats(history);
+		pass.lastStatistics[s] = 0.0;
+	}
+	memset(pass.timeQueries, 0, sizeof(pass.timeQueries));
+	memset(pass.statQueries, 0, sizeof(pass.statQueries));
+	memset(pass.issued, 0, sizeof(pass.issued));
+
+	if (enabled) {
+		glGenQueries(GPU_PROFILER_FRAMES, pass.timeQueries);
+		if (pipelineStatistics) {
+			glGenQueries(GPU_PROFILER_FRAMES * GPU_STAT_COUNT, &pass.statQueries[0][0]);
+		}
+	}
+
+	passes.push_back(pass);
+	return (int)passes.size() - 1;
+}
+
+int GpuProfiler::addCounter(const char *name)
+{
+	Counter counter;
+	counter.name = name;
+	counter.stats = FrameStats(history);
+	for (int i = 0; i < GPU_PROFILER_FRAMES; ++i) counter.values[i] = 0.0;
+	counters.push_back(counter);
+	return (int)counters.size() - 1;
+}
+
+void GpuProfiler::beginFrame()
+{
+	if (!enabled) return;
+
+	int slot = (int)(frame % GPU_PROFILER_FRAMES);
+	if (pending[slot] && !collect(slot)) {
+		// The GPU is more than GPU_PROFILER_FRAMES behind; waiting here would stall
+		pending[slot] = false;
+		droppedFrames++;
+	}
+
+	slotFrame[slot] = frame;
+	for (size_t i = 0; i < passes.size(); ++i) passes[i].issued[slot] = false;
+	for (size_t i = 0; i < counters.size(); ++i) counters[i].values[slot] = 0.0;
+}
+
+void GpuProfiler::beginPass(int pass)
+{
+	if (!enabled || pass < 0) return;
+
+	int slot = (int)(frame % GPU_PROFILER_FRAMES);
+	Pass &p = passes[pass];
+
+	// Only one GL_TIME_ELAPSED query can be active, so passes must not nest
+	if (activePass >= 0) endPass(activePass);
+
+	glBeginQuery(GL_TIME_ELAPSED, p.timeQueries[slot]);
+	if (pipelineStatistics) {
+		for (int s = 0; s < GPU_STAT_COUNT; ++s) glBeginQuery(statisticTargets[s], p.statQueries[slot][s]);
+	}
+	p.issued[slot] = true;
+	activePass = pass;
+}
+
+void GpuProfiler::endPass(int pass)
+{
+	if (!enabled || pass < 0 || pass != activePass) return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	if (pipelineStatistics) {
+		for (int s = 0; s < GPU_STAT_COUNT; ++s) glEndQuery(statisticTargets[s]);
+	}
+	activePass = -1;
+}
+
+void GpuProfiler::setCounter(int counter, double value)
+{
+	if (!enabled || counter < 0) return;
+	counters[counter].values[frame % GPU_PROFILER_FRAMES] = value;
+}
+
+void GpuProfiler::endFrame()
+{
+	if (!enabled) return;
+	if (activePass >= 0) endPass(activePass);
+
+	int slot = (int)(frame % GPU_PROFILER_FRAMES);
+	pending[slot] = true;
+	frame++;
+
+	// Collect older frames first so rows reach the CSV file in order
+	for (int i = 1; i < GPU_PROFILER_FRAMES; ++i) {
+		int older = (int)((frame + i - 1) % GPU_PROFILER_FRAMES);
+		if (pending[older] && !collect(older)) break;
+	}
+}
+
+bool GpuProfiler::collect(int slot)
+{
+	// Check every query first so a partially available frame is left untouched
+	for (size_t i = 0; i < passes.size(); ++i) {
+		if (!passes[i].issued[slot]) continue;
+		GLint available = 0;
+		glGetQueryObjectiv(passes[i].timeQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return false;
+		if (pipelineStatistics) {
+			glGetQueryObjectiv(passes[i].statQueries[slot][GPU_STAT_COUNT - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) return false;
+		}
+	}
+
+	for (size_t i = 0; i < passes.size(); ++i) {
+		Pass &p = passes[i];
+		if (!p.issued[slot]) continue;
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(p.timeQueries[slot], GL_QUERY_RESULT, &elapsed);
+		p.gpuTime.add(elapsed / 1.0e6);
+
+		if (pipelineStatistics) {
+			for (int s = 0; s < GPU_STAT_COUNT; ++s) {
+				GLuint64 value = 0;
+				glGetQueryObjectui64v(p.statQueries[slot][s], GL_QUERY_RESULT, &value);
+				p.lastStatistics[s] = (double)value;
+				p.statistics[s].add((double)value);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < counters.size(); ++i) counters[i].stats.add(counters[i].values[slot]);
+
+	if (csv != NULL) writeCSVRow(slotFrame[slot], slot);
+	pending[slot] = false;
+	return true;
+}
+
+void GpuProfiler::print() const
+{
+	if (!enabled) return;
+
+	for (size_t i = 0; i < passes.size(); ++i) {
+		const Pass &p = passes[i];
+		if (p.gpuTime.count() == 0) continue;
+		std::string label = "GPU " + p.name;
+		p.gpuTime.print(label.c_str());
+		if (pipelineStatistics) {
+			printf("    ");
+			for (int s = 0; s < GPU_STAT_COUNT; ++s) printf("%s %.0f  ", statisticNames[s], p.statistics[s].avg());
+			printf("\n");
+		}
+	}
+	for (size_t i = 0; i < counters.size(); ++i) {
+		const Counter &c = counters[i];
+		printf("%s: avg %.3f, min %.3f, p99 %.3f, max %.3f\n", c.name.c_str(), c.stats.avg(), c.stats.min(), c.stats.percentile(99.0), c.stats.max());
+	}
+	if (droppedFrames > 0) printf("GPU profiler: %llu frames dropped (results not ready in time)\n", droppedFrames);
+}
+
+bool GpuProfiler::openCSV(const char *path)
+{
+	csv = fopen(path, "w");
+	if (csv == NULL) {
+		printf("Failed to open profiler CSV file %s\n", path);
+		return false;
+	}
+	csvHeaderWritten = false;
+	return true;
+}
+
+void GpuProfiler::writeCSVRow(unsigned long long frameNumber, int slot)
+{
+	if (!csvHeaderWritten) {
+		fprintf(csv, "frame");
+		for (size_t i = 0; i < passes.size(); ++i) {
+			fprintf(csv, ",%s_ms", passes[i].name.c_str());
+			if (pipelineStatistics) {
+				for (int s = 0; s < GPU_STAT_COUNT; ++s) fprintf(csv, ",%s_%s", passes[i].name.c_str(), statisticNames[s]);
+			}
+		}
+		for (size_t i = 0; i < counters.size(); ++i) fprintf(csv, ",%s", counters[i].name.c_str());
+		fprintf(csv, "\n");
+		csvHeaderWritten = true;
+	}
+
+	fprintf(csv, "%llu", frameNumber);
+	for (size_t i = 0; i < passes.size(); ++i) {
+		const Pass &p = passes[i];
+		if (p.issued[slot]) fprintf(csv, ",%.4f", p.gpuTime.last());
+		else fprintf(csv, ",");
+		if (pipelineStatistics) {
+			for (int s = 0; s < GPU_STAT_COUNT; ++s) {
+				if (p.issued[slot]) fprintf(csv, ",%.0f", p.lastStatistics[s]);
+				else fprintf(csv, ",");
+			}
+		}
+	}
+	for (size_t i = 0; i < counters.size(); ++i) fprintf(csv, ",%.4f", counters[i].values[slot]);
+	fprintf(csv, "\n");
+}
@@ -0,0 +1,93 @@
+#ifndef _GPU_PROFILER_H_
+#define _GPU_PROFILER_H_
+
+#include <glad/gl.h>
+#include <core/frame_stats.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Number of frames whose queries can be in flight at once. Results are read 
+// back a frame late and only when the driver reports them available, so the 
+// profiler never stalls the pipeline; frames still pending when their query 
+// slot comes round again are dropped.
+#define GPU_PROFILER_FRAMES 2
+
+// Pipeline statistics collected per pass when GL_ARB_pipeline_statistics_query is available
+enum GpuStatistic {
+	GPU_STAT_VERTICES_SUBMITTED,
+	GPU_STAT_PRIMITIVES_SUBMITTED,
+	GPU_STAT_VERTEX_INVOCATIONS,
+	GPU_STAT_CLIPPING_INPUT_PRIMITIVES,
+	GPU_STAT_FRAGMENT_INVOCATIONS,
+	GPU_STAT_COUNT
+};
+
+// Times render passes with GL_TIME_ELAPSED queries and keeps rolling 
+// per-pass statistics. CPU-side counters (e.g. draw calls) can be recorded 
+// alongside and end up in the same report and CSV file.
+struct GpuProfiler {
+	struct Pass {
+		std::string name;
+		GLuint timeQueries[GPU_PROFILER_FRAMES];
+		GLuint statQueries[GPU_PROFILER_FRAMES][GPU_STAT_COUNT];
+		bool issued[GPU_PROFILER_FRAMES];
+		FrameStats gpuTime;
+		FrameStats statistics[GPU_STAT_COUNT];
+		double lastStatistics[GPU_STAT_COUNT];
+	};
+
+	struct Counter {
+		std::string name;
+		double values[GPU_PROFILER_FRAMES];
+		FrameStats stats;
+	};
+
+	GpuProfiler();
+
+	// history is the number of frames kept for the rolling statistics
+	void initialize(size_t history = 240);
+	void cleanup();
+
+	// Clears the rolling statistics, e.g. after warm-up frames
+	void reset();
+
+	int addPass(const char *name);
+	int addCounter(const char *name);
+
+	void beginFrame();
+	void beginPass(int pass);
+	void endPass(int pass);
+	void setCounter(int counter, double value);
+	void endFrame();
+
+	// One line per pass and counter with the rolling statistics
+	void print() const;
+
+	// Writes one row per collected frame to path; the header is written with 
+	// the first row, so register passes and counters before that.
+	bool openCSV(const char *path);
+
+	bool enabled;
+	bool pipelineStatistics;
+	size_t history;
+	unsigned long long frame;
+	unsigned long long droppedFrames;
+	int activePass;
+
+	std::vector<Pass> passes;
+	std::vector<Counter> counters;
+
+	bool pending[GPU_PROFILER_FRAMES];
+	unsigned long long slotFrame[GPU_PROFILER_FRAMES];
+
+	FILE *csv;
+	bool csvHeaderWritten;
+
+private:
+	bool collect(int slot);
+	void writeCSVRow(unsigned long long frameNumber, int slot);
+};
+
+#endif
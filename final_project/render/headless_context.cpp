@@ -0,0 +1,150 @@
+#include "headless_context.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef FINAL_PROJECT_HAS_EGL
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static EGLSurface surface = EGL_NO_SURFACE;
+
+static bool hasExtension(const char *extensions, const char *name)
+{
+	if (extensions == NULL) return false;
+	size_t length = strlen(name);
+	const char *p = extensions;
+	while ((p = strstr(p, name)) != NULL) {
+		if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) return true;
+		p += length;
+	}
+	return false;
+}
+
+// Prefer Mesa's surfaceless platform, then the first EGL device, and finally 
+// whatever the default display is.
+static EGLDisplay openDisplay()
+{
+	const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = 
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+	if (getPlatformDisplay != NULL && hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+		EGLDisplay dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (dpy != EGL_NO_DISPLAY) return dpy;
+	}
+
+	PFNEGLQUERYDEVICESEXTPROC queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+	if (getPlatformDisplay != NULL && queryDevices != NULL && hasExtension(clientExtensions, "EGL_EXT_platform_device")) {
+		EGLDeviceEXT device;
+		EGLint numDevices = 0;
+		if (queryDevices(1, &device, &numDevices) && numDevices > 0) {
+			EGLDisplay dpy = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, NULL);
+			if (dpy != EGL_NO_DISPLAY) return dpy;
+		}
+	}
+
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool CreateHeadlessContext()
+{
+	display = openDisplay();
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		printf("Failed to initialize an EGL display.\n");
+		return false;
+	}
+	printf("EGL %d.%d: %s\n", major, minor, eglQueryString(display, EGL_VENDOR));
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		printf("EGL does not support desktop OpenGL.\n");
+		DestroyHeadlessContext();
+		return false;
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+		printf("No suitable EGL config found.\n");
+		DestroyHeadlessContext();
+		return false;
+	}
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+	if (context == EGL_NO_CONTEXT) {
+		printf("Failed to create an OpenGL 3.3 core context through EGL.\n");
+		DestroyHeadlessContext();
+		return false;
+	}
+
+	// Rendering goes to an FBO, so a surface is only needed by drivers 
+	// without EGL_KHR_surfaceless_context.
+	if (!hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+		const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+	}
+
+	if (!eglMakeCurrent(display, surface, surface, context)) {
+		printf("Failed to make the EGL context current.\n");
+		DestroyHeadlessContext();
+		return false;
+	}
+	return true;
+}
+
+void DestroyHeadlessContext()
+{
+	if (display == EGL_NO_DISPLAY) return;
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+	if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+	eglTerminate(display);
+
+	display = EGL_NO_DISPLAY;
+	context = EGL_NO_CONTEXT;
+	surface = EGL_NO_SURFACE;
+}
+
+GLADapiproc GetHeadlessProcAddress(const char *name)
+{
+	return (GLADapiproc)eglGetProcAddress(name);
+}
+
+#else
+
+bool CreateHeadlessContext()
+{
+	printf("Headless mode is not available: final_project was built without EGL.\n");
+	return false;
+}
+
+void DestroyHeadlessContext()
+{
+}
+
+GLADapiproc GetHeadlessProcAddress(const char *)
+{
+	return NULL;
+}
+
+#endif
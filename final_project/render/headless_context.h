@@ -0,0 +1,17 @@
+#ifndef _HEADLESS_CONTEXT_H_
+#define _HEADLESS_CONTEXT_H_
+
+#include <glad/gl.h>
+
+// Creates an OpenGL 3.3 core context without a window through surfaceless EGL 
+// (Mesa llvmpipe is fine), so final_project can run on render nodes and CI. 
+// Returns false when no display-less context can be created or when the 
+// build has no EGL support (FINAL_PROJECT_HAS_EGL undefined).
+bool CreateHeadlessContext();
+
+void DestroyHeadlessContext();
+
+// Loader for gladLoadGL while the headless context is current
+GLADapiproc GetHeadlessProcAddress(const char *name);
+
+#endif
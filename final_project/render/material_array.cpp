@@ -0,0 +1,64 @@
+#include "material_array.h"
+#include "texture_cache.h"
+
+#include <vector>
+
+MaterialArray::MaterialArray() : textureID(0), width(0), height(0), layerCount(0), levelCount(0)
+{
+}
+
+bool MaterialArray::initialize(int layers, int arrayWidth, int arrayHeight)
+{
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	if (layers <= 0 || layers > maxLayers) return false;
+
+	width = arrayWidth;
+	height = arrayHeight;
+	layerCount = layers;
+	levelCount = 1;
+	for (int size = width > height ? width : height; size > 1; size /= 2) levelCount++;
+
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+	// Every level of every layer starts out mid-grey until its texture arrives
+	std::vector<unsigned char> grey((size_t)width * height * 3 * layerCount, 128);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	int levelWidth = width, levelHeight = height;
+	for (int level = 0; level < levelCount; ++level) {
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGB8, levelWidth, levelHeight, layerCount, 0, GL_RGB, GL_UNSIGNED_BYTE, grey.data());
+		levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+		levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return textureID != 0;
+}
+
+bool MaterialArray::load(int layer, const char *path)
+{
+	if (layer < 0 || layer >= layerCount) return false;
+
+	TextureImage image;
+	if (!LoadTextureImage(path, image, width, height)) return false;
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+	UploadTextureImageLayer(image, layer);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	ReleaseTextureImage(image);
+	return true;
+}
+
+void MaterialArray::cleanup()
+{
+	glDeleteTextures(1, &textureID);
+	textureID = 0;
+	layerCount = levelCount = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef _MATERIAL_ARRAY_H_
+#define _MATERIAL_ARRAY_H_
+
+#include <glad/gl.h>
+
+// Textures of every material in one GL_TEXTURE_2D_ARRAY, one layer each.
+// Images are resampled to the array's size when imported (the resized mip
+// chain is kept in the texture cache), so draws that sample different
+// materials need no texture change between them: the layer comes from the
+// vertex or the instance instead of the bound texture.
+
+#define MATERIAL_ARRAY_SIZE 1024
+
+struct MaterialArray {
+	GLuint textureID;
+	int width;
+	int height;
+	int layerCount;
+	int levelCount;
+
+	MaterialArray();
+
+	// Allocates layerCount layers with a full mip chain, all mid-grey until loaded
+	bool initialize(int layerCount, int width = MATERIAL_ARRAY_SIZE, int height = MATERIAL_ARRAY_SIZE);
+
+	// Loads path into layer through the texture cache. See also
+	// AsyncTextureLoader::loadLayer.
+	bool load(int layer, const char *path);
+
+	void cleanup();
+};
+
+#endif
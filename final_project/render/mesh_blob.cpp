@@ -0,0 +1,232 @@
+#include "mesh_blob.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+MeshBlob::MeshBlob() : header(NULL), meshes(NULL), ranges(NULL), instances(NULL)
+{
+}
+
+MeshBlobSource::MeshBlobSource(const char *name)
+{
+	memset(&mesh, 0, sizeof(mesh));
+	strncpy(mesh.name, name, sizeof(mesh.name) - 1);
+}
+
+void MeshBlobSource::addAttribute(uint32_t location, uint32_t components, uint32_t type, bool normalized, uint32_t offset)
+{
+	if (mesh.attributeCount == MESH_BLOB_MAX_ATTRIBUTES) return;
+	MeshBlobAttribute &attribute = mesh.attributes[mesh.attributeCount++];
+	attribute.location = location;
+	attribute.components = components;
+	attribute.type = type;
+	attribute.normalized = normalized ? 1 : 0;
+	attribute.offset = offset;
+}
+
+void MeshBlobSource::addRange(const MeshBlobRange &range)
+{
+	ranges.push_back(range);
+	mesh.rangeCount = (uint32_t)ranges.size();
+}
+
+static bool sourceInfo(const char *path, uint64_t &size, int64_t &modified)
+{
+	struct stat info;
+	if (stat(path, &info) != 0) return false;
+	size = (uint64_t)info.st_size;
+	modified = (int64_t)info.st_mtime;
+	return true;
+}
+
+static size_t alignUp(size_t value)
+{
+	return (value + MESH_BLOB_ALIGNMENT - 1) & ~(size_t)(MESH_BLOB_ALIGNMENT - 1);
+}
+
+static size_t indexSize(uint32_t indexType)
+{
+	return indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+bool OpenMeshBlob(const char *path, MeshBlob &blob, const char *sourcePath, uint64_t contentHash)
+{
+	if (!MapFile(path, blob.file)) return false;
+
+	const MeshBlobHeader *header = (const MeshBlobHeader *)blob.file.data;
+	size_t size = blob.file.size;
+	bool valid = size >= sizeof(MeshBlobHeader)
+		&& memcmp(header->magic, "FPMB", 4) == 0
+		&& header->version == MESH_BLOB_VERSION
+		&& header->fileSize == size;
+
+	size_t tables = sizeof(MeshBlobHeader);
+	if (valid) {
+		tables += (size_t)header->meshCount * sizeof(MeshBlobMesh) + (size_t)header->rangeCount * sizeof(MeshBlobRange) + (size_t)header->instanceCount * sizeof(MeshBlobInstance);
+		valid = tables <= size;
+	}
+
+	if (valid && sourcePath != NULL) {
+		// A blob baked from an older version of the source is ignored
+		uint64_t sourceSize = 0;
+		int64_t sourceModified = 0;
+		valid = sourceInfo(sourcePath, sourceSize, sourceModified) 
+			&& header->sourceSize == sourceSize 
+			&& header->sourceModified == sourceModified;
+		if (!valid) std::cout << path << " is out of date, run asset_bake again" << std::endl;
+	}
+	if (valid && contentHash != 0) {
+		valid = header->contentHash == contentHash;
+		if (!valid) std::cout << path << " is out of date, run asset_bake again" << std::endl;
+	}
+
+	if (valid) {
+		blob.header = header;
+		blob.meshes = (const MeshBlobMesh *)(header + 1);
+		blob.ranges = (const MeshBlobRange *)(blob.meshes + header->meshCount);
+		blob.instances = (const MeshBlobInstance *)(blob.ranges + header->rangeCount);
+
+		for (uint32_t i = 0; i < header->meshCount && valid; ++i) {
+			const MeshBlobMesh &mesh = blob.meshes[i];
+			valid = mesh.vertexOffset + (uint64_t)mesh.vertexCount * mesh.vertexStride <= size
+				&& mesh.indexOffset + (uint64_t)mesh.indexCount * indexSize(mesh.indexType) <= size
+				&& (uint64_t)mesh.firstRange + mesh.rangeCount <= header->rangeCount
+				&& mesh.attributeCount <= MESH_BLOB_MAX_ATTRIBUTES;
+		}
+		for (uint32_t i = 0; i < header->instanceCount && valid; ++i) {
+			valid = blob.instances[i].mesh < header->meshCount;
+		}
+	}
+
+	if (!valid) {
+		CloseMeshBlob(blob);
+		return false;
+	}
+	return true;
+}
+
+void CloseMeshBlob(MeshBlob &blob)
+{
+	UnmapFile(blob.file);
+	blob.header = NULL;
+	blob.meshes = NULL;
+	blob.ranges = NULL;
+	blob.instances = NULL;
+}
+
+int FindMeshBlobMesh(const MeshBlob &blob, const char *name)
+{
+	if (blob.header == NULL) return -1;
+	for (uint32_t i = 0; i < blob.header->meshCount; ++i) {
+		if (strncmp(blob.meshes[i].name, name, sizeof(blob.meshes[i].name)) == 0) return (int)i;
+	}
+	return -1;
+}
+
+MeshRef GetMeshBlobMesh(const MeshBlob &blob, int index)
+{
+	const MeshBlobMesh &mesh = blob.meshes[index];
+	MeshRef ref;
+	ref.mesh = &mesh;
+	ref.vertices = blob.file.data + mesh.vertexOffset;
+	ref.indices = blob.file.data + mesh.indexOffset;
+	ref.ranges = blob.ranges + mesh.firstRange;
+	return ref;
+}
+
+MeshRef GetMeshSource(const MeshBlobSource &source)
+{
+	MeshRef ref;
+	ref.mesh = &source.mesh;
+	ref.vertices = source.vertices.data();
+	ref.indices = source.indices.data();
+	ref.ranges = source.ranges.data();
+	return ref;
+}
+
+bool GetMeshRangeBounds(const MeshRef &ref, const MeshBlobRange &range, float boundsMin[3], float boundsMax[3])
+{
+	const MeshBlobMesh &mesh = *ref.mesh;
+	const MeshBlobAttribute *position = NULL;
+	for (uint32_t i = 0; i < mesh.attributeCount; ++i) {
+		if (mesh.attributes[i].location == 0 && mesh.attributes[i].type == GL_FLOAT && mesh.attributes[i].components >= 3) position = &mesh.attributes[i];
+	}
+	if (position == NULL || range.indexCount == 0 || range.firstIndex + range.indexCount > mesh.indexCount) return false;
+
+	for (uint32_t i = range.firstIndex; i < range.firstIndex + range.indexCount; ++i) {
+		uint32_t index = mesh.indexType == GL_UNSIGNED_SHORT ? ((const uint16_t *)ref.indices)[i] : ((const uint32_t *)ref.indices)[i];
+		if (index >= mesh.vertexCount) return false;
+		float p[3];
+		memcpy(p, ref.vertices + (size_t)index * mesh.vertexStride + position->offset, sizeof(p));
+		for (int k = 0; k < 3; ++k) {
+			if (i == range.firstIndex || p[k] < boundsMin[k]) boundsMin[k] = p[k];
+			if (i == range.firstIndex || p[k] > boundsMax[k]) boundsMax[k] = p[k];
+		}
+	}
+	return true;
+}
+
+bool WriteMeshBlob(const char *path, const std::vector<MeshBlobSource> &meshes, const std::vector<MeshBlobInstance> &instances, const char *sourcePath, uint64_t contentHash)
+{
+	MeshBlobHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "FPMB", 4);
+	header.version = MESH_BLOB_VERSION;
+	if (sourcePath != NULL && !sourceInfo(sourcePath, header.sourceSize, header.sourceModified)) return false;
+	header.contentHash = contentHash;
+	header.meshCount = (uint32_t)meshes.size();
+	header.instanceCount = (uint32_t)instances.size();
+
+	// Lay out the tables, then every vertex and index stream on its own alignment boundary
+	std::vector<MeshBlobMesh> table(meshes.size());
+	std::vector<MeshBlobRange> ranges;
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		table[i] = meshes[i].mesh;
+		table[i].firstRange = (uint32_t)ranges.size();
+		table[i].rangeCount = (uint32_t)meshes[i].ranges.size();
+		ranges.insert(ranges.end(), meshes[i].ranges.begin(), meshes[i].ranges.end());
+	}
+	header.rangeCount = (uint32_t)ranges.size();
+
+	size_t offset = alignUp(sizeof(header) + table.size() * sizeof(MeshBlobMesh) + ranges.size() * sizeof(MeshBlobRange) + instances.size() * sizeof(MeshBlobInstance));
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		table[i].vertexOffset = offset;
+		offset = alignUp(offset + meshes[i].vertices.size());
+		table[i].indexOffset = offset;
+		offset = alignUp(offset + meshes[i].indices.size());
+	}
+	header.fileSize = offset;
+
+	// Write to a temporary file first so a failed bake never leaves a broken blob behind
+	std::string temporaryPath = std::string(path) + ".tmp";
+	FILE *file = fopen(temporaryPath.c_str(), "wb");
+	if (file == NULL) return false;
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(table.data(), sizeof(MeshBlobMesh), table.size(), file) == table.size()
+		&& fwrite(ranges.data(), sizeof(MeshBlobRange), ranges.size(), file) == ranges.size()
+		&& fwrite(instances.data(), sizeof(MeshBlobInstance), instances.size(), file) == instances.size();
+
+	static const unsigned char padding[MESH_BLOB_ALIGNMENT] = { 0 };
+	size_t position = sizeof(header) + table.size() * sizeof(MeshBlobMesh) + ranges.size() * sizeof(MeshBlobRange) + instances.size() * sizeof(MeshBlobInstance);
+	for (size_t i = 0; i < meshes.size() && ok; ++i) {
+		ok = fwrite(padding, 1, table[i].vertexOffset - position, file) == table[i].vertexOffset - position
+			&& fwrite(meshes[i].vertices.data(), 1, meshes[i].vertices.size(), file) == meshes[i].vertices.size();
+		position = table[i].vertexOffset + meshes[i].vertices.size();
+		ok = ok && fwrite(padding, 1, table[i].indexOffset - position, file) == table[i].indexOffset - position
+			&& fwrite(meshes[i].indices.data(), 1, meshes[i].indices.size(), file) == meshes[i].indices.size();
+		position = table[i].indexOffset + meshes[i].indices.size();
+	}
+	ok = ok && fwrite(padding, 1, header.fileSize - position, file) == header.fileSize - position;
+
+	ok = fclose(file) == 0 && ok;
+	if (ok) {
+		remove(path);
+		ok = rename(temporaryPath.c_str(), path) == 0;
+	}
+	if (!ok) remove(temporaryPath.c_str());
+	return ok;
+}
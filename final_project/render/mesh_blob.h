@@ -0,0 +1,131 @@
+#ifndef _MESH_BLOB_H_
+#define _MESH_BLOB_H_
+
+#include <glad/gl.h>
+#include <core/mapped_file.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// GPU-ready mesh files written by tools/asset_bake. A blob is a header, a 
+// table of meshes, their draw ranges and instances, followed by interleaved 
+// vertex streams and index buffers aligned to MESH_BLOB_ALIGNMENT. Vertices 
+// are baked in the geometry arena's PackedVertex layout, so the runtime maps 
+// the file and hands those bytes to glBufferSubData unchanged.
+//
+// The same structs describe meshes built in memory when no blob exists, so 
+// both paths go into the geometry arena (see geometry_arena.h) the same way.
+
+#define MESH_BLOB_VERSION 2 // 2: meshes store PackedVertex
+#define MESH_BLOB_ALIGNMENT 64
+#define MESH_BLOB_MAX_ATTRIBUTES 6
+
+// Range flags
+#define MESH_BLOB_DOUBLE_SIDED 1
+
+struct MeshBlobHeader {
+	char magic[4]; // "FPMB"
+	uint32_t version;
+	uint64_t sourceSize;     // Size and modification time of the baked source 
+	int64_t sourceModified;  // file, zero for built-in geometry
+	uint32_t meshCount;
+	uint32_t rangeCount;
+	uint32_t instanceCount;
+	uint32_t reserved;
+	uint64_t fileSize;
+	uint64_t contentHash;    // Hash of built-in source geometry, zero for files
+	uint64_t reserved2;
+};
+
+struct MeshBlobAttribute {
+	uint32_t location;
+	uint32_t components;
+	uint32_t type;       // GL_FLOAT, GL_UNSIGNED_BYTE, ...
+	uint32_t normalized;
+	uint32_t offset;     // Byte offset inside the vertex
+};
+
+struct MeshBlobRange {
+	uint32_t mode;       // GL_TRIANGLES, ...
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t flags;
+	float baseColor[4];
+};
+
+struct MeshBlobMesh {
+	char name[32];
+	uint64_t vertexOffset; // From the start of the file
+	uint64_t indexOffset;
+	uint32_t vertexCount;
+	uint32_t vertexStride;
+	uint32_t indexCount;
+	uint32_t indexType;    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	uint32_t firstRange;
+	uint32_t rangeCount;
+	uint32_t attributeCount;
+	uint32_t reserved;
+	MeshBlobAttribute attributes[MESH_BLOB_MAX_ATTRIBUTES];
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+struct MeshBlobInstance {
+	uint32_t mesh;
+	uint32_t reserved[3];
+	float transform[16]; // Column-major
+};
+
+// A mapped blob; the table pointers point into the mapping
+struct MeshBlob {
+	MappedFile file;
+	const MeshBlobHeader *header;
+	const MeshBlobMesh *meshes;
+	const MeshBlobRange *ranges;
+	const MeshBlobInstance *instances;
+
+	MeshBlob();
+};
+
+// A mesh built in memory, in blob layout. mesh.firstRange indexes ranges.
+struct MeshBlobSource {
+	MeshBlobMesh mesh;
+	std::vector<unsigned char> vertices;
+	std::vector<unsigned char> indices;
+	std::vector<MeshBlobRange> ranges;
+
+	MeshBlobSource(const char *name);
+	void addAttribute(uint32_t location, uint32_t components, uint32_t type, bool normalized, uint32_t offset);
+	void addRange(const MeshBlobRange &range);
+};
+
+// Where one mesh's bytes live, inside a blob or a MeshBlobSource
+struct MeshRef {
+	const MeshBlobMesh *mesh;
+	const unsigned char *vertices;
+	const unsigned char *indices;
+	const MeshBlobRange *ranges;
+};
+
+// Maps path and validates its tables. With sourcePath set, the blob must 
+// have been baked from that file as it is now; with contentHash set, it must 
+// record that hash.
+bool OpenMeshBlob(const char *path, MeshBlob &blob, const char *sourcePath = NULL, uint64_t contentHash = 0);
+void CloseMeshBlob(MeshBlob &blob);
+
+// Index of the named mesh or -1
+int FindMeshBlobMesh(const MeshBlob &blob, const char *name);
+
+MeshRef GetMeshBlobMesh(const MeshBlob &blob, int index);
+MeshRef GetMeshSource(const MeshBlobSource &source);
+
+// Bounds of the vertices one range draws, read from the float position at 
+// attribute location 0; false when the mesh has none
+bool GetMeshRangeBounds(const MeshRef &ref, const MeshBlobRange &range, float boundsMin[3], float boundsMax[3]);
+
+// Writes meshes and instances (instance.mesh indexes meshes) to path, 
+// recording sourcePath's size and modification time when given, and contentHash
+bool WriteMeshBlob(const char *path, const std::vector<MeshBlobSource> &meshes, const std::vector<MeshBlobInstance> &instances, const char *sourcePath = NULL, uint64_t contentHash = 0);
+
+#endif
@@ -0,0 +1,218 @@
+#include "readback.h"
+
+#include <stb_image_write.h>
+
+#include <cstring>
+#include <iostream>
+
+AsyncReadback::AsyncReadback()
+	: initialized(false), frame(0), inFlight(0), written(0), dropped(0), nextBuffer(0), writing(0), stopping(false)
+{
+	for (int i = 0; i < READBACK_BUFFERS; ++i) {
+		buffers[i].buffer = 0;
+		buffers[i].capacity = 0;
+		buffers[i].fence = 0;
+		buffers[i].frame = 0;
+	}
+}
+
+void AsyncReadback::initialize()
+{
+	for (int i = 0; i < READBACK_BUFFERS; ++i) {
+		glGenBuffers(1, &buffers[i].buffer);
+		buffers[i].capacity = 0;
+		buffers[i].fence = 0;
+	}
+
+	stopping = false;
+	writer = std::thread(&AsyncReadback::writerMain, this);
+	initialized = true;
+}
+
+void AsyncReadback::cleanup()
+{
+	if (!initialized) return;
+	finish();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeWriter.notify_all();
+	writer.join();
+
+	for (int i = 0; i < READBACK_BUFFERS; ++i) {
+		glDeleteBuffers(1, &buffers[i].buffer);
+		buffers[i].buffer = 0;
+		buffers[i].capacity = 0;
+	}
+	for (size_t i = 0; i < pool.size(); ++i) delete pool[i];
+	pool.clear();
+	initialized = false;
+}
+
+bool AsyncReadback::capture(GLuint framebuffer, int width, int height, Format format, const char *path)
+{
+	if (!initialized) return false;
+
+	// Never wait for the GPU here; a full ring drops the capture
+	PackBuffer &slot = buffers[nextBuffer];
+	if (slot.fence != 0) {
+		std::cout << "Readback buffers are all in flight, dropping " << path << std::endl;
+		dropped++;
+		return false;
+	}
+	nextBuffer = (nextBuffer + 1) % READBACK_BUFFERS;
+
+	// Depth is read as floats, colour as RGBA bytes; either way 4 bytes a pixel
+	size_t size = (size_t)width * height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	if (slot.capacity < size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		slot.capacity = size;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	if (format == READBACK_DEPTH) {
+		glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, (void *)0);
+	} else {
+		glReadBuffer(framebuffer == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame = frame;
+	slot.capture.path = path;
+	slot.capture.width = width;
+	slot.capture.height = height;
+	slot.capture.format = format;
+	slot.capture.pixels = NULL;
+	inFlight++;
+	return true;
+}
+
+// Copies a finished read into staging memory and queues it for the writer
+void AsyncReadback::collect(PackBuffer &slot)
+{
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+	inFlight--;
+
+	Capture capture = slot.capture;
+	size_t size = (size_t)capture.width * capture.height * 4;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (pool.empty()) {
+			capture.pixels = new std::vector<unsigned char>();
+		} else {
+			capture.pixels = pool.back();
+			pool.pop_back();
+		}
+	}
+	capture.pixels->resize(size);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const void *source = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	if (source != NULL) {
+		memcpy(capture.pixels->data(), source, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (source == NULL) {
+			std::cout << "Failed to map the readback buffer for " << capture.path << std::endl;
+			pool.push_back(capture.pixels);
+			dropped++;
+			return;
+		}
+		queued.push_back(capture);
+	}
+	wakeWriter.notify_one();
+}
+
+void AsyncReadback::update()
+{
+	if (!initialized) return;
+	frame++;
+	if (inFlight == 0) return;
+
+	for (int i = 0; i < READBACK_BUFFERS; ++i) {
+		PackBuffer &slot = buffers[i];
+		if (slot.fence == 0 || frame - slot.frame < READBACK_LATENCY) continue;
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) collect(slot);
+	}
+}
+
+void AsyncReadback::finish()
+{
+	if (!initialized) return;
+
+	// Oldest first, so files appear in the order they were captured
+	for (int i = 0; i < READBACK_BUFFERS && inFlight > 0; ++i) {
+		PackBuffer &slot = buffers[(nextBuffer + i) % READBACK_BUFFERS];
+		if (slot.fence == 0) continue;
+		glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		collect(slot);
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!queued.empty() || writing > 0) wakeWaiters.wait(lock);
+}
+
+void AsyncReadback::writerMain()
+{
+	// Reused for every image
+	std::vector<unsigned char> image;
+
+	while (true) {
+		Capture capture;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && queued.empty()) wakeWriter.wait(lock);
+			if (queued.empty()) return;
+			capture = queued.front();
+			queued.pop_front();
+			writing++;
+		}
+
+		// GL rows start at the bottom, PNG rows at the top
+		int width = capture.width;
+		int height = capture.height;
+		int channels = capture.format == READBACK_DEPTH ? 1 : 3;
+		image.resize((size_t)width * height * channels);
+		for (int y = 0; y < height; ++y) {
+			unsigned char *row = &image[(size_t)(height - 1 - y) * width * channels];
+			if (capture.format == READBACK_DEPTH) {
+				const float *depth = (const float *)&(*capture.pixels)[(size_t)y * width * 4];
+				for (int x = 0; x < width; ++x) row[x] = (unsigned char)(depth[x] * 255.0f);
+			} else {
+				const unsigned char *rgba = &(*capture.pixels)[(size_t)y * width * 4];
+				for (int x = 0; x < width; ++x) {
+					row[3 * x] = rgba[4 * x];
+					row[3 * x + 1] = rgba[4 * x + 1];
+					row[3 * x + 2] = rgba[4 * x + 2];
+				}
+			}
+		}
+
+		bool ok = stbi_write_png(capture.path.c_str(), width, height, channels, image.data(), width * channels) != 0;
+		if (ok) {
+			std::cout << "Saved " << capture.path << std::endl;
+		} else {
+			std::cout << "Failed to write " << capture.path << std::endl;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pool.push_back(capture.pixels);
+			writing--;
+			if (ok) written++;
+			else dropped++;
+		}
+		wakeWaiters.notify_all();
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef _READBACK_H_
+#define _READBACK_H_
+
+#include <glad/gl.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Number of pixel pack buffers captures rotate through
+#define READBACK_BUFFERS 4
+
+// Frames a capture stays in flight before its fence is polled
+#define READBACK_LATENCY 2
+
+// Saves framebuffer contents without stalling the GL thread. capture()
+// starts a glReadPixels into the next pixel pack buffer of a ring and fences
+// it; update(), called once per frame, maps buffers whose fence signalled at
+// least READBACK_LATENCY frames later, copies the pixels into pooled staging
+// memory and hands them to a writer thread, which converts and PNG-encodes
+// them. When every buffer is still in flight a capture is dropped rather
+// than waited for.
+struct AsyncReadback {
+	enum Format {
+		READBACK_DEPTH, // Grey image of the depth attachment
+		READBACK_COLOR  // RGB image of the first colour attachment
+	};
+
+	struct Capture {
+		std::string path;
+		int width;
+		int height;
+		Format format;
+		std::vector<unsigned char> *pixels; // Staging memory from the pool
+	};
+
+	struct PackBuffer {
+		GLuint buffer;
+		size_t capacity;
+		GLsync fence;
+		long long frame; // Frame the read was issued in
+		Capture capture;
+	};
+
+	AsyncReadback();
+
+	void initialize();
+
+	// Writes every capture still in flight, then stops the writer
+	void cleanup();
+
+	// Reads width x height pixels of framebuffer into the ring; false when
+	// the capture was dropped. Must be called on the GL thread.
+	bool capture(GLuint framebuffer, int width, int height, Format format, const char *path);
+
+	// Collects finished reads; call once per frame on the GL thread
+	void update();
+
+	// Blocks until every capture has been written
+	void finish();
+
+	bool initialized;
+	long long frame;
+	int inFlight; // Buffers holding a read (GL thread only)
+	std::atomic<int> written; // Counted by the writer and the GL thread
+	std::atomic<int> dropped;
+
+	PackBuffer buffers[READBACK_BUFFERS];
+	int nextBuffer;
+
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wakeWriter;
+	std::condition_variable wakeWaiters;
+	std::deque<Capture> queued; // Waiting for the writer
+	std::vector<std::vector<unsigned char> *> pool;
+	int writing;
+	bool stopping;
+
+private:
+	void writerMain();
+	void collect(PackBuffer &slot);
+};
+
+#endif
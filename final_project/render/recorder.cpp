@@ -0,0 +1,332 @@
+#include "recorder.h"
+
+#include <core/qoi.h>
+#include <stb_image_write.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define fdopen _fdopen
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+// Moves stdout's file descriptor to a new FILE for the stream and points
+// stdout at stderr, so log messages cannot end up inside the video
+static FILE *takeStdout()
+{
+	fflush(stdout);
+	int fd = dup(fileno(stdout));
+	if (fd < 0) return NULL;
+	dup2(fileno(stderr), fileno(stdout));
+#ifdef _WIN32
+	_setmode(fd, _O_BINARY);
+#endif
+	return fdopen(fd, "wb");
+}
+
+// Bottom-up RGBA rows to top-down RGB rows
+static void convertRGB(const unsigned char *rgba, int width, int height, unsigned char *rgb)
+{
+	for (int y = 0; y < height; ++y) {
+		const unsigned char *src = rgba + (size_t)(height - 1 - y) * width * 4;
+		unsigned char *dst = rgb + (size_t)y * width * 3;
+		for (int x = 0; x < width; ++x) {
+			dst[3 * x] = src[4 * x];
+			dst[3 * x + 1] = src[4 * x + 1];
+			dst[3 * x + 2] = src[4 * x + 2];
+		}
+	}
+}
+
+// Bottom-up RGBA rows to top-down planar Y, U and V with chroma averaged
+// over 2 x 2 blocks, BT.709 limited range in 8.8 fixed point
+static void convertYUV(const unsigned char *rgba, int width, int height, unsigned char *yuv)
+{
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	unsigned char *planeY = yuv;
+	unsigned char *planeU = planeY + (size_t)width * height;
+	unsigned char *planeV = planeU + (size_t)chromaWidth * chromaHeight;
+
+	for (int y = 0; y < height; ++y) {
+		const unsigned char *src = rgba + (size_t)(height - 1 - y) * width * 4;
+		unsigned char *dst = planeY + (size_t)y * width;
+		for (int x = 0; x < width; ++x) {
+			const unsigned char *p = src + 4 * x;
+			dst[x] = (unsigned char)(((47 * p[0] + 157 * p[1] + 16 * p[2] + 128) >> 8) + 16);
+		}
+	}
+
+	for (int cy = 0; cy < chromaHeight; ++cy) {
+		int y0 = 2 * cy;
+		int y1 = y0 + 1 < height ? y0 + 1 : y0;
+		const unsigned char *row0 = rgba + (size_t)(height - 1 - y0) * width * 4;
+		const unsigned char *row1 = rgba + (size_t)(height - 1 - y1) * width * 4;
+		for (int cx = 0; cx < chromaWidth; ++cx) {
+			int x0 = 2 * cx;
+			int x1 = x0 + 1 < width ? x0 + 1 : x0;
+			int r = row0[4 * x0] + row0[4 * x1] + row1[4 * x0] + row1[4 * x1];
+			int g = row0[4 * x0 + 1] + row0[4 * x1 + 1] + row1[4 * x0 + 1] + row1[4 * x1 + 1];
+			int b = row0[4 * x0 + 2] + row0[4 * x1 + 2] + row1[4 * x0 + 2] + row1[4 * x1 + 2];
+			// Sums of four samples, hence >> 10 instead of >> 8
+			planeU[(size_t)cy * chromaWidth + cx] = (unsigned char)(((-26 * r - 87 * g + 113 * b + 512) >> 10) + 128);
+			planeV[(size_t)cy * chromaWidth + cx] = (unsigned char)(((113 * r - 103 * g - 10 * b + 512) >> 10) + 128);
+		}
+	}
+}
+
+FrameRecorder::FrameRecorder()
+	: initialized(false), width(0), height(0), format(RECORD_PNG), interval(1), encoderCount(0), opened(false), frame(0), captured(0), stalls(0),
+	written(0), failed(0), nextBuffer(0), inFlight(0), freeFrames(RECORDER_FRAMES), readyFrames(RECORDER_FRAMES),
+	stopping(false), stream(NULL), nextStreamIndex(0)
+{
+	memset(buffers, 0, sizeof(buffers));
+}
+
+bool FrameRecorder::open(Format format, const std::string &path, int interval, int encoderCount)
+{
+	this->format = format;
+	this->path = path;
+	this->interval = interval > 0 ? interval : 1;
+
+	bool raw = format == RECORD_RGB || format == RECORD_YUV;
+	if (raw != (path == "-")) {
+		std::cerr << "Raw RGB and YUV recordings go to stdout (\"-\"), PNG and QOI ones to files" << std::endl;
+		return false;
+	}
+	if (!raw && path.find('%') == std::string::npos) {
+		std::cerr << "Recording path " << path << " needs a frame number pattern such as %05d" << std::endl;
+		return false;
+	}
+	if (raw) {
+		stream = takeStdout();
+		if (stream == NULL) {
+			std::cerr << "Failed to open stdout for recording" << std::endl;
+			return false;
+		}
+	}
+
+	if (encoderCount <= 0) {
+		int hardwareThreads = (int)std::thread::hardware_concurrency();
+		encoderCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+		if (encoderCount > RECORDER_FRAMES - 2) encoderCount = RECORDER_FRAMES - 2;
+	}
+	this->encoderCount = encoderCount;
+	opened = true;
+	return true;
+}
+
+bool FrameRecorder::initialize(int width, int height)
+{
+	if (!opened) return false;
+	this->width = width;
+	this->height = height;
+
+	size_t size = (size_t)width * height * 4;
+	for (int i = 0; i < RECORDER_BUFFERS; ++i) {
+		glGenBuffers(1, &buffers[i].buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i].buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		buffers[i].fence = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	for (int i = 0; i < RECORDER_FRAMES; ++i) {
+		frames[i].pixels.resize(size);
+		freeFrames.tryPush(&frames[i]);
+	}
+
+	stopping = false;
+	for (int i = 0; i < encoderCount; ++i) {
+		encoders.push_back(std::thread(&FrameRecorder::encoderMain, this));
+	}
+	initialized = true;
+
+	static const char *formatNames[] = { "PNG sequence", "QOI sequence", "rgb24 stream", "yuv420p stream" };
+	fprintf(stderr, "Recording %d x %d %s to %s, every %d frame(s), %d encoder threads\n",
+		width, height, formatNames[format], stream != NULL ? "stdout" : path.c_str(), interval, encoderCount);
+	return true;
+}
+
+void FrameRecorder::cleanup()
+{
+	if (initialized) {
+		finish();
+
+		stopping = true;
+		wakeEncoders.notify_all();
+		for (size_t i = 0; i < encoders.size(); ++i) encoders[i].join();
+		encoders.clear();
+
+		for (int i = 0; i < RECORDER_BUFFERS; ++i) glDeleteBuffers(1, &buffers[i].buffer);
+		memset(buffers, 0, sizeof(buffers));
+		Frame *unused;
+		while (freeFrames.tryPop(unused)) {}
+		for (int i = 0; i < RECORDER_FRAMES; ++i) std::vector<unsigned char>().swap(frames[i].pixels);
+		initialized = false;
+	}
+
+	if (stream != NULL) fclose(stream);
+	stream = NULL;
+	opened = false;
+}
+
+void FrameRecorder::update(GLuint framebuffer)
+{
+	if (!initialized) return;
+
+	if (frame++ % interval == 0) {
+		// The oldest read still holds the next buffer; wait for it instead of dropping the frame
+		PackBuffer &slot = buffers[nextBuffer];
+		if (slot.fence != 0) {
+			stalls++;
+			glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			collect(slot);
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glReadBuffer(framebuffer == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.frame = frame;
+		slot.index = captured++;
+		nextBuffer = (nextBuffer + 1) % RECORDER_BUFFERS;
+		inFlight++;
+	}
+
+	// Collect in recording order, stopping at the first read still in flight
+	while (inFlight > 0) {
+		PackBuffer &oldest = buffers[(nextBuffer - inFlight + RECORDER_BUFFERS) % RECORDER_BUFFERS];
+		if (frame - oldest.frame < RECORDER_LATENCY) break;
+		GLenum status = glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+		collect(oldest);
+	}
+}
+
+// Copies a finished read into a staging frame and queues it for the encoders
+void FrameRecorder::collect(PackBuffer &slot)
+{
+	Frame *staging;
+	if (!freeFrames.tryPop(staging)) {
+		stalls++;
+		while (!freeFrames.tryPop(staging)) std::this_thread::yield();
+	}
+
+	size_t size = (size_t)width * height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const void *source = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	if (source != NULL) {
+		memcpy(staging->pixels.data(), source, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	} else {
+		// Keep the numbering of a sequence intact with a black frame
+		memset(staging->pixels.data(), 0, size);
+		failed++;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+	inFlight--;
+
+	staging->index = slot.index;
+	readyFrames.tryPush(staging);
+	wakeEncoders.notify_one();
+}
+
+void FrameRecorder::finish()
+{
+	if (!initialized) return;
+
+	while (inFlight > 0) {
+		PackBuffer &oldest = buffers[(nextBuffer - inFlight + RECORDER_BUFFERS) % RECORDER_BUFFERS];
+		glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		collect(oldest);
+	}
+	while (written < captured) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	if (stream != NULL) fflush(stream);
+}
+
+void FrameRecorder::encoderMain()
+{
+	// Converted pixels or encoded file, reused for every frame
+	std::vector<unsigned char> scratch;
+
+	while (true) {
+		Frame *staging;
+		if (!readyFrames.tryPop(staging)) {
+			if (stopping) return;
+			// The queue itself never blocks, so idle encoders sleep here. A
+			// wake-up can be missed between the pop and the wait, which the
+			// timeout bounds.
+			std::unique_lock<std::mutex> lock(idleMutex);
+			wakeEncoders.wait_for(lock, std::chrono::milliseconds(1));
+			continue;
+		}
+
+		if (!encode(*staging, scratch)) failed++;
+		freeFrames.tryPush(staging);
+		written++;
+	}
+}
+
+bool FrameRecorder::encode(const Frame &staging, std::vector<unsigned char> &scratch)
+{
+	const unsigned char *pixels = staging.pixels.data();
+
+	if (format == RECORD_RGB) {
+		scratch.resize((size_t)width * height * 3);
+		convertRGB(pixels, width, height, scratch.data());
+		return writeStream(staging.index, scratch);
+	}
+	if (format == RECORD_YUV) {
+		scratch.resize((size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2));
+		convertYUV(pixels, width, height, scratch.data());
+		return writeStream(staging.index, scratch);
+	}
+
+	char filename[512];
+	snprintf(filename, sizeof(filename), path.c_str(), (int)staging.index);
+
+	if (format == RECORD_PNG) {
+		scratch.resize((size_t)width * height * 3);
+		convertRGB(pixels, width, height, scratch.data());
+		return stbi_write_png(filename, width, height, 3, scratch.data(), width * 3) != 0;
+	}
+
+	// QOI reads the rows bottom-up directly, dropping the alpha channel
+	ptrdiff_t stride = (ptrdiff_t)width * 4;
+	EncodeQOI(pixels + (height - 1) * stride, width, height, -stride, 3, scratch);
+	FILE *file = fopen(filename, "wb");
+	if (file == NULL) return false;
+	bool ok = fwrite(scratch.data(), 1, scratch.size(), file) == scratch.size();
+	return fclose(file) == 0 && ok;
+}
+
+bool FrameRecorder::writeStream(long long index, const std::vector<unsigned char> &data)
+{
+	std::unique_lock<std::mutex> lock(streamMutex);
+	while (nextStreamIndex != index) streamTurn.wait(lock);
+	bool ok = fwrite(data.data(), 1, data.size(), stream) == data.size();
+	nextStreamIndex++;
+	lock.unlock();
+	streamTurn.notify_all();
+	return ok;
+}
+
+void FrameRecorder::printStatistics() const
+{
+	printf("Recording: %lld frames captured, %lld written, %d failed, GL thread stalled %lld times\n",
+		captured, (long long)written, (int)failed, stalls);
+}
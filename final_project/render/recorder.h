@@ -0,0 +1,115 @@
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+
+#include <glad/gl.h>
+#include <core/mpmc_queue.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Number of pixel pack buffers recorded frames rotate through
+#define RECORDER_BUFFERS 6
+
+// Frames a read stays in flight before its fence is polled
+#define RECORDER_LATENCY 3
+
+// Staging frames shared by the GL thread and the encoders
+#define RECORDER_FRAMES 8
+
+// Records the rendered frames to a PNG or QOI image sequence or to a raw
+// RGB or YUV 4:2:0 stream on stdout. update() reads the colour buffer into
+// a ring of pixel pack buffers; reads are collected a few frames later into
+// staging frames and handed to a pool of encoder threads through a lock-free
+// queue, and the frames return through a second one. Unlike AsyncReadback a
+// recorder never drops a frame: when every buffer or staging frame is busy
+// the GL thread waits, and the wait is counted as a stall.
+struct FrameRecorder {
+	enum Format {
+		RECORD_PNG,
+		RECORD_QOI,
+		RECORD_RGB, // Raw rgb24
+		RECORD_YUV  // Raw planar yuv420p, BT.709 limited range
+	};
+
+	struct Frame {
+		long long index;                   // Position in the recording
+		std::vector<unsigned char> pixels; // RGBA rows, bottom row first
+	};
+
+	struct PackBuffer {
+		GLuint buffer;
+		GLsync fence;
+		long long frame; // Rendered frame the read was issued in
+		long long index;
+	};
+
+	FrameRecorder();
+
+	// path is a printf pattern taking the frame number for image sequences
+	// (frames/frame_%05d.png) or "-" for a raw stream on stdout, in which
+	// case everything printed to stdout afterwards goes to stderr instead,
+	// so call this before anything else is printed. Every interval-th frame
+	// is recorded. encoderCount 0 picks one encoder per spare hardware thread.
+	bool open(Format format, const std::string &path, int interval = 1, int encoderCount = 0);
+
+	// Allocates the buffers and starts the encoders once the GL context and
+	// the framebuffer size are known
+	bool initialize(int width, int height);
+	void cleanup();
+
+	// Call once per rendered frame, before the buffers are swapped, on the
+	// GL thread; framebuffer 0 reads the back buffer
+	void update(GLuint framebuffer);
+
+	// Blocks until every recorded frame has been written
+	void finish();
+
+	void printStatistics() const;
+
+	bool initialized;
+	int width;
+	int height;
+	Format format;
+	std::string path;
+	int interval;
+	int encoderCount;
+	bool opened;
+
+	long long frame;    // Frames seen by update()
+	long long captured; // Frames read back
+	long long stalls;   // Times the GL thread had to wait
+	std::atomic<long long> written;
+	std::atomic<int> failed;
+
+	PackBuffer buffers[RECORDER_BUFFERS];
+	int nextBuffer;
+	int inFlight;
+
+	Frame frames[RECORDER_FRAMES];
+	MPMCQueue<Frame *> freeFrames;
+	MPMCQueue<Frame *> readyFrames;
+
+	std::vector<std::thread> encoders;
+	std::atomic<bool> stopping;
+	std::mutex idleMutex;
+	std::condition_variable wakeEncoders;
+
+	// Raw streams are written in recording order
+	FILE *stream;
+	std::mutex streamMutex;
+	std::condition_variable streamTurn;
+	long long nextStreamIndex;
+
+private:
+	void encoderMain();
+	void collect(PackBuffer &slot);
+	bool encode(const Frame &frame, std::vector<unsigned char> &scratch);
+	bool writeStream(long long index, const std::vector<unsigned char> &data);
+};
+
+#endif
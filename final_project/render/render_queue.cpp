@@ -0,0 +1,307 @@
+#include "render_queue.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+RenderProgram::RenderProgram() : programID(0)
+{
+}
+
+InstanceStream::InstanceStream() : bufferID(0), stride(0), attributeCount(0)
+{
+}
+
+void InstanceStream::addAttribute(uint32_t location, uint32_t components, uint32_t type, uint32_t offset)
+{
+	if (attributeCount >= RENDER_QUEUE_MAX_INSTANCE_ATTRIBUTES) return;
+	MeshBlobAttribute &attribute = attributes[attributeCount++];
+	attribute.location = location;
+	attribute.components = components;
+	attribute.type = type;
+	attribute.normalized = 0;
+	attribute.offset = offset;
+}
+
+DrawPacket::DrawPacket()
+	: program(NULL), vertexArrayID(0), textureTarget(GL_TEXTURE_2D), textureID(0), doubleSided(false), mode(GL_TRIANGLES), indexType(GL_UNSIGNED_INT), indices(NULL),
+	indexCount(0), baseVertex(0), instanceCount(0), instances(NULL), firstInstance(0), object(-1), key(0)
+{
+}
+
+void DrawPacket::setGeometry(const GeometryArena &arena, const GeometryAllocation &allocation, GLenum drawMode, GLuint firstIndex, GLsizei count)
+{
+	vertexArrayID = arena.vertexArrayID;
+	mode = drawMode;
+	indexType = allocation.indexType;
+	indices = allocation.indices(firstIndex);
+	indexCount = count;
+	baseVertex = allocation.baseVertex;
+}
+
+void DrawPacket::setTexture(GLenum target, GLuint texture)
+{
+	textureTarget = target;
+	textureID = texture;
+}
+
+GLStateCache::GLStateCache()
+{
+	memset(issued, 0, sizeof(issued));
+	memset(skipped, 0, sizeof(skipped));
+	invalidate();
+}
+
+void GLStateCache::invalidate()
+{
+	program = (GLuint)-1;
+	vertexArray = (GLuint)-1;
+	textureTarget = GL_NONE;
+	texture = (GLuint)-1;
+	cullFace = -1;
+	instances = NULL;
+	firstInstance = 0;
+	objectOffset = (size_t)-1;
+}
+
+void GLStateCache::useProgram(GLuint programID)
+{
+	if (programID == program) {
+		skipped[RENDER_STATE_PROGRAM]++;
+		return;
+	}
+	glUseProgram(programID);
+	program = programID;
+	issued[RENDER_STATE_PROGRAM]++;
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArrayID)
+{
+	if (vertexArrayID == vertexArray) {
+		skipped[RENDER_STATE_VERTEX_ARRAY]++;
+		return;
+	}
+
+	// Instance attributes are vertex array state; leave none enabled behind
+	setInstances(NULL, 0);
+	glBindVertexArray(vertexArrayID);
+	vertexArray = vertexArrayID;
+	issued[RENDER_STATE_VERTEX_ARRAY]++;
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint textureID)
+{
+	if (target == textureTarget && textureID == texture) {
+		skipped[RENDER_STATE_TEXTURE]++;
+		return;
+	}
+	glBindTexture(target, textureID);
+	textureTarget = target;
+	texture = textureID;
+	issued[RENDER_STATE_TEXTURE]++;
+}
+
+void GLStateCache::setCullFace(bool enabled)
+{
+	if (cullFace == (enabled ? 1 : 0)) {
+		skipped[RENDER_STATE_CULL_FACE]++;
+		return;
+	}
+	if (enabled) glEnable(GL_CULL_FACE);
+	else glDisable(GL_CULL_FACE);
+	cullFace = enabled ? 1 : 0;
+	issued[RENDER_STATE_CULL_FACE]++;
+}
+
+void GLStateCache::bindObject(FrameUniforms &uniforms, size_t offset)
+{
+	if (offset == objectOffset) {
+		skipped[RENDER_STATE_OBJECT_UNIFORMS]++;
+		return;
+	}
+	uniforms.bindObject(offset);
+	objectOffset = offset;
+	issued[RENDER_STATE_OBJECT_UNIFORMS]++;
+}
+
+void GLStateCache::setInstances(const InstanceStream *stream, GLsizei first)
+{
+	if (stream == instances && (stream == NULL || first == firstInstance)) {
+		if (stream != NULL) skipped[RENDER_STATE_INSTANCES]++;
+		return;
+	}
+
+	if (instances != NULL && stream != instances) {
+		for (uint32_t i = 0; i < instances->attributeCount; ++i) glDisableVertexAttribArray(instances->attributes[i].location);
+	}
+	if (stream != NULL) {
+		size_t base = (size_t)first * stream->stride;
+		glBindBuffer(GL_ARRAY_BUFFER, stream->bufferID);
+		for (uint32_t i = 0; i < stream->attributeCount; ++i) {
+			const MeshBlobAttribute &attribute = stream->attributes[i];
+			if (stream != instances) glEnableVertexAttribArray(attribute.location);
+			glVertexAttribPointer(attribute.location, attribute.components, attribute.type, GL_FALSE, stream->stride, (void *)(base + attribute.offset));
+		}
+	}
+	instances = stream;
+	firstInstance = first;
+	issued[RENDER_STATE_INSTANCES]++;
+}
+
+RenderQueue::RenderQueue() : drawCalls(0), listsMerged(0), frames(0)
+{
+}
+
+bool RenderQueue::initialize()
+{
+	return uniforms.initialize();
+}
+
+RenderProgram *RenderQueue::registerProgram(GLuint programID)
+{
+	std::map<GLuint, RenderProgram>::iterator found = programs.find(programID);
+	if (found != programs.end()) return &found->second;
+	RenderProgram &program = programs[programID];
+	program.programID = programID;
+	BindFrameUniformBlocks(programID);
+	return &program;
+}
+
+void RenderQueue::begin(int view, const ShadowCascades *shadows)
+{
+	uniforms.bindView(view);
+	if (shadows != NULL) {
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, shadows->textureID);
+		glActiveTexture(GL_TEXTURE0);
+	}
+}
+
+int CommandList::addObject(const glm::mat4 &model, const float *baseColor, int baseColorSize)
+{
+	ObjectUniformBlock object;
+	object.model = model;
+	object.baseColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	for (int k = 0; k < baseColorSize && k < 4; ++k) object.baseColor[k] = baseColor[k];
+	objects.push_back(object);
+	return (int)objects.size() - 1;
+}
+
+void CommandList::submit(const DrawPacket &packet)
+{
+	packets.push_back(packet);
+}
+
+void CommandList::clear()
+{
+	packets.clear();
+	objects.clear();
+}
+
+// Most expensive state in the highest bits: program, vertex array, texture,
+// then culling. GL names are truncated to their field, which only affects
+// grouping, never correctness. The low bits keep submission order among
+// packets with equal state.
+static uint64_t sortKey(const DrawPacket &packet, size_t sequence)
+{
+	uint64_t key = (uint64_t)(packet.program->programID & 0xffff) << 48;
+	key |= (uint64_t)(packet.vertexArrayID & 0xff) << 40;
+	key |= (uint64_t)(packet.textureID & 0xffff) << 24;
+	key |= (uint64_t)(packet.doubleSided ? 1 : 0) << 23;
+	key |= (uint64_t)(sequence & 0x7fffff);
+	return key;
+}
+
+static bool compareKey(const DrawPacket &a, const DrawPacket &b)
+{
+	return a.key < b.key;
+}
+
+void RenderQueue::flush()
+{
+	// A list's object indices become indices into the merged objects
+	for (int l = 0; l < RENDER_QUEUE_LISTS; ++l) {
+		CommandList &list = lists[l];
+		if (list.packets.empty()) continue;
+		int objectBase = (int)objects.size();
+		objects.insert(objects.end(), list.objects.begin(), list.objects.end());
+		for (size_t i = 0; i < list.packets.size(); ++i) {
+			packets.push_back(list.packets[i]);
+			DrawPacket &packet = packets.back();
+			if (packet.object >= 0) packet.object += objectBase;
+			packet.key = sortKey(packet, packets.size() - 1);
+		}
+		list.clear();
+		++listsMerged;
+	}
+
+	std::sort(packets.begin(), packets.end(), compareKey);
+	size_t objectBase = objects.empty() ? 0 : uniforms.uploadObjects(objects.data(), objects.size());
+
+	state.invalidate();
+	glActiveTexture(GL_TEXTURE0);
+
+	for (size_t i = 0; i < packets.size(); ++i) {
+		const DrawPacket &packet = packets[i];
+
+		state.useProgram(packet.program->programID);
+		state.bindVertexArray(packet.vertexArrayID);
+		if (packet.textureID != 0) state.bindTexture(packet.textureTarget, packet.textureID);
+		state.setCullFace(!packet.doubleSided);
+		state.setInstances(packet.instances, packet.firstInstance);
+
+		if (packet.object >= 0) state.bindObject(uniforms, objectBase + (size_t)packet.object * uniforms.objectStride);
+
+		if (packet.instanceCount > 0) {
+			glDrawElementsInstancedBaseVertex(packet.mode, packet.indexCount, packet.indexType, (void *)packet.indices, packet.instanceCount, packet.baseVertex);
+		} else {
+			glDrawElementsBaseVertex(packet.mode, packet.indexCount, packet.indexType, (void *)packet.indices, packet.baseVertex);
+		}
+	}
+
+	// Leave the defaults the rest of the renderer expects
+	state.setInstances(NULL, 0);
+	state.setCullFace(true);
+
+	drawCalls += packets.size();
+	packets.clear();
+	objects.clear();
+}
+
+void RenderQueue::resetStatistics()
+{
+	memset(state.issued, 0, sizeof(state.issued));
+	memset(state.skipped, 0, sizeof(state.skipped));
+	drawCalls = listsMerged = frames = 0;
+	uniforms.frameUploads = uniforms.objectUploads = uniforms.objectBytes = uniforms.orphans = 0;
+}
+
+void RenderQueue::printStatistics() const
+{
+	static const char *names[RENDER_STATE_KIND_COUNT] = {
+		"program", "vertex array", "texture", "cull face", "instances", "object uniforms"
+	};
+	if (frames == 0) return;
+
+	long long issued = 0, skipped = 0;
+	for (int i = 0; i < RENDER_STATE_KIND_COUNT; ++i) {
+		issued += state.issued[i];
+		skipped += state.skipped[i];
+	}
+	printf("Render queue: %.1f draws from %.1f command lists per frame, %.1f state changes issued and %.1f redundant ones skipped\n",
+		(double)drawCalls / frames, (double)listsMerged / frames, (double)issued / frames, (double)skipped / frames);
+	for (int i = 0; i < RENDER_STATE_KIND_COUNT; ++i) {
+		printf("  %-16s %8.1f issued %8.1f skipped\n", names[i], (double)state.issued[i] / frames, (double)state.skipped[i] / frames);
+	}
+	printf("Uniform buffers: %.1f frame and %.1f object uploads (%.1f KB) per frame, object ring orphaned %lld times\n",
+		(double)uniforms.frameUploads / frames, (double)uniforms.objectUploads / frames, uniforms.objectBytes / 1024.0 / frames, uniforms.orphans);
+}
+
+void RenderQueue::cleanup()
+{
+	uniforms.cleanup();
+	programs.clear();
+	for (int l = 0; l < RENDER_QUEUE_LISTS; ++l) lists[l].clear();
+	packets.clear();
+	objects.clear();
+}
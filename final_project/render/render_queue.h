@@ -0,0 +1,173 @@
+#ifndef _RENDER_QUEUE_H_
+#define _RENDER_QUEUE_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "mesh_blob.h"
+#include "geometry_arena.h"
+#include "frame_uniforms.h"
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+// Draws are not issued by the objects themselves: each pass records draw
+// packets into command lists, possibly on several threads, and the GL
+// thread merges them, sorts them by a 64-bit state key and issues them
+// through a shadow of the GL state, so that only calls which change
+// something reach the driver.
+
+#define RENDER_QUEUE_MAX_INSTANCE_ATTRIBUTES 4
+
+// Command lists a pass can record into
+#define RENDER_QUEUE_LISTS 8
+
+// The state a packet can change, for the statistics
+enum RenderStateKind {
+	RENDER_STATE_PROGRAM,
+	RENDER_STATE_VERTEX_ARRAY,
+	RENDER_STATE_TEXTURE,
+	RENDER_STATE_CULL_FACE,
+	RENDER_STATE_INSTANCES,
+	RENDER_STATE_OBJECT_UNIFORMS,
+	RENDER_STATE_KIND_COUNT
+};
+
+// A program as the queue uses it. Its uniforms all live in the blocks of
+// frame_uniforms.h, so there is nothing to set per program beyond binding
+// them once (see RenderQueue::registerProgram).
+struct RenderProgram {
+	GLuint programID;
+
+	RenderProgram();
+};
+
+// Per-instance attributes streamed from a buffer. GL 3.3 has no base
+// instance, so a packet's first instance is applied by re-pointing them.
+struct InstanceStream {
+	GLuint bufferID;
+	GLsizei stride;
+	uint32_t attributeCount;
+	MeshBlobAttribute attributes[RENDER_QUEUE_MAX_INSTANCE_ATTRIBUTES];
+
+	InstanceStream();
+	void addAttribute(uint32_t location, uint32_t components, uint32_t type, uint32_t offset);
+};
+
+// One draw and everything it needs bound
+struct DrawPacket {
+	RenderProgram *program;
+	GLuint vertexArrayID;
+	GLenum textureTarget; // GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+	GLuint textureID;     // Bound to textureTarget on unit 0, or 0 for none
+	bool doubleSided;     // Drawn with face culling off
+
+	GLenum mode;
+	GLenum indexType;
+	const void *indices;
+	GLsizei indexCount;
+	GLint baseVertex;
+	GLsizei instanceCount; // 0 for a non-instanced draw
+	const InstanceStream *instances;
+	GLsizei firstInstance;
+
+	// Index of the draw's ObjectUniformBlock in RenderQueue::objects, -1 to
+	// keep whatever is bound
+	int object;
+
+	uint64_t key;
+
+	DrawPacket();
+
+	// Draws indexCount indices from firstIndex of a mesh in arena
+	void setGeometry(const GeometryArena &arena, const GeometryAllocation &allocation, GLenum mode, GLuint firstIndex, GLsizei indexCount);
+	void setTexture(GLenum target, GLuint texture);
+};
+
+// Draw packets and their per-draw uniforms, recorded by one job. Recording
+// makes no GL calls, so any thread can fill a list as long as no other
+// fills it at the same time. Storage is kept from frame to frame, so once
+// warmed up recording allocates nothing.
+struct CommandList {
+	std::vector<DrawPacket> packets;
+	std::vector<ObjectUniformBlock> objects;
+
+	// Stores the per-draw uniforms of packets in this list and returns their index
+	int addObject(const glm::mat4 &model, const float *baseColor = NULL, int baseColorSize = 0);
+
+	void submit(const DrawPacket &packet);
+	void clear();
+};
+
+// The GL state the queue changes, as last set through it. Anything else
+// that touches this state must be followed by invalidate().
+struct GLStateCache {
+	GLuint program;
+	GLuint vertexArray;
+	GLenum textureTarget; // Of texture, on unit 0
+	GLuint texture;
+	int cullFace;         // -1 when unknown
+	const InstanceStream *instances;
+	GLsizei firstInstance;
+	size_t objectOffset;  // Bound to OBJECT_UNIFORMS_BINDING, (size_t)-1 when unknown
+
+	long long issued[RENDER_STATE_KIND_COUNT];
+	long long skipped[RENDER_STATE_KIND_COUNT];
+
+	GLStateCache();
+
+	void invalidate();
+	void useProgram(GLuint programID);
+	void bindVertexArray(GLuint vertexArrayID);
+	void bindTexture(GLenum target, GLuint textureID);
+	void setCullFace(bool enabled);
+	void bindObject(FrameUniforms &uniforms, size_t offset);
+
+	// Enables and points stream's attributes in the bound vertex array at
+	// instance first, or disables the previous stream's for NULL
+	void setInstances(const InstanceStream *stream, GLsizei first);
+};
+
+struct RenderQueue {
+	std::map<GLuint, RenderProgram> programs;
+	CommandList lists[RENDER_QUEUE_LISTS];
+
+	// The lists merged by flush
+	std::vector<DrawPacket> packets;
+	std::vector<ObjectUniformBlock> objects;
+	GLStateCache state;
+	FrameUniforms uniforms;
+
+	long long drawCalls;
+	long long listsMerged;
+	long long frames;
+
+	RenderQueue();
+
+	bool initialize();
+
+	// The RenderProgram of programID, its uniform blocks bound on first use
+	RenderProgram *registerProgram(GLuint programID);
+
+	// Starts a pass seen through view (see FrameUniforms::addView); shadows
+	// are bound to texture unit 1 unless NULL
+	void begin(int view, const ShadowCascades *shadows);
+
+	// The list a recording job fills; index 0 for a pass recorded on one thread
+	CommandList &list(int index) { return lists[index]; }
+
+	// Merges the lists in index order, so the draws come out in the same
+	// order whichever threads recorded them, uploads their objects into the
+	// uniform ring in one write, then sorts and issues the packets and
+	// clears the lists. Call on the GL thread once every recording job has
+	// finished. The state cache is invalidated first, since code outside
+	// the queue may have changed state in between.
+	void flush();
+
+	void endFrame() { ++frames; }
+	void resetStatistics();
+	void printStatistics() const;
+	void cleanup();
+};
+
+#endif
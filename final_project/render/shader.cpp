@@ -116,7 +116,7 @@ GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_fi
 	return ProgramID;
 }
 
-GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode)
+GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode, ShaderLinkCallback BeforeLink)
 {
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
@@ -169,6 +169,7 @@ GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentS
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if (BeforeLink != NULL) BeforeLink(ProgramID);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -6,6 +6,9 @@
 
 GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path);
 
-GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode);
+// Called on the program after the shaders are attached and before it is linked
+typedef void (*ShaderLinkCallback)(GLuint ProgramID);
+
+GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode, ShaderLinkCallback BeforeLink = NULL);
 
 #endif
@@ -0,0 +1,295 @@
+#include "shader_library.h"
+#include "shader.h"
+#include "gl_extensions.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdint.h>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define SHADER_LIBRARY_APIENTRY __stdcall
+#else
+#define SHADER_LIBRARY_APIENTRY
+#endif
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+#define SHADER_CACHE_VERSION 1
+
+// GL 4.1 / GL_ARB_get_program_binary entry points
+typedef void (SHADER_LIBRARY_APIENTRY *GetProgramBinaryFunc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (SHADER_LIBRARY_APIENTRY *ProgramBinaryFunc)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (SHADER_LIBRARY_APIENTRY *ProgramParameteriFunc)(GLuint program, GLenum pname, GLint value);
+
+static GetProgramBinaryFunc getProgramBinary = NULL;
+static ProgramBinaryFunc programBinary = NULL;
+static ProgramParameteriFunc programParameteri = NULL;
+
+struct ShaderCacheHeader {
+	char magic[4]; // "FPSB"
+	uint32_t version;
+	uint64_t driverHash;
+	uint64_t sourceHash;
+	uint32_t format;
+	uint32_t length;
+};
+
+static uint64_t hashBytes(uint64_t hash, const char *data, size_t size)
+{
+	// FNV-1a
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool readFile(const char *path, std::string &contents)
+{
+	std::ifstream stream(path, std::ios::in | std::ios::binary);
+	if (!stream.is_open()) return false;
+	std::stringstream sstr;
+	sstr << stream.rdbuf();
+	contents = sstr.str();
+	return true;
+}
+
+// Inserts the stage define, defines and prelude after the #version line. The
+// prelude is numbered as source string 1 and a #line directive follows it, so
+// compiler messages keep the file's line numbers.
+static void insertPrelude(std::string &code, const char *stage, const std::string &defines, const std::string &prelude)
+{
+	size_t position = 0;
+	size_t version = code.find("#version");
+	if (version != std::string::npos) {
+		position = code.find('\n', version);
+		position = position == std::string::npos ? code.size() : position + 1;
+	}
+	int line = 1;
+	for (size_t i = 0; i < position; ++i) {
+		if (code[i] == '\n') line++;
+	}
+
+	std::string text = std::string("#define ") + stage + "\n" + defines;
+	if (!prelude.empty()) {
+		text += "#line 1 1\n" + prelude;
+		if (prelude[prelude.size() - 1] != '\n') text += '\n';
+	}
+	char lineDirective[32];
+	snprintf(lineDirective, sizeof(lineDirective), "#line %d 0\n", line);
+	code.insert(position, text + lineDirective);
+}
+
+// Asks the driver to keep the binary retrievable; must happen before linking
+static void markRetrievable(GLuint program)
+{
+	if (programParameteri != NULL) programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+ShaderLibrary::ShaderLibrary() 
+	: binaryCache(false), driverHash(0), requests(0), compiled(0), cacheHits(0), cacheRejected(0)
+{
+}
+
+void ShaderLibrary::initialize(GLADloadfunc load, const std::string &directory)
+{
+	cacheDirectory = directory;
+
+	bool supported = HasGLVersion(4, 1) || HasGLExtension("GL_ARB_get_program_binary");
+	if (supported && load != NULL) {
+		getProgramBinary = (GetProgramBinaryFunc)load("glGetProgramBinary");
+		programBinary = (ProgramBinaryFunc)load("glProgramBinary");
+		programParameteri = (ProgramParameteriFunc)load("glProgramParameteri");
+	}
+
+	GLint formats = 0;
+	if (getProgramBinary != NULL && programBinary != NULL) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	binaryCache = formats > 0 && !cacheDirectory.empty();
+
+	// Binaries are only valid for the driver that produced them
+	std::string driver;
+	const GLubyte *strings[3] = { glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION) };
+	for (int i = 0; i < 3; ++i) {
+		if (strings[i] != NULL) driver += (const char *)strings[i];
+		driver += '\n';
+	}
+	driverHash = hashBytes(14695981039346656037ULL, driver.data(), driver.size());
+
+	if (binaryCache) {
+#ifdef _WIN32
+		_mkdir(cacheDirectory.c_str());
+#else
+		mkdir(cacheDirectory.c_str(), 0755);
+#endif
+	}
+}
+
+bool ShaderLibrary::loadPrelude(const char *path)
+{
+	if (!readFile(path, prelude)) {
+		printf("Shader prelude not found %s.\n", path);
+		return false;
+	}
+	return true;
+}
+
+void ShaderLibrary::cleanup()
+{
+	for (std::map<unsigned long long, Entry>::iterator it = programs.begin(); it != programs.end(); ++it) {
+		glDeleteProgram(it->second.program);
+	}
+	programs.clear();
+}
+
+GLuint ShaderLibrary::load(const char *vertexPath, const char *fragmentPath)
+{
+	requests++;
+
+	std::string vertexCode, fragmentCode;
+	if (!readFile(vertexPath, vertexCode)) {
+		printf("Vertex shader not found %s.\n", vertexPath);
+		return 0;
+	}
+	if (!readFile(fragmentPath, fragmentCode)) {
+		printf("Fragment shader not found %s.\n", fragmentPath);
+		return 0;
+	}
+	insertPrelude(vertexCode, "VERTEX_SHADER", defines, prelude);
+	insertPrelude(fragmentCode, "FRAGMENT_SHADER", defines, prelude);
+
+	uint64_t hash = hashBytes(14695981039346656037ULL, vertexCode.c_str(), vertexCode.size() + 1);
+	hash = hashBytes(hash, fragmentCode.c_str(), fragmentCode.size() + 1);
+
+	std::map<unsigned long long, Entry>::iterator found = programs.find(hash);
+	if (found != programs.end()) {
+		found->second.references++;
+		return found->second.program;
+	}
+
+	GLuint program = binaryCache ? loadBinary(hash) : 0;
+	if (program == 0) {
+		printf("Compiling %s + %s\n", vertexPath, fragmentPath);
+		program = LoadShadersFromString(vertexCode, fragmentCode, binaryCache ? markRetrievable : NULL);
+		if (program == 0) return 0;
+		compiled++;
+		if (binaryCache) saveBinary(hash, program);
+	}
+
+	Entry entry;
+	entry.program = program;
+	entry.references = 1;
+	programs[hash] = entry;
+	return program;
+}
+
+void ShaderLibrary::release(GLuint program)
+{
+	for (std::map<unsigned long long, Entry>::iterator it = programs.begin(); it != programs.end(); ++it) {
+		if (it->second.program != program) continue;
+		if (--it->second.references == 0) {
+			glDeleteProgram(program);
+			programs.erase(it);
+		}
+		return;
+	}
+}
+
+static std::string binaryPath(const std::string &directory, uint64_t hash)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+	return directory + "/" + name;
+}
+
+GLuint ShaderLibrary::loadBinary(unsigned long long hash)
+{
+	std::string path = binaryPath(cacheDirectory, hash);
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) return 0;
+
+	ShaderCacheHeader header;
+	std::vector<char> binary;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1
+		&& memcmp(header.magic, "FPSB", 4) == 0
+		&& header.version == SHADER_CACHE_VERSION
+		&& header.driverHash == driverHash
+		&& header.sourceHash == hash
+		&& header.length > 0;
+	if (valid) {
+		binary.resize(header.length);
+		valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+	}
+	fclose(file);
+
+	if (!valid) {
+		cacheRejected++;
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	programBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		// The driver rejected the binary, fall back to compiling from source
+		glDeleteProgram(program);
+		remove(path.c_str());
+		cacheRejected++;
+		return 0;
+	}
+
+	cacheHits++;
+	return program;
+}
+
+void ShaderLibrary::saveBinary(unsigned long long hash, GLuint program)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	getProgramBinary(program, length, &written, &format, binary.data());
+	if (written <= 0) return;
+
+	ShaderCacheHeader header;
+	memcpy(header.magic, "FPSB", 4);
+	header.version = SHADER_CACHE_VERSION;
+	header.driverHash = driverHash;
+	header.sourceHash = hash;
+	header.format = format;
+	header.length = (uint32_t)written;
+
+	// Write to a temporary file and rename so a crash never leaves a truncated entry
+	std::string path = binaryPath(cacheDirectory, hash);
+	std::string temporaryPath = path + ".tmp";
+	FILE *file = fopen(temporaryPath.c_str(), "wb");
+	if (file == NULL) return;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 
+		&& fwrite(binary.data(), 1, (size_t)written, file) == (size_t)written;
+	ok = fclose(file) == 0 && ok;
+	if (ok) {
+		remove(path.c_str());
+		ok = rename(temporaryPath.c_str(), path.c_str()) == 0;
+	}
+	if (!ok) remove(temporaryPath.c_str());
+}
+
+void ShaderLibrary::printStatistics() const
+{
+	printf("Shader library: %d requests, %zu programs, %d compiled, %d from binary cache, %d cache entries rejected\n",
+		requests, programs.size(), compiled, cacheHits, cacheRejected);
+}
@@ -0,0 +1,66 @@
+#ifndef _SHADER_LIBRARY_H_
+#define _SHADER_LIBRARY_H_
+
+#include <glad/gl.h>
+
+#include <map>
+#include <string>
+
+// Shares linked programs between objects and keeps them across runs.
+//
+// Programs are deduplicated by a hash of their sources, so every object 
+// loading scene.vert/scene.frag gets the same program. Linked programs are 
+// saved with glGetProgramBinary to the cache directory and reloaded with 
+// glProgramBinary on later runs; when the driver rejects a binary (new 
+// driver, different GPU) the program is compiled from source again and the 
+// entry is replaced.
+//
+// defines is inserted after the #version line of every shader, so options 
+// such as the shadow filter are compiled in rather than branched on. The 
+// prelude (common.glsl: the uniform blocks and the shadow lookup) follows 
+// it, with VERTEX_SHADER or FRAGMENT_SHADER defined for the stage. Both are 
+// part of the hash, so each set of options has its own programs.
+struct ShaderLibrary {
+	struct Entry {
+		GLuint program;
+		int references;
+	};
+
+	ShaderLibrary();
+
+	// load resolves the entry points glad's 3.3 core profile does not cover. 
+	// An empty cacheDirectory disables the binary cache.
+	void initialize(GLADloadfunc load, const std::string &cacheDirectory = "shader_cache");
+	void cleanup();
+
+	// Reads the prelude prepended to every shader loaded afterwards
+	bool loadPrelude(const char *path);
+
+	// Returns a program shared by every caller with identical sources, or 0
+	GLuint load(const char *vertexPath, const char *fragmentPath);
+
+	// Drops one reference; the program is deleted with its last reference
+	void release(GLuint program);
+
+	void printStatistics() const;
+
+	std::string defines;
+	std::string prelude;
+
+	bool binaryCache;
+	std::string cacheDirectory;
+	unsigned long long driverHash;
+
+	std::map<unsigned long long, Entry> programs;
+
+	int requests;
+	int compiled;
+	int cacheHits;
+	int cacheRejected;
+
+private:
+	GLuint loadBinary(unsigned long long hash);
+	void saveBinary(unsigned long long hash, GLuint program);
+};
+
+#endif
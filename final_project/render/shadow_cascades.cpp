@@ -0,0 +1,227 @@
+#include "shadow_cascades.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Depth texture array of count size x size layers. Sampled through a
+// shadow sampler, so every fetch returns the bilinear blend of four depth
+// comparisons.
+static GLuint createDepthArray(int size, int count)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, count, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return texture;
+}
+
+// Depth-only framebuffer with the first layer of texture attached
+static GLuint createDepthFramebuffer(GLuint texture, GLenum &status)
+{
+	GLuint framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return framebuffer;
+}
+
+ShadowCascades::ShadowCascades()
+	: framebufferID(0), textureID(0), staticFramebufferID(0), staticTextureID(0), size(0), cascadeCount(0), lightSpaceMatrix(1.0f), splitLambda(0.75f),
+	slopeBias(2.0f), constantBias(2.0f), frame(0)
+{
+}
+
+bool ShadowCascades::initialize(int count, const int *resolutions, const int *intervals)
+{
+	cascadeCount = std::min(std::max(count, 1), MAX_SHADOW_CASCADES);
+	size = 0;
+	for (int i = 0; i < cascadeCount; ++i) {
+		ShadowCascade &cascade = cascades[i];
+		cascade.resolution = std::max(resolutions[i], 16);
+		cascade.interval = std::max(intervals[i], 1);
+		cascade.splitNear = cascade.splitFar = 0.0f;
+		cascade.crop = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+		cascade.matrix = glm::mat4(1.0f);
+		cascade.due = false;
+		cascade.drawn = false;
+		cascade.staticMatrix = glm::mat4(1.0f);
+		cascade.staticVersion = 0;
+		cascade.staticValid = false;
+		size = std::max(size, cascade.resolution);
+	}
+
+	GLenum status, staticStatus;
+	textureID = createDepthArray(size, cascadeCount);
+	framebufferID = createDepthFramebuffer(textureID, status);
+	staticTextureID = createDepthArray(size, cascadeCount);
+	staticFramebufferID = createDepthFramebuffer(staticTextureID, staticStatus);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE || staticStatus != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Shadow framebuffer is incomplete (0x" << std::hex << (status != GL_FRAMEBUFFER_COMPLETE ? status : staticStatus) << std::dec << ")." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Bounds in the light's normalized device x and y of the camera frustum
+// slice between depths near and far; false when part of it lies behind
+// the light
+static bool sliceBounds(const glm::mat4 &inverseView, float tanHalfFov, float aspect, float near, float far,
+	const glm::mat4 &lightSpaceMatrix, glm::vec2 &boundsMin, glm::vec2 &boundsMax)
+{
+	boundsMin = glm::vec2(1e30f);
+	boundsMax = glm::vec2(-1e30f);
+	for (int corner = 0; corner < 8; ++corner) {
+		float depth = (corner & 4) ? far : near;
+		float halfHeight = depth * tanHalfFov;
+		float halfWidth = halfHeight * aspect;
+		glm::vec4 view((corner & 1) ? halfWidth : -halfWidth, (corner & 2) ? halfHeight : -halfHeight, -depth, 1.0f);
+		glm::vec4 clip = lightSpaceMatrix * (inverseView * view);
+		if (clip.w <= 1e-3f) return false;
+		glm::vec2 ndc = glm::vec2(clip) / clip.w;
+		boundsMin = glm::min(boundsMin, ndc);
+		boundsMax = glm::max(boundsMax, ndc);
+	}
+	return true;
+}
+
+void ShadowCascades::update(const glm::mat4 &viewMatrix, float fov, float aspect, float zNear, float zFar, const glm::mat4 &lightSpaceMatrix)
+{
+	glm::mat4 inverseView = glm::inverse(viewMatrix);
+	float tanHalfFov = std::tan(0.5f * fov);
+
+	if (lightSpaceMatrix != this->lightSpaceMatrix) {
+		this->lightSpaceMatrix = lightSpaceMatrix;
+		for (int i = 0; i < cascadeCount; ++i) cascades[i].drawn = false;
+	}
+
+	for (int i = 0; i < cascadeCount; ++i) {
+		ShadowCascade &cascade = cascades[i];
+
+		// Practical split scheme: a blend of logarithmic and uniform splits
+		float t = (float)(i + 1) / cascadeCount;
+		float logSplit = zNear * std::pow(zFar / zNear, t);
+		float uniformSplit = zNear + (zFar - zNear) * t;
+		cascade.splitNear = i == 0 ? zNear : cascades[i - 1].splitFar;
+		cascade.splitFar = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+
+		// Staggered so cascades with the same interval do not all redraw together
+		cascade.due = !cascade.drawn || (frame + i) % cascade.interval == 0;
+		if (!cascade.due) continue;
+
+		glm::vec2 sliceMin(-1.0f), sliceMax(1.0f);
+		bool bounded = sliceBounds(inverseView, tanHalfFov, aspect, cascade.splitNear, cascade.splitFar, lightSpaceMatrix, sliceMin, sliceMax);
+
+		// Nothing outside the light's own frustum can be shadowed
+		glm::vec2 neededMin = glm::max(sliceMin, glm::vec2(-1.0f));
+		glm::vec2 neededMax = glm::min(sliceMax, glm::vec2(1.0f));
+
+		// Keep the previous fit while it covers the slice and is not much
+		// larger than a new one would be
+		if (cascade.drawn) {
+			glm::vec2 previousMin = (glm::vec2(-1.0f) - glm::vec2(cascade.crop.z, cascade.crop.w)) / glm::vec2(cascade.crop.x, cascade.crop.y);
+			glm::vec2 previousMax = (glm::vec2(1.0f) - glm::vec2(cascade.crop.z, cascade.crop.w)) / glm::vec2(cascade.crop.x, cascade.crop.y);
+			glm::vec2 previousExtent = previousMax - previousMin;
+			glm::vec2 neededExtent = neededMax - neededMin;
+			if (previousMin.x <= neededMin.x && previousMin.y <= neededMin.y && neededMax.x <= previousMax.x && neededMax.y <= previousMax.y
+				&& previousExtent.x <= 1.3f * neededExtent.x && previousExtent.y <= 1.3f * neededExtent.y) {
+				continue;
+			}
+		}
+
+		// Room for the camera to move before the cascade has to be refitted
+		glm::vec2 boundsMin(-1.0f), boundsMax(1.0f);
+		if (bounded) {
+			glm::vec2 extent = sliceMax - sliceMin;
+			float margin = cascade.interval > 1 ? 0.1f : 0.05f;
+			boundsMin = glm::max(sliceMin - extent * margin, glm::vec2(-1.0f));
+			boundsMax = glm::min(sliceMax + extent * margin, glm::vec2(1.0f));
+		}
+		glm::vec2 extent = glm::max(boundsMax - boundsMin, glm::vec2(1e-4f));
+
+		// Snap the centre to the cascade's texels so a small camera movement
+		// does not make the shadow edges crawl
+		glm::vec2 texel = extent / (float)cascade.resolution;
+		glm::vec2 centre = glm::floor(0.5f * (boundsMin + boundsMax) / texel) * texel;
+
+		// Crop matrix: scales and offsets the light's clip space x and y
+		glm::vec2 scale = 2.0f / extent;
+		cascade.crop = glm::vec4(scale.x, scale.y, -centre.x * scale.x, -centre.y * scale.y);
+		glm::mat4 crop(1.0f);
+		crop[0][0] = cascade.crop.x;
+		crop[1][1] = cascade.crop.y;
+		crop[3][0] = cascade.crop.z;
+		crop[3][1] = cascade.crop.w;
+		cascade.matrix = crop * lightSpaceMatrix;
+		cascade.drawn = true;
+	}
+	++frame;
+}
+
+void ShadowCascades::bindCascade(int i) const
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textureID, 0, i);
+	glViewport(0, 0, cascades[i].resolution, cascades[i].resolution);
+}
+
+bool ShadowCascades::staticStale(int i, unsigned staticVersion) const
+{
+	const ShadowCascade &cascade = cascades[i];
+	return !cascade.staticValid || cascade.staticVersion != staticVersion || cascade.staticMatrix != cascade.matrix;
+}
+
+void ShadowCascades::bindStatic(int i, unsigned staticVersion)
+{
+	ShadowCascade &cascade = cascades[i];
+	cascade.staticMatrix = cascade.matrix;
+	cascade.staticVersion = staticVersion;
+	cascade.staticValid = true;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, staticFramebufferID);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTextureID, 0, i);
+	glViewport(0, 0, cascade.resolution, cascade.resolution);
+}
+
+void ShadowCascades::restoreStatic(int i) const
+{
+	int resolution = cascades[i].resolution;
+	bindCascade(i);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebufferID);
+	glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTextureID, 0, i);
+	glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebufferID);
+}
+
+double ShadowCascades::averageFill() const
+{
+	double texels = 0.0;
+	for (int i = 0; i < cascadeCount; ++i) {
+		texels += (double)cascades[i].resolution * cascades[i].resolution / cascades[i].interval;
+	}
+	return texels;
+}
+
+void ShadowCascades::cleanup()
+{
+	glDeleteFramebuffers(1, &framebufferID);
+	glDeleteTextures(1, &textureID);
+	glDeleteFramebuffers(1, &staticFramebufferID);
+	glDeleteTextures(1, &staticTextureID);
+	framebufferID = 0;
+	textureID = 0;
+	staticFramebufferID = 0;
+	staticTextureID = 0;
+}
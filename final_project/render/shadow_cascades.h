@@ -0,0 +1,87 @@
+#ifndef _SHADOW_CASCADES_H_
+#define _SHADOW_CASCADES_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+// Cascaded shadow maps in one depth texture array. The camera frustum is
+// split by depth and each cascade crops the light's projection to one
+// slice, so near geometry gets most of the texels. Every cascade has its
+// own resolution (it renders into the corner of its layer) and is redrawn
+// every interval frames. The crops only scale and offset the light's x and
+// y, so the shaders transform a fragment by the light once and pick the
+// first cascade whose map covers it (see calculateShadow in common.glsl).
+//
+// Static casters are drawn into a second texture array that is kept until
+// the cascade's matrix or the caller's static version changes; a redraw
+// copies that cache into the shadow map and adds only the dynamic casters.
+
+// Must match MAX_SHADOW_CASCADES in common.glsl
+#define MAX_SHADOW_CASCADES 4
+
+struct ShadowCascade {
+	int resolution;   // Texels per side used in its layer
+	int interval;     // Redrawn every interval frames
+	float splitNear;  // Camera view depth range of the slice
+	float splitFar;
+	glm::vec4 crop;   // Scale and offset of the light's x and y, as last drawn
+	glm::mat4 matrix; // crop applied to the light space matrix
+	bool due;         // Redrawn this frame
+	bool drawn;
+
+	// What the static cache layer was last drawn with
+	glm::mat4 staticMatrix;
+	unsigned staticVersion;
+	bool staticValid;
+};
+
+struct ShadowCascades {
+	GLuint framebufferID;
+	GLuint textureID;
+	GLuint staticFramebufferID;
+	GLuint staticTextureID;
+	int size; // Layer size, the largest cascade resolution
+	int cascadeCount;
+	ShadowCascade cascades[MAX_SHADOW_CASCADES];
+	glm::mat4 lightSpaceMatrix; // Cropped by every cascade
+	float splitLambda; // 0 splits the depth range evenly, 1 logarithmically
+
+	// glPolygonOffset factor and units of the depth pass: a slope-scaled bias
+	// that grows where the light grazes a surface
+	float slopeBias;
+	float constantBias;
+	long long frame;
+
+	ShadowCascades();
+
+	bool initialize(int count, const int *resolutions, const int *intervals);
+
+	// Splits [zNear, zFar] of the camera (fov in radians) and fits the
+	// cascades due this frame to their slices inside lightSpaceMatrix; a
+	// new lightSpaceMatrix makes every cascade due. A cascade keeps its
+	// previous fit while that still covers its slice without wasting many
+	// texels, so the static cache survives small camera movements.
+	void update(const glm::mat4 &viewMatrix, float fov, float aspect, float zNear, float zFar, const glm::mat4 &lightSpaceMatrix);
+
+	// Attaches cascade i's layer to the framebuffer and sets the viewport
+	void bindCascade(int i) const;
+
+	// True when cascade i's static cache was drawn with another matrix or an
+	// older staticVersion
+	bool staticStale(int i, unsigned staticVersion) const;
+
+	// Attaches cascade i's static cache layer and sets the viewport; the
+	// caller clears it and draws every static caster
+	void bindStatic(int i, unsigned staticVersion);
+
+	// Copies cascade i's static cache into its shadow map and leaves the
+	// shadow map bound as by bindCascade
+	void restoreStatic(int i) const;
+
+	// Depth texels written per frame, averaged over the update intervals
+	double averageFill() const;
+
+	void cleanup();
+};
+
+#endif
@@ -0,0 +1,378 @@
+#include "texture_cache.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#define TEXTURE_CACHE_VERSION 1
+
+// Level data is aligned so it can be handed to the driver straight from the mapping
+#define TEXTURE_CACHE_ALIGNMENT 64
+
+struct TextureCacheHeader {
+	char magic[4]; // "FPTX"
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceModified;
+	uint32_t internalFormat;
+	uint32_t format;
+	uint32_t compressed; // Only set by older builds, which cached DXT1 levels
+	uint32_t levelCount;
+};
+
+struct TextureCacheLevel {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;
+	uint64_t size;
+};
+
+static std::string cacheDirectory = "texture_cache";
+
+TextureImage::TextureImage() : internalFormat(GL_RGB8), format(GL_RGB)
+{
+}
+
+const unsigned char *TextureImage::data() const
+{
+	return mapping.data != NULL ? mapping.data : storage.data();
+}
+
+void SetTextureCacheDirectory(const std::string &directory)
+{
+	cacheDirectory = directory;
+}
+
+static uint64_t hashString(const char *s)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (; *s; ++s) {
+		hash ^= (unsigned char)*s;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Resized images are cached apart from the image at its own size
+static std::string cachePath(const char *sourcePath, int width = 0, int height = 0)
+{
+	char name[64];
+	if (width > 0 && height > 0) {
+		snprintf(name, sizeof(name), "%016llx-%dx%d.tex", (unsigned long long)hashString(sourcePath), width, height);
+	} else {
+		snprintf(name, sizeof(name), "%016llx.tex", (unsigned long long)hashString(sourcePath));
+	}
+	return cacheDirectory + "/" + name;
+}
+
+static bool sourceInfo(const char *path, uint64_t &size, int64_t &modified)
+{
+	struct stat info;
+	if (stat(path, &info) != 0) return false;
+	size = (uint64_t)info.st_size;
+	modified = (int64_t)info.st_mtime;
+	return true;
+}
+
+static void makeDirectory(const std::string &path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+static size_t alignUp(size_t value)
+{
+	return (value + TEXTURE_CACHE_ALIGNMENT - 1) & ~(size_t)(TEXTURE_CACHE_ALIGNMENT - 1);
+}
+
+// Maps a cache entry and checks it still matches the source file
+static bool loadCacheEntry(const std::string &path, uint64_t sourceSize, int64_t sourceModified, TextureImage &image)
+{
+	MappedFile file;
+	if (!MapFile(path.c_str(), file)) return false;
+
+	const TextureCacheHeader *header = (const TextureCacheHeader *)file.data;
+	bool valid = file.size >= sizeof(TextureCacheHeader) 
+		&& memcmp(header->magic, "FPTX", 4) == 0
+		&& header->version == TEXTURE_CACHE_VERSION
+		&& header->sourceSize == sourceSize
+		&& header->sourceModified == sourceModified
+		&& header->levelCount > 0
+		&& file.size >= sizeof(TextureCacheHeader) + header->levelCount * sizeof(TextureCacheLevel)
+		&& !header->compressed;
+
+	if (valid) {
+		const TextureCacheLevel *levels = (const TextureCacheLevel *)(header + 1);
+		image.levels.resize(header->levelCount);
+		for (uint32_t i = 0; i < header->levelCount && valid; ++i) {
+			if (levels[i].offset + levels[i].size > file.size) valid = false;
+			image.levels[i].width = (int)levels[i].width;
+			image.levels[i].height = (int)levels[i].height;
+			image.levels[i].offset = (size_t)levels[i].offset;
+			image.levels[i].size = (size_t)levels[i].size;
+		}
+	}
+
+	if (!valid) {
+		image.levels.clear();
+		UnmapFile(file);
+		return false;
+	}
+
+	image.internalFormat = header->internalFormat;
+	image.format = header->format;
+	image.mapping = file;
+	return true;
+}
+
+static bool writeCacheEntry(const std::string &path, uint64_t sourceSize, int64_t sourceModified, const TextureImage &image)
+{
+	makeDirectory(cacheDirectory);
+
+	// Write to a temporary file and rename, so a reader never maps a half-written entry
+	std::string temporaryPath = path + ".tmp";
+	FILE *file = fopen(temporaryPath.c_str(), "wb");
+	if (file == NULL) return false;
+
+	TextureCacheHeader header;
+	memcpy(header.magic, "FPTX", 4);
+	header.version = TEXTURE_CACHE_VERSION;
+	header.sourceSize = sourceSize;
+	header.sourceModified = sourceModified;
+	header.internalFormat = image.internalFormat;
+	header.format = image.format;
+	header.compressed = 0;
+	header.levelCount = (uint32_t)image.levels.size();
+
+	size_t offset = alignUp(sizeof(header) + image.levels.size() * sizeof(TextureCacheLevel));
+	std::vector<TextureCacheLevel> levels(image.levels.size());
+	for (size_t i = 0; i < levels.size(); ++i) {
+		levels[i].width = image.levels[i].width;
+		levels[i].height = image.levels[i].height;
+		levels[i].offset = offset;
+		levels[i].size = image.levels[i].size;
+		offset = alignUp(offset + image.levels[i].size);
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 
+		&& fwrite(levels.data(), sizeof(TextureCacheLevel), levels.size(), file) == levels.size();
+
+	static const unsigned char padding[TEXTURE_CACHE_ALIGNMENT] = { 0 };
+	size_t position = sizeof(header) + levels.size() * sizeof(TextureCacheLevel);
+	for (size_t i = 0; i < levels.size() && ok; ++i) {
+		ok = fwrite(padding, 1, levels[i].offset - position, file) == levels[i].offset - position
+			&& fwrite(image.data() + image.levels[i].offset, 1, image.levels[i].size, file) == image.levels[i].size;
+		position = levels[i].offset + levels[i].size;
+	}
+
+	ok = fclose(file) == 0 && ok;
+	if (ok) {
+		remove(path.c_str());
+		ok = rename(temporaryPath.c_str(), path.c_str()) == 0;
+	}
+	if (!ok) remove(temporaryPath.c_str());
+	return ok;
+}
+
+// 2x2 box filter; an odd last row or column is folded into its neighbour
+static void downsample(const unsigned char *src, int width, int height, unsigned char *dst, int dstWidth, int dstHeight, int channels)
+{
+	for (int y = 0; y < dstHeight; ++y) {
+		int y0 = y * 2 < height ? y * 2 : height - 1;
+		int y1 = y * 2 + 1 < height ? y * 2 + 1 : y0;
+		for (int x = 0; x < dstWidth; ++x) {
+			int x0 = x * 2 < width ? x * 2 : width - 1;
+			int x1 = x * 2 + 1 < width ? x * 2 + 1 : x0;
+			for (int c = 0; c < channels; ++c) {
+				int sum = src[(y0 * width + x0) * channels + c] + src[(y0 * width + x1) * channels + c]
+					+ src[(y1 * width + x0) * channels + c] + src[(y1 * width + x1) * channels + c];
+				dst[(y * dstWidth + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+// Source texels and weights of every destination texel along one axis, the
+// texels of destination i being indices[offsets[i]] to indices[offsets[i + 1] - 1].
+// A tent filter as wide as the scale averages every covered texel when
+// shrinking and interpolates when enlarging. Texels wrap around, since the
+// textures repeat.
+static void resampleTaps(int length, int dstLength, std::vector<int> &offsets, std::vector<int> &indices, std::vector<float> &weights)
+{
+	float scale = (float)length / dstLength;
+	float radius = scale > 1.0f ? scale : 1.0f;
+	offsets.assign(1, 0);
+	indices.clear();
+	weights.clear();
+	for (int i = 0; i < dstLength; ++i) {
+		float center = (i + 0.5f) * scale - 0.5f;
+		int first = (int)std::floor(center - radius) + 1;
+		int last = (int)std::floor(center + radius);
+		size_t start = weights.size();
+		float total = 0.0f;
+		for (int j = first; j <= last; ++j) {
+			float weight = 1.0f - std::fabs(j - center) / radius;
+			if (weight <= 0.0f) continue;
+			indices.push_back((j % length + length) % length);
+			weights.push_back(weight);
+			total += weight;
+		}
+		for (size_t k = start; k < weights.size(); ++k) weights[k] /= total;
+		offsets.push_back((int)weights.size());
+	}
+}
+
+// Separable resampling to any size: rows first, then columns
+static void resample(const unsigned char *src, int width, int height, unsigned char *dst, int dstWidth, int dstHeight, int channels)
+{
+	std::vector<int> xOffsets, xIndices, yOffsets, yIndices;
+	std::vector<float> xWeights, yWeights;
+	resampleTaps(width, dstWidth, xOffsets, xIndices, xWeights);
+	resampleTaps(height, dstHeight, yOffsets, yIndices, yWeights);
+
+	size_t rowSize = (size_t)dstWidth * channels;
+	std::vector<float> rows(rowSize * height, 0.0f);
+	for (int y = 0; y < height; ++y) {
+		const unsigned char *srcRow = src + (size_t)y * width * channels;
+		float *row = &rows[y * rowSize];
+		for (int x = 0; x < dstWidth; ++x) {
+			for (int k = xOffsets[x]; k < xOffsets[x + 1]; ++k) {
+				const unsigned char *texel = srcRow + (size_t)xIndices[k] * channels;
+				for (int c = 0; c < channels; ++c) row[x * channels + c] += xWeights[k] * texel[c];
+			}
+		}
+	}
+
+	std::vector<float> sum(rowSize);
+	for (int y = 0; y < dstHeight; ++y) {
+		std::fill(sum.begin(), sum.end(), 0.0f);
+		for (int k = yOffsets[y]; k < yOffsets[y + 1]; ++k) {
+			const float *row = &rows[yIndices[k] * rowSize];
+			for (size_t i = 0; i < rowSize; ++i) sum[i] += yWeights[k] * row[i];
+		}
+		unsigned char *dstRow = dst + y * rowSize;
+		for (size_t i = 0; i < rowSize; ++i) {
+			float value = sum[i] + 0.5f;
+			dstRow[i] = (unsigned char)(value < 0.0f ? 0.0f : value > 255.0f ? 255.0f : value);
+		}
+	}
+}
+
+static bool decodeImage(const char *path, TextureImage &image, int width, int height)
+{
+	const int channels = 3;
+	int w, h, sourceChannels;
+	unsigned char *pixels = stbi_load(path, &w, &h, &sourceChannels, channels);
+	if (pixels == NULL) return false;
+
+	std::vector<unsigned char> resized;
+	if (width > 0 && height > 0 && (width != w || height != h)) {
+		resized.resize((size_t)width * height * channels);
+		resample(pixels, w, h, resized.data(), width, height, channels);
+		w = width;
+		h = height;
+	}
+
+	// Lay out the whole chain in one allocation
+	size_t total = 0;
+	int levelWidth = w, levelHeight = h;
+	while (true) {
+		TextureLevel level;
+		level.width = levelWidth;
+		level.height = levelHeight;
+		level.offset = total;
+		level.size = (size_t)levelWidth * levelHeight * channels;
+		image.levels.push_back(level);
+		total += alignUp(level.size);
+		if (levelWidth == 1 && levelHeight == 1) break;
+		levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+		levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+	}
+
+	image.storage.resize(total);
+	memcpy(image.storage.data(), resized.empty() ? pixels : resized.data(), image.levels[0].size);
+	stbi_image_free(pixels);
+
+	for (size_t i = 1; i < image.levels.size(); ++i) {
+		const TextureLevel &src = image.levels[i - 1];
+		const TextureLevel &dst = image.levels[i];
+		downsample(image.storage.data() + src.offset, src.width, src.height, 
+			image.storage.data() + dst.offset, dst.width, dst.height, channels);
+	}
+
+	image.internalFormat = GL_RGB8;
+	image.format = GL_RGB;
+	return true;
+}
+
+bool LoadTextureImage(const char *path, TextureImage &image, int width, int height)
+{
+	uint64_t sourceSize = 0;
+	int64_t sourceModified = 0;
+	if (!sourceInfo(path, sourceSize, sourceModified)) return false;
+
+	bool useCache = !cacheDirectory.empty();
+	std::string entry = useCache ? cachePath(path, width, height) : std::string();
+	if (useCache && loadCacheEntry(entry, sourceSize, sourceModified, image)) return true;
+
+	if (!decodeImage(path, image, width, height)) return false;
+	if (useCache && !writeCacheEntry(entry, sourceSize, sourceModified, image)) {
+		printf("Failed to write texture cache entry %s\n", entry.c_str());
+	}
+	return true;
+}
+
+void ReleaseTextureImage(TextureImage &image)
+{
+	UnmapFile(image.mapping);
+	std::vector<unsigned char>().swap(image.storage);
+	image.levels.clear();
+}
+
+// base is a client pointer to the first level, or an offset into the bound 
+// pixel unpack buffer. The levels replace layer of the bound GL_TEXTURE_2D_ARRAY.
+static void uploadLevels(const TextureImage &image, uintptr_t base, GLint layer)
+{
+	// Mip levels of RGB images are rarely 4-byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	size_t first = image.levels.empty() ? 0 : image.levels[0].offset;
+	for (size_t i = 0; i < image.levels.size(); ++i) {
+		const TextureLevel &level = image.levels[i];
+		const void *pixels = (const void *)(base + (level.offset - first));
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)i, 0, 0, layer, level.width, level.height, 1,
+			image.format, GL_UNSIGNED_BYTE, pixels);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+size_t TextureImageDataSize(const TextureImage &image)
+{
+	if (image.levels.empty()) return 0;
+	const TextureLevel &last = image.levels.back();
+	return last.offset + last.size - image.levels[0].offset;
+}
+
+void UploadTextureImageLayer(const TextureImage &image, GLint layer)
+{
+	if (image.levels.empty()) return;
+	uploadLevels(image, (uintptr_t)(image.data() + image.levels[0].offset), layer);
+}
+
+void UploadTextureImageLayerFromBuffer(const TextureImage &image, GLint layer, size_t bufferOffset)
+{
+	uploadLevels(image, (uintptr_t)bufferOffset, layer);
+}
@@ -0,0 +1,58 @@
+#ifndef _TEXTURE_CACHE_H_
+#define _TEXTURE_CACHE_H_
+
+#include <glad/gl.h>
+#include <core/mapped_file.h>
+
+#include <string>
+#include <vector>
+
+// On-disk cache of GPU-ready textures. The first load of an image decodes it, 
+// builds the full mip chain on the CPU and stores every level in a cache file 
+// keyed by the source path, modification time and size. Later loads map that 
+// file and upload the levels straight from the mapping with no decoding.
+
+// One mip level; offset is relative to TextureImage::data()
+struct TextureLevel {
+	int width;
+	int height;
+	size_t offset;
+	size_t size;
+};
+
+struct TextureImage {
+	GLenum internalFormat; // GL_RGB8
+	GLenum format;         // Pixel format of the levels
+	std::vector<TextureLevel> levels;
+
+	// Level data lives either in a cache file mapping or in storage
+	MappedFile mapping;
+	std::vector<unsigned char> storage;
+
+	TextureImage();
+	const unsigned char *data() const;
+};
+
+// Cache settings; the directory defaults to "texture_cache" and an empty 
+// directory disables the cache
+void SetTextureCacheDirectory(const std::string &directory);
+
+// Decodes or maps an image with its mip chain. Touches no GL state, so it can 
+// run on any thread. With width and height set, the image is resampled to 
+// that size before the mip chain is built, and cached under an entry of its 
+// own.
+bool LoadTextureImage(const char *path, TextureImage &image, int width = 0, int height = 0);
+
+void ReleaseTextureImage(TextureImage &image);
+
+// Size of the contiguous block holding every level, starting at the first level
+size_t TextureImageDataSize(const TextureImage &image);
+
+// Uploads all levels into one layer of the texture bound to 
+// GL_TEXTURE_2D_ARRAY, whose levels must have the sizes of the image's. The 
+// FromBuffer variant sources the levels from the bound 
+// GL_PIXEL_UNPACK_BUFFER, into which the block above was copied at bufferOffset.
+void UploadTextureImageLayer(const TextureImage &image, GLint layer);
+void UploadTextureImageLayerFromBuffer(const TextureImage &image, GLint layer, size_t bufferOffset);
+
+#endif
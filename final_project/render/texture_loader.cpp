@@ -0,0 +1,210 @@
+#include "texture_loader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+
+AsyncTextureLoader::AsyncTextureLoader() 
+	: initialized(false), outstanding(0), stopping(false), nextBuffer(0)
+{
+	memset(buffers, 0, sizeof(buffers));
+}
+
+void AsyncTextureLoader::initialize(int workerCount)
+{
+	if (workerCount <= 0) {
+		int hardwareThreads = (int)std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+		if (workerCount > 8) workerCount = 8;
+	}
+
+	for (int i = 0; i < TEXTURE_LOADER_BUFFERS; ++i) {
+		glGenBuffers(1, &buffers[i].buffer);
+		buffers[i].capacity = 0;
+		buffers[i].fence = 0;
+	}
+
+	stopping = false;
+	for (int i = 0; i < workerCount; ++i) {
+		workers.push_back(std::thread(&AsyncTextureLoader::workerMain, this));
+	}
+	initialized = true;
+}
+
+void AsyncTextureLoader::cleanup()
+{
+	if (!initialized) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeWorkers.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+	workers.clear();
+
+	// Drop whatever was never uploaded
+	for (size_t i = 0; i < decoded.size(); ++i) {
+		if (decoded[i].image != NULL) {
+			ReleaseTextureImage(*decoded[i].image);
+			delete decoded[i].image;
+		}
+	}
+	decoded.clear();
+	queued.clear();
+	outstanding = 0;
+
+	for (int i = 0; i < TEXTURE_LOADER_BUFFERS; ++i) {
+		if (buffers[i].fence != 0) glDeleteSync(buffers[i].fence);
+		glDeleteBuffers(1, &buffers[i].buffer);
+	}
+	memset(buffers, 0, sizeof(buffers));
+	initialized = false;
+}
+
+void AsyncTextureLoader::loadLayer(const char *path, GLuint arrayTexture, GLint layer, int width, int height)
+{
+	Request request;
+	request.path = path;
+	request.texture = arrayTexture;
+	request.layer = layer;
+	request.width = width;
+	request.height = height;
+	request.image = NULL;
+	enqueue(request);
+}
+
+void AsyncTextureLoader::enqueue(const Request &request)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(request);
+	}
+	wakeWorkers.notify_one();
+	outstanding++;
+}
+
+void AsyncTextureLoader::workerMain()
+{
+	while (true) {
+		Request request;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && queued.empty()) wakeWorkers.wait(lock);
+			if (stopping) return;
+			request = queued.front();
+			queued.pop_front();
+		}
+
+		TextureImage *image = new TextureImage();
+		if (LoadTextureImage(request.path.c_str(), *image, request.width, request.height)) {
+			request.image = image;
+		} else {
+			delete image;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			decoded.push_back(request);
+		}
+		wakeLoader.notify_one();
+	}
+}
+
+bool AsyncTextureLoader::upload(Request &request, size_t &bytes)
+{
+	// Take the next buffer in the ring once the GPU has finished reading it
+	UploadBuffer &slot = buffers[nextBuffer];
+	if (slot.fence != 0) {
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_TIMEOUT_EXPIRED) return false;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+	}
+	nextBuffer = (nextBuffer + 1) % TEXTURE_LOADER_BUFFERS;
+
+	const TextureImage &image = *request.image;
+	size_t size = TextureImageDataSize(image);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+	if (slot.capacity < size) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		slot.capacity = size;
+	}
+
+	// The fence above guarantees the GPU is done with this buffer
+	void *destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, 
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (destination != NULL) {
+		memcpy(destination, image.data() + image.levels[0].offset, size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, request.texture);
+		UploadTextureImageLayerFromBuffer(image, request.layer, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (destination == NULL) {
+		// Mapping failed; upload from client memory instead
+		glBindTexture(GL_TEXTURE_2D_ARRAY, request.texture);
+		UploadTextureImageLayer(image, request.layer);
+	}
+
+	bytes += size;
+	return true;
+}
+
+void AsyncTextureLoader::update(size_t byteBudget)
+{
+	if (!initialized || outstanding == 0) return;
+
+	size_t bytes = 0;
+	while (bytes < byteBudget) {
+		Request request;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (decoded.empty()) break;
+			request = decoded.front();
+		}
+
+		if (request.image == NULL) {
+			std::cout << "Failed to load texture " << request.path << std::endl;
+		} else {
+			if (!upload(request, bytes)) break; // Every buffer still in flight
+			ReleaseTextureImage(*request.image);
+			delete request.image;
+			std::cout << "Texture loaded successfully: " << request.path << std::endl;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			decoded.pop_front();
+		}
+		outstanding--;
+	}
+}
+
+void AsyncTextureLoader::finish()
+{
+	while (initialized && outstanding > 0) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (decoded.empty()) wakeLoader.wait(lock);
+		}
+		int before = outstanding;
+		update((size_t)-1);
+
+		// Every buffer is still in flight; block on the oldest instead of spinning
+		UploadBuffer &oldest = buffers[nextBuffer];
+		if (outstanding == before && oldest.fence != 0) {
+			glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		}
+	}
+}
+
+bool AsyncTextureLoader::idle()
+{
+	return outstanding == 0;
+}
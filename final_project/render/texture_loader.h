@@ -0,0 +1,79 @@
+#ifndef _TEXTURE_LOADER_H_
+#define _TEXTURE_LOADER_H_
+
+#include <glad/gl.h>
+#include <render/texture_cache.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Number of pixel unpack buffers uploads rotate through
+#define TEXTURE_LOADER_BUFFERS 4
+
+// Loads textures without blocking the GL thread. Images are decoded (or 
+// mapped from the texture cache) on a pool of worker threads; the GL thread 
+// copies finished images into a ring of pixel unpack buffers and fills the 
+// texture array layer from there, so the driver can transfer them 
+// asynchronously.
+struct AsyncTextureLoader {
+	struct Request {
+		std::string path;
+		GLuint texture;
+		GLint layer;         // Of the GL_TEXTURE_2D_ARRAY texture
+		int width;           // Size the image is resampled to, 0 to keep its own
+		int height;
+		TextureImage *image; // NULL when decoding failed
+	};
+
+	struct UploadBuffer {
+		GLuint buffer;
+		size_t capacity;
+		GLsync fence;
+	};
+
+	AsyncTextureLoader();
+
+	// workerCount 0 picks one worker per spare hardware thread
+	void initialize(int workerCount = 0);
+	void cleanup();
+
+	// Fills one layer of arrayTexture, whose levels are width x height and 
+	// down, with path resampled to that size. The layer keeps its contents 
+	// until the upload completes.
+	void loadLayer(const char *path, GLuint arrayTexture, GLint layer, int width, int height);
+
+	// Uploads finished images, stopping once byteBudget bytes were copied in 
+	// this call (at least one image is uploaded if any is ready). Call once 
+	// per frame on the GL thread.
+	void update(size_t byteBudget = 32 * 1024 * 1024);
+
+	// Blocks until every requested texture has been uploaded
+	void finish();
+
+	bool idle();
+
+	bool initialized;
+	int outstanding; // Requests not uploaded yet (GL thread only)
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeWorkers;
+	std::condition_variable wakeLoader;
+	std::deque<Request> queued;   // Waiting for a worker
+	std::deque<Request> decoded;  // Waiting for the GL thread
+	bool stopping;
+
+	UploadBuffer buffers[TEXTURE_LOADER_BUFFERS];
+	int nextBuffer;
+
+private:
+	void enqueue(const Request &request);
+	void workerMain();
+	bool upload(Request &request, size_t &bytes);
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "vertex_format.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+static uint32_t packSigned10(float value)
+{
+	if (value > 1.0f) value = 1.0f;
+	if (value < -1.0f) value = -1.0f;
+	int component = (int)std::floor(value * 511.0f + 0.5f);
+	return (uint32_t)component & 0x3ff;
+}
+
+uint32_t PackNormal(float x, float y, float z)
+{
+	return packSigned10(x) | packSigned10(y) << 10 | packSigned10(z) << 20;
+}
+
+uint16_t PackHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xff);
+	uint32_t mantissa = bits & 0x7fffff;
+
+	// Infinity and NaN
+	if (exponent == 0xff) return (uint16_t)(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+
+	exponent += 15 - 127;
+	if (exponent >= 31) return (uint16_t)(sign | 0x7c00);
+
+	// Too small for a normal half: shift the implicit one into a subnormal
+	if (exponent <= 0) {
+		if (exponent < -10) return (uint16_t)sign;
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1))) half++;
+		return (uint16_t)(sign | half);
+	}
+
+	// A carry out of the mantissa correctly bumps the exponent
+	uint32_t half = (uint32_t)exponent << 10 | mantissa >> 13;
+	uint32_t remainder = mantissa & 0x1fff;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) half++;
+	return (uint16_t)(sign | half);
+}
+
+void SetPackedVertexLayout(MeshBlobSource &source)
+{
+	source.mesh.vertexStride = sizeof(PackedVertex);
+	source.mesh.attributeCount = 0;
+	source.addAttribute(0, 3, GL_FLOAT, false, offsetof(PackedVertex, position));
+	source.addAttribute(1, 1, GL_UNSIGNED_SHORT, false, offsetof(PackedVertex, material));
+	source.addAttribute(2, 4, GL_INT_2_10_10_10_REV, true, offsetof(PackedVertex, normal));
+	source.addAttribute(3, 2, GL_HALF_FLOAT, false, offsetof(PackedVertex, uv));
+}
+
+bool HasPackedVertexLayout(const MeshBlobMesh &mesh)
+{
+	MeshBlobSource packed("");
+	SetPackedVertexLayout(packed);
+	if (mesh.vertexStride != packed.mesh.vertexStride || mesh.attributeCount != packed.mesh.attributeCount) return false;
+	return memcmp(mesh.attributes, packed.mesh.attributes, mesh.attributeCount * sizeof(MeshBlobAttribute)) == 0;
+}
+
+static const MeshBlobAttribute *findAttribute(const MeshBlobMesh &mesh, uint32_t location)
+{
+	for (uint32_t i = 0; i < mesh.attributeCount; ++i) {
+		if (mesh.attributes[i].location == location) return &mesh.attributes[i];
+	}
+	return NULL;
+}
+
+bool PackVertices(const MeshRef &ref, std::vector<PackedVertex> &vertices)
+{
+	const MeshBlobMesh &mesh = *ref.mesh;
+	const MeshBlobAttribute *position = findAttribute(mesh, 0);
+	const MeshBlobAttribute *material = findAttribute(mesh, 1);
+	const MeshBlobAttribute *normal = findAttribute(mesh, 2);
+	const MeshBlobAttribute *uv = findAttribute(mesh, 3);
+	if (position == NULL || position->type != GL_FLOAT || position->components < 3) return false;
+
+	vertices.resize(mesh.vertexCount);
+	for (uint32_t i = 0; i < mesh.vertexCount; ++i) {
+		const unsigned char *source = ref.vertices + (size_t)i * mesh.vertexStride;
+		PackedVertex &vertex = vertices[i];
+		memcpy(vertex.position, source + position->offset, sizeof(vertex.position));
+
+		vertex.material = vertex.padding = 0;
+		if (material != NULL && material->type == GL_UNSIGNED_SHORT) {
+			memcpy(&vertex.material, source + material->offset, sizeof(vertex.material));
+		}
+
+		vertex.normal = 0;
+		if (normal != NULL && normal->type == GL_FLOAT && normal->components >= 3) {
+			float n[3];
+			memcpy(n, source + normal->offset, sizeof(n));
+			vertex.normal = PackNormal(n[0], n[1], n[2]);
+		} else if (normal != NULL && normal->type == GL_INT_2_10_10_10_REV) {
+			memcpy(&vertex.normal, source + normal->offset, sizeof(vertex.normal));
+		}
+
+		vertex.uv[0] = vertex.uv[1] = 0;
+		if (uv != NULL && uv->type == GL_FLOAT && uv->components >= 2) {
+			float t[2];
+			memcpy(t, source + uv->offset, sizeof(t));
+			vertex.uv[0] = PackHalf(t[0]);
+			vertex.uv[1] = PackHalf(t[1]);
+		} else if (uv != NULL && uv->type == GL_HALF_FLOAT && uv->components >= 2) {
+			memcpy(vertex.uv, source + uv->offset, sizeof(vertex.uv));
+		}
+	}
+	return true;
+}
@@ -0,0 +1,42 @@
+#ifndef _VERTEX_FORMAT_H_
+#define _VERTEX_FORMAT_H_
+
+#include "mesh_blob.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Packing of vertex attributes into the compact types GL 3.3 reads
+// natively, so meshes can store them at a fraction of the float size.
+
+// Packs a unit vector for a normalized GL_INT_2_10_10_10_REV attribute: 
+// x, y and z take 10 signed bits each from the low bits up, w is 0
+uint32_t PackNormal(float x, float y, float z);
+
+// IEEE 754 half precision, rounded to nearest even, for GL_HALF_FLOAT
+// attributes
+uint16_t PackHalf(float value);
+
+// The vertex layout of every mesh in the geometry arena (locations match
+// scene.vert), 24 bytes
+struct PackedVertex {
+	float position[3];  // location 0
+	uint16_t material;  // location 1, layer of the material array
+	uint16_t padding;
+	uint32_t normal;    // location 2, GL_INT_2_10_10_10_REV
+	uint16_t uv[2];     // location 3, GL_HALF_FLOAT
+};
+
+// Describes PackedVertex in source's stride and attribute table
+void SetPackedVertexLayout(MeshBlobSource &source);
+
+// True when mesh stores exactly PackedVertex
+bool HasPackedVertexLayout(const MeshBlobMesh &mesh);
+
+// Converts the vertices of ref to PackedVertex. Positions must be floats at 
+// location 0; normals (location 2) and UVs (location 3) may be floats or 
+// already packed, and are zero when missing, as is a material (location 1) 
+// not stored as GL_UNSIGNED_SHORT. False when there is no position.
+bool PackVertices(const MeshRef &ref, std::vector<PackedVertex> &vertices);
+
+#endif
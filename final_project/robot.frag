@@ -1,7 +1,30 @@
 #version 330 core
 
+in vec3 worldPosition;
+in vec3 worldNormal;
+in vec4 fragPosLightSpace;
+
 out vec4 FragColor; // Output color of the fragment
 
 void main() {
-    FragColor = vec4(1.0, 1.0, 1.0, 1.0);
-}
\ No newline at end of file
+    vec3 diffuseReflectance = baseColor.rgb / 3.14159;
+
+    // Double-sided materials are lit from whichever side faces the camera
+    vec3 N = normalize(gl_FrontFacing ? worldNormal : -worldNormal);
+    vec3 L = normalize(lightPosition - worldPosition);
+    float cosine = max(dot(N, L), 0.0);
+
+    float distance = length(lightPosition - worldPosition);
+    vec3 irradiance = lightIntensity / (0.6 * 3.14159 * distance * distance);
+
+    vec3 color = diffuseReflectance * cosine * irradiance;
+    color = color * calculateShadow(fragPosLightSpace);
+
+    // tone mapping
+    color = color / (1.0 + color);
+
+    // gamma correction
+    color = pow(color, vec3(1.0 / 2.2));
+
+    FragColor = vec4(color, baseColor.a);
+}
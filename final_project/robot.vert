@@ -1,9 +1,18 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec3 aNormal;
+layout (location = 3) in vec2 aUV;
 
-uniform mat4 uMVP;
+out vec3 worldPosition;
+out vec3 worldNormal;
+out vec4 fragPosLightSpace;
 
 void main() {
-    gl_Position = uMVP * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
+
+    // glTF node transforms may scale non-uniformly
+    worldPosition = (model * vec4(aPos, 1.0)).xyz;
+    worldNormal = transpose(inverse(mat3(model))) * aNormal;
+    fragPosLightSpace = lightSpaceMatrix * vec4(worldPosition, 1.0);
+}
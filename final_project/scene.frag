@@ -6,38 +6,12 @@ in vec3 worldNormal;
 in vec4 fragPosLightSpace;
 
 in vec2 uv; 
+flat in float material;
 
-uniform vec3 lightPosition;
-uniform vec3 lightIntensity;
-uniform sampler2D shadowMap;
-uniform mat4 lightSpaceMatrix;
-
-uniform sampler2D textureSampler;
+uniform sampler2DArray textureSampler; // The material array
 
 out vec4 finalColor;
 
-// Shadow bias to prevent acne
-const float bias = 0.005;
-
-// Function to calculate shadow factor
-float calculateShadow(vec4 fragPosLightSpace) {
-    // Perform perspective divide
-    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-
-    // Transform to [0, 1] range
-    projCoords = projCoords * 0.5 + 0.5;
-
-    if (projCoords.z > 1.0) return 1.0;
-
-    // Retrieve depth from shadow map
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
-    float currentDepth = projCoords.z;
-
-    // Compare depths and return shadow factor
-	float shadow = (currentDepth >= closestDepth + bias) ? 0.2 : 1.0;
-    return shadow;
-}
-
 void main()
 {
 	// TODO: lighting, tone mapping, gamma correction
@@ -65,7 +39,7 @@ void main()
 	// gamma correction
 	color = pow(color, vec3(1.0 / 2.2));
 
-	vec3 textureColor = texture(textureSampler, uv).rgb;
+	vec3 textureColor = texture(textureSampler, vec3(uv, material)).rgb;
 
 	finalColor = vec4(textureColor * color, 1.0);
 }
@@ -2,7 +2,7 @@
 
 // Input
 layout(location = 0) in vec3 vertexPosition;
-layout(location = 1) in vec3 vertexColor;
+layout(location = 1) in float vertexMaterial;
 layout(location = 2) in vec3 vertexNormal;
 layout(location = 3) in vec2 vertexUV;
 
@@ -14,18 +14,17 @@ out vec3 worldNormal;
 out vec4 fragPosLightSpace;
 
 out vec2 uv;
-
-uniform mat4 MVP;
-uniform mat4 lightSpaceMatrix;
+flat out float material; // Layer of the material array
 
 void main() {
     // Transform vertex
-    gl_Position =  MVP * vec4(vertexPosition, 1);
+    gl_Position = viewProjection * model * vec4(vertexPosition, 1);
     
-    // Pass vertex color to the fragment shader
-    color = vertexColor;
+    // Pass the color to the fragment shader
+    color = baseColor.rgb;
 
     uv = vertexUV;   
+    material = vertexMaterial;
 
     // World-space geometry 
     worldPosition = vertexPosition;
@@ -0,0 +1,118 @@
+#include "city.h"
+#include "scene_geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Buildings stay this far inside the background box (+-3500)
+static const float cityExtent = 3400.0f;
+
+// Kept free of generated buildings: the original buildings and the view
+// from the camera down to the robot
+static const float clearMin[2] = { -1700.0f, -700.0f };
+static const float clearMax[2] = { 1000.0f, 1300.0f };
+
+// World-space size of one repeat of each wall texture, matching the
+// original buildings
+static const float layerTileSize[CITY_LAYER_COUNT][2] = {
+	{ 1000.0f, 1600.0f / 3.0f },
+	{ 700.0f, 950.0f },
+};
+
+// xorshift32, so the city is the same with every standard library
+static unsigned int nextRandom(unsigned int &state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+// Uniform in [0, 1)
+static float randomUnit(unsigned int &state)
+{
+	return (nextRandom(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+static float repeats(float size, float tile)
+{
+	return std::max(1.0f, std::floor(size / tile + 0.5f));
+}
+
+static BuildingInstance makeBuilding(float x, float z, float yaw, float width, float height, float depth, int layer)
+{
+	BuildingInstance building;
+	memset(&building, 0, sizeof(building));
+	building.position[0] = x;
+	building.position[2] = z;
+	building.yaw = yaw;
+	building.size[0] = width;
+	building.size[1] = height;
+	building.size[2] = depth;
+	building.layer = (float)(SCENE_MATERIAL_BUILDING + layer);
+	building.uvScale[0] = repeats(std::max(width, depth), layerTileSize[layer][0]);
+	building.uvScale[1] = repeats(height, layerTileSize[layer][1]);
+	return building;
+}
+
+static bool overlapsClearing(float x, float z, float halfSize)
+{
+	return x + halfSize > clearMin[0] && x - halfSize < clearMax[0]
+		&& z + halfSize > clearMin[1] && z - halfSize < clearMax[1];
+}
+
+// Centres of the free grid cells for the given pitch
+static void freeCells(float pitch, std::vector<float> &cells)
+{
+	cells.clear();
+	int perSide = (int)(2.0f * cityExtent / pitch);
+	float start = -0.5f * perSide * pitch + 0.5f * pitch;
+	for (int i = 0; i < perSide; ++i) {
+		for (int j = 0; j < perSide; ++j) {
+			float x = start + i * pitch;
+			float z = start + j * pitch;
+			if (overlapsClearing(x, z, 0.5f * pitch)) continue;
+			cells.push_back(x);
+			cells.push_back(z);
+		}
+	}
+}
+
+void GenerateCity(int count, unsigned int seed, std::vector<BuildingInstance> &buildings)
+{
+	buildings.clear();
+	buildings.push_back(makeBuilding(300.0f, 0.0f, 0.0f, 1000.0f, 1600.0f, 1000.0f, 0));
+	buildings.push_back(makeBuilding(-1200.0f, 0.0f, 0.0f, 700.0f, 1900.0f, 700.0f, 1));
+	if (count <= 0) return;
+
+	// One building per grid cell; shrink the grid until there are enough cells
+	float clearArea = (clearMax[0] - clearMin[0]) * (clearMax[1] - clearMin[1]);
+	float pitch = std::sqrt((4.0f * cityExtent * cityExtent - clearArea) / count);
+	std::vector<float> cells;
+	for (freeCells(pitch, cells); (int)cells.size() / 2 < count; freeCells(pitch, cells)) {
+		pitch *= 0.95f;
+	}
+
+	unsigned int state = seed != 0 ? seed : 1;
+
+	// Partial Fisher-Yates shuffle picks which cells get a building
+	int cellCount = (int)cells.size() / 2;
+	for (int i = 0; i < count; ++i) {
+		int pick = i + (int)(nextRandom(state) % (unsigned int)(cellCount - i));
+		std::swap(cells[i * 2], cells[pick * 2]);
+		std::swap(cells[i * 2 + 1], cells[pick * 2 + 1]);
+
+		// Footprints leave streets between the cells; a few towers are much taller
+		float width = pitch * (0.5f + 0.3f * randomUnit(state));
+		float depth = pitch * (0.5f + 0.3f * randomUnit(state));
+		float tall = randomUnit(state);
+		float height = std::min(6500.0f, std::max(width, depth) * (1.0f + 5.0f * tall * tall * tall));
+		float slack = pitch - std::max(width, depth);
+		float x = cells[i * 2] + (randomUnit(state) - 0.5f) * slack;
+		float z = cells[i * 2 + 1] + (randomUnit(state) - 0.5f) * slack;
+		float yaw = (nextRandom(state) % 4) * 1.5707963f;
+		int layer = (int)(nextRandom(state) % CITY_LAYER_COUNT);
+		buildings.push_back(makeBuilding(x, z, yaw, width, height, depth, layer));
+	}
+}
@@ -0,0 +1,17 @@
+#ifndef _CITY_H_
+#define _CITY_H_
+
+#include <render/building_batch.h>
+
+#include <vector>
+
+// Wall textures the generated buildings choose from (building1.png, building2.png)
+#define CITY_LAYER_COUNT 2
+
+// Lays out the city: the two original buildings, then count generated ones
+// on a street grid inside the ground square. The area around the camera,
+// the robot and the original buildings stays clear. The same seed always
+// gives the same city.
+void GenerateCity(int count, unsigned int seed, std::vector<BuildingInstance> &buildings);
+
+#endif
@@ -0,0 +1,41 @@
+#include "fly_camera.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+
+CameraInput::CameraInput() : forward(0.0f), right(0.0f), yaw(0.0f), pitch(0.0f)
+{
+}
+
+FlyCamera::FlyCamera(const glm::vec3 &position, float yaw, float pitch, float speed)
+	: position(position), yaw(yaw), pitch(pitch), speed(speed)
+{
+}
+
+void FlyCamera::update(const CameraInput &input, float seconds)
+{
+	yaw += input.yaw;
+	pitch += input.pitch;
+	yaw = fmodf(yaw, 360.0f);
+	pitch = glm::clamp(pitch, -89.0f, 89.0f);
+
+	// Movement stays horizontal whatever the pitch, and diagonals are no faster
+	glm::vec3 ahead = front();
+	ahead.y = 0.0f;
+	ahead = glm::normalize(ahead);
+	glm::vec3 side = glm::normalize(glm::cross(ahead, glm::vec3(0.0f, 1.0f, 0.0f)));
+	glm::vec3 move = ahead * input.forward + side * input.right;
+	if (glm::dot(move, move) > 0.0f) position += glm::normalize(move) * speed * seconds;
+}
+
+glm::vec3 FlyCamera::front() const
+{
+	float y = glm::radians(yaw), p = glm::radians(pitch);
+	return glm::normalize(glm::vec3(cos(y) * cos(p), sin(p), sin(y) * cos(p)));
+}
+
+glm::mat4 FlyCamera::viewMatrix() const
+{
+	return glm::lookAt(position, position + front(), glm::vec3(0.0f, 1.0f, 0.0f));
+}
@@ -0,0 +1,35 @@
+#ifndef _FLY_CAMERA_H_
+#define _FLY_CAMERA_H_
+
+#include <glm/glm.hpp>
+
+// The input that moves the camera, sampled once per frame: held movement
+// keys as axes and how far the mouse moved since the previous sample.
+struct CameraInput {
+	float forward; // 1 forward, -1 backward
+	float right;   // 1 right, -1 left
+	float yaw;     // Mouse movement in degrees since the last sample
+	float pitch;
+
+	CameraInput();
+};
+
+// A first-person camera that flies level with the ground. Movement is
+// integrated over the time between samples, so its speed does not depend
+// on the frame rate or on the keyboard's repeat rate.
+struct FlyCamera {
+	glm::vec3 position;
+	float yaw;   // Degrees, -90 looks down -z
+	float pitch; // Degrees, kept within +-89 so the view never flips
+	float speed; // Units per second
+
+	FlyCamera(const glm::vec3 &position = glm::vec3(0.0f), float yaw = -90.0f, float pitch = 0.0f, float speed = 2000.0f);
+
+	// Turns by the input's mouse movement, then moves along the new heading
+	void update(const CameraInput &input, float seconds);
+
+	glm::vec3 front() const;
+	glm::mat4 viewMatrix() const;
+};
+
+#endif
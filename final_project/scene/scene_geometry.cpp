@@ -0,0 +1,498 @@
+#include "scene_geometry.h"
+
+#include <render/vertex_format.h>
+
+#include <cstddef>
+#include <vector>
+
+// Ground and background box
+const float groundVertexData[72] = {
+	// Ground and Background
+    -3500.0f, 0.0f, -3500.0f,  // Bottom-left
+	3500.0f, 0.0f, -3500.0f,   // Bottom-right
+     	3500.0f, 0.0f,  3500.0f,  // Top-right
+	-3500.0f, 0.0f,  3500.0f,  // Top-left
+
+	// Top face
+	-3500.0f, 7000.0f, -3500.0f,  // Bottom-left
+	-3500.0f, 7000.0f,  3500.0f,  // Top-left
+	3500.0f, 7000.0f,  3500.0f,  // Top-right
+	3500.0f, 7000.0f, -3500.0f,  // Bottom-right
+
+	// Front face
+	-3500.0f, 0.0f,  3500.0f,  // Bottom-left
+	-3500.0f, 7000.0f,  3500.0f,  // Top-left
+	3500.0f, 7000.0f,  3500.0f,  // Top-right
+	3500.0f, 0.0f,  3500.0f,  // Bottom-right
+
+	// Back face
+	-3500.0f, 0.0f, -3500.0f,  // Bottom-left
+	-3500.0f, 7000.0f, -3500.0f,  // Top-left
+	3500.0f, 7000.0f, -3500.0f,  // Top-right
+	3500.0f, 0.0f, -3500.0f,  // Bottom-right
+
+	// Left face
+	-3500.0f, 0.0f, -3500.0f,  // Bottom-left
+	-3500.0f, 7000.0f, -3500.0f,  // Top-left
+	-3500.0f, 7000.0f,  3500.0f,  // Top-right
+	-3500.0f, 0.0f,  3500.0f,  // Bottom-right
+
+	// Right face
+	3500.0f, 0.0f, -3500.0f,  // Bottom-left
+	3500.0f, 7000.0f, -3500.0f,  // Top-left
+	3500.0f, 7000.0f,  3500.0f,  // Top-right
+	3500.0f, 0.0f,  3500.0f,  // Bottom-right
+
+};
+
+const float groundNormalData[72] = {
+	// Ground and background
+	// Floor
+	0.0, 1.0, 0.0,
+	0.0, 1.0, 0.0,
+	0.0, 1.0, 0.0,
+	0.0, 1.0, 0.0,
+
+	// Ceiling
+	0.0f, -1.0f, 0.0f,  // Bottom-left
+	0.0f, -1.0f, 0.0f,  // Top-left
+	0.0f, -1.0f, 0.0f,  // Top-right
+	0.0f, -1.0f, 0.0f,  // Bottom-right
+
+	// Front face
+	0.0f, 0.0f, -1.0f,   // Bottom-left
+	0.0f, 0.0f, -1.0f,   // Top-left
+	0.0f, 0.0f, -1.0f,   // Top-right
+	0.0f, 0.0f, -1.0f,   // Bottom-right
+
+	// Back face
+	0.0f, 0.0f, 1.0f,  // Bottom-left
+	0.0f, 0.0f, 1.0f,  // Top-left
+	0.0f, 0.0f, 1.0f,  // Top-right
+	0.0f, 0.0f, 1.0f,  // Bottom-right
+
+	// Left face
+	1.0f, 0.0f, 0.0f,  // Bottom-left
+	1.0f, 0.0f, 0.0f,  // Top-left
+	1.0f, 0.0f, 0.0f,  // Top-right
+	1.0f, 0.0f, 0.0f,  // Bottom-right
+
+	// Right face
+	-1.0f, 0.0f, 0.0f,   // Bottom-left
+	-1.0f, 0.0f, 0.0f,   // Top-left
+	-1.0f, 0.0f, 0.0f,   // Top-right
+	-1.0f, 0.0f, 0.0f,   // Bottom-right
+
+};
+
+const unsigned int groundIndexData[36] = {
+	// ground and background
+	// Botton
+	2, 1, 0,
+	3, 2, 0,
+
+	// Top face
+	6, 5, 4,
+	7, 6, 4,
+
+	// Front face
+	8, 9, 10,
+	8, 10, 11,
+
+	// Back face
+	14, 13, 12,
+	15, 14, 12,
+
+	// Left face
+	16, 17, 18,
+	16, 18, 19,
+
+	// Right face
+	22, 21, 20,
+	23, 22, 20,
+
+};
+
+const float groundUVData[48] = {
+	8.0f,  8.0f,    // Top-right
+	0.0f,  8.0f,    // Top-left
+	0.0f,  0.0f,    // Bottom-left
+	8.0f,  0.0f,    // Bottom-right
+
+	0.5f,  0.333f,  // Top-right
+	0.25f, 0.333f,  // Top-left
+	0.25f, 0.0f,    // Bottom-left
+	0.5f,  0.0f,    // Bottom-right
+
+	0.25f, 0.666f,  // Top-right
+	0.25f, 0.333f,  // Bottom-right
+	0.0f,  0.333f,  // Bottom-left
+	0.0f,  0.666f,  // Top-left
+
+	0.5f,  0.666f,  // Top-left
+	0.5f,  0.333f,  // Bottom-left
+	0.75f, 0.333f,  // Bottom-right
+	0.75f, 0.666f,  // Top-right y
+
+	0.5f,  0.666f,  // Top-right
+	0.5f,  0.333f,  // Bottom-right
+	0.25f, 0.333f,  // Bottom-left
+	0.25f, 0.666f,  // Top-left y
+
+	0.75f, 0.666f,  // Top-left
+	0.75f, 0.333f,  // Bottom-left
+	1.0f,  0.333f,  // Bottom-right
+	1.0f,  0.666f,  // Top-right y
+
+};
+
+// Unit building box: footprint [-0.5, 0.5] in x and z, height [0, 1], no 
+// bottom face. Instances scale it to their size (see building.vert).
+const float buildingVertexData[60] = {
+	// Top face
+	-0.5f, 1.0f,  0.5f,
+	 0.5f, 1.0f,  0.5f,
+	 0.5f, 1.0f, -0.5f,
+	-0.5f, 1.0f, -0.5f,
+
+	// Front face
+	-0.5f, 0.0f,  0.5f,
+	 0.5f, 0.0f,  0.5f,
+	 0.5f, 1.0f,  0.5f,
+	-0.5f, 1.0f,  0.5f,
+
+	// Back face
+	 0.5f, 0.0f, -0.5f,
+	-0.5f, 0.0f, -0.5f,
+	-0.5f, 1.0f, -0.5f,
+	 0.5f, 1.0f, -0.5f,
+
+	// Left face
+	-0.5f, 0.0f, -0.5f,
+	-0.5f, 0.0f,  0.5f,
+	-0.5f, 1.0f,  0.5f,
+	-0.5f, 1.0f, -0.5f,
+
+	// Right face
+	 0.5f, 0.0f,  0.5f,
+	 0.5f, 0.0f, -0.5f,
+	 0.5f, 1.0f, -0.5f,
+	 0.5f, 1.0f,  0.5f,
+};
+
+const float buildingNormalData[60] = {
+	0.0f, 1.0f, 0.0f,
+	0.0f, 1.0f, 0.0f,
+	0.0f, 1.0f, 0.0f,
+	0.0f, 1.0f, 0.0f,
+
+	0.0f, 0.0f, 1.0f,
+	0.0f, 0.0f, 1.0f,
+	0.0f, 0.0f, 1.0f,
+	0.0f, 0.0f, 1.0f,
+
+	0.0f, 0.0f, -1.0f,
+	0.0f, 0.0f, -1.0f,
+	0.0f, 0.0f, -1.0f,
+	0.0f, 0.0f, -1.0f,
+
+	-1.0f, 0.0f, 0.0f,
+	-1.0f, 0.0f, 0.0f,
+	-1.0f, 0.0f, 0.0f,
+	-1.0f, 0.0f, 0.0f,
+
+	1.0f, 0.0f, 0.0f,
+	1.0f, 0.0f, 0.0f,
+	1.0f, 0.0f, 0.0f,
+	1.0f, 0.0f, 0.0f,
+};
+
+const unsigned int buildingIndexData[30] = {
+	0, 1, 2,
+	0, 2, 3,
+
+	4, 5, 6,
+	4, 6, 7,
+
+	8, 9, 10,
+	8, 10, 11,
+
+	12, 13, 14,
+	12, 14, 15,
+
+	16, 17, 18,
+	16, 18, 19,
+};
+
+// Wall UVs span the texture once; building.vert repeats them per instance. 
+// The roof samples a small corner of the texture.
+const float buildingUVData[40] = {
+	0.0f, 0.1f,
+	0.1f, 0.1f,
+	0.1f, 0.0f,
+	0.0f, 0.0f,
+
+	0.0f, 1.0f,
+	1.0f, 1.0f,
+	1.0f, 0.0f,
+	0.0f, 0.0f,
+
+	0.0f, 1.0f,
+	1.0f, 1.0f,
+	1.0f, 0.0f,
+	0.0f, 0.0f,
+
+	0.0f, 1.0f,
+	1.0f, 1.0f,
+	1.0f, 0.0f,
+	0.0f, 0.0f,
+
+	0.0f, 1.0f,
+	1.0f, 1.0f,
+	1.0f, 0.0f,
+	0.0f, 0.0f,
+};
+
+// The UFO, a box rotating about the y axis
+const float ufoVertexData[72] = {
+	// Front face
+	2000.0f, 1400.0f,  200.0f,  // Bottom-left
+	2400.0f, 1400.0f,  200.0f,  // Bottom-right
+	2400.0f, 1800.0f, 200.0f,  // Top-right
+	2000.0f, 1800.0f, 200.0f,  // Top-left
+
+	// Back face
+	2000.0f, 1400.0f, -200.0f,  // Bottom-left
+	2400.0f, 1400.0f, -200.0f,  // Bottom-right
+	2400.0f, 1800.0f, -200.0f, // Top-right
+	2000.0f, 1800.0f, -200.0f, // Top-left
+
+	// Left face
+	2000.0f, 1400.0f, -200.0f,  // Bottom-left
+	2000.0f, 1400.0f,  200.0f,  // Bottom-right
+	2000.0f, 1800.0f, 200.0f,  // Top-right
+	2000.0f, 1800.0f, -200.0f, // Top-left
+
+	// Right face
+	2400.0f, 1400.0f, -200.0f,  // Bottom-left
+	2400.0f, 1400.0f,  200.0f,  // Bottom-right
+	2400.0f, 1800.0f, 200.0f,  // Top-right
+	2400.0f, 1800.0f, -200.0f, // Top-left
+
+	// Top face
+	2000.0f, 1800.0f, 200.0f,  // Bottom-left
+	2400.0f, 1800.0f, 200.0f,  // Bottom-right
+	2400.0f, 1800.0f, -200.0f, // Top-right
+	2000.0f, 1800.0f, -200.0f, // Top-left
+
+	// Bottom face
+	2000.0f, 1400.0f, 200.0f,   // Bottom-left
+	2400.0f, 1400.0f, 200.0f,   // Bottom-right
+	2400.0f, 1400.0f, -200.0f,  // Top-right
+	2000.0f, 1400.0f, -200.0f   // Top-left
+};
+
+const float ufoNormalData[72] = {
+	// Front face (facing +Z)
+	0.0f, 0.0f,  -1.0f,  // Bottom-left
+	0.0f, 0.0f,  -1.0f,  // Bottom-right
+	0.0f, 0.0f,  -1.0f,  // Top-right
+	0.0f, 0.0f,  -1.0f,  // Top-left
+
+	// Back face (facing -Z)
+	0.0f, 0.0f, -1.0f,  // Bottom-left
+	0.0f, 0.0f, -1.0f,  // Bottom-right
+	0.0f, 0.0f, -1.0f,  // Top-right
+	0.0f, 0.0f, -1.0f,  // Top-left
+
+	// Left face (facing -X)
+	-1.0f, 0.0f, 0.0f,  // Bottom-left
+	-1.0f, 0.0f, 0.0f,  // Bottom-right
+	-1.0f, 0.0f, 0.0f,  // Top-right
+	-1.0f, 0.0f, 0.0f,  // Top-left
+
+	// Right face (facing +X)
+	-1.0f, 0.0f, 0.0f,   // Bottom-left
+	-1.0f, 0.0f, 0.0f,   // Bottom-right
+	-1.0f, 0.0f, 0.0f,   // Top-right
+	-1.0f, 0.0f, 0.0f,   // Top-left
+
+	// Top face (facing +Y)
+	0.0f, -1.0f, 0.0f,   // Bottom-left
+	0.0f, -1.0f, 0.0f,   // Bottom-right
+	0.0f, -1.0f, 0.0f,   // Top-right
+	0.0f, -1.0f, 0.0f,   // Top-left
+
+	// Bottom face (facing -Y)
+	0.0f, 1.0f, 0.0f,  // Bottom-left
+	0.0f, 1.0f, 0.0f,  // Bottom-right
+	0.0f, 1.0f, 0.0f,  // Top-right
+	0.0f, 1.0f, 0.0f   // Top-left
+};
+
+const unsigned int ufoIndexData[96] = {
+	// Front face (+Z)
+	0, 1, 2,  // First triangle
+	0, 2, 3,  // Second triangle
+
+	// Back face (-Z)
+	6, 5, 4,  // First triangle
+	7, 6, 4,  // Second triangle y
+
+	// Left face (-X)
+	8, 9, 10,  // First triangle
+	8, 10, 11, // Second triangle y
+
+	// Right face (+X)
+	14, 13, 12, // First triangle
+	15, 14, 12, // Second triangle
+
+	// Top face (+Y)
+	16, 17, 18, // First triangle
+	16, 18, 19, // Second triangle
+
+	// Bottom face (-Y)
+	22, 21, 20, // First triangle
+	23, 22, 20  // Second triangle
+};
+
+const float ufoUVData[128] = {
+	// Front face (+Z)
+	0.0f, 0.0f,  // Bottom-left
+	1.0f, 0.0f,  // Bottom-right
+	1.0f, 1.0f,  // Top-right
+	0.0f, 1.0f,  // Top-left
+
+	// Back face (-Z)
+	0.0f, 0.0f,  // Bottom-left
+	1.0f, 0.0f,  // Bottom-right
+	1.0f, 1.0f,  // Top-right
+	0.0f, 1.0f,  // Top-left
+
+	// Left face (-X)
+	0.0f, 0.0f,  // Bottom-left
+	1.0f, 0.0f,  // Bottom-right
+	1.0f, 1.0f,  // Top-right
+	0.0f, 1.0f,  // Top-left
+
+	// Right face (+X)
+	0.0f, 0.0f,  // Bottom-left
+	1.0f, 0.0f,  // Bottom-right
+	1.0f, 1.0f,  // Top-right
+	0.0f, 1.0f,  // Top-left
+
+	// Top face (+Y)
+	0.0f, 0.0f,  // Bottom-left
+	0.1f, 0.0f,  // Bottom-right
+	0.1f, 0.1f,  // Top-right
+	0.0f, 0.1f,  // Top-left
+
+	// Bottom face (-Y)
+	0.0f, 0.0f,  // Bottom-left
+	0.1f, 0.0f,  // Bottom-right
+	0.1f, 0.1f,  // Top-right
+	0.0f, 0.1f   // Top-left
+};
+
+// Interleaves and packs vertexCount vertices. Vertices past the end of the 
+// UV array get (0, 0).
+static void buildMesh(MeshBlobSource &source, const float *positions, const float *normals, const float *uvs, 
+	size_t vertexCount, size_t uvCount, const unsigned int *indices, size_t indexCount)
+{
+	std::vector<PackedVertex> vertices(vertexCount);
+	for (int k = 0; k < 3; ++k) {
+		source.mesh.boundsMin[k] = positions[k];
+		source.mesh.boundsMax[k] = positions[k];
+	}
+	for (size_t i = 0; i < vertexCount; ++i) {
+		PackedVertex &vertex = vertices[i];
+		vertex.material = vertex.padding = 0;
+		for (int k = 0; k < 3; ++k) {
+			vertex.position[k] = positions[i * 3 + k];
+			if (vertex.position[k] < source.mesh.boundsMin[k]) source.mesh.boundsMin[k] = vertex.position[k];
+			if (vertex.position[k] > source.mesh.boundsMax[k]) source.mesh.boundsMax[k] = vertex.position[k];
+		}
+		vertex.normal = PackNormal(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+		vertex.uv[0] = PackHalf(i < uvCount ? uvs[i * 2] : 0.0f);
+		vertex.uv[1] = PackHalf(i < uvCount ? uvs[i * 2 + 1] : 0.0f);
+	}
+
+	// The built-in meshes are small enough for 16-bit indices
+	std::vector<unsigned short> shortIndices(indices, indices + indexCount);
+
+	source.vertices.assign((const unsigned char *)vertices.data(), (const unsigned char *)(vertices.data() + vertices.size()));
+	source.indices.assign((const unsigned char *)shortIndices.data(), (const unsigned char *)(shortIndices.data() + shortIndices.size()));
+	source.mesh.vertexCount = (uint32_t)vertexCount;
+	source.mesh.indexCount = (uint32_t)indexCount;
+	source.mesh.indexType = GL_UNSIGNED_SHORT;
+	SetPackedVertexLayout(source);
+}
+
+// Adds a draw range and assigns material to the vertices it draws
+static void addRange(MeshBlobSource &source, uint32_t firstIndex, uint32_t indexCount, uint16_t material)
+{
+	const unsigned short *indices = (const unsigned short *)source.indices.data();
+	PackedVertex *vertices = (PackedVertex *)source.vertices.data();
+	for (uint32_t i = firstIndex; i < firstIndex + indexCount; ++i) vertices[indices[i]].material = material;
+
+	MeshBlobRange range;
+	range.mode = GL_TRIANGLES;
+	range.firstIndex = firstIndex;
+	range.indexCount = indexCount;
+	range.flags = 0;
+	for (int k = 0; k < 4; ++k) range.baseColor[k] = 1.0f;
+	source.addRange(range);
+}
+
+void BuildGroundMesh(MeshBlobSource &source)
+{
+	source = MeshBlobSource("ground");
+	buildMesh(source, groundVertexData, groundNormalData, groundUVData, 24, 24, groundIndexData, 36);
+	addRange(source, 0, 6, SCENE_MATERIAL_ROAD);  // GROUND_RANGE_GROUND
+	addRange(source, 6, 30, SCENE_MATERIAL_SKY);  // GROUND_RANGE_BACKGROUND
+}
+
+void BuildBuildingMesh(MeshBlobSource &source)
+{
+	source = MeshBlobSource("building");
+	buildMesh(source, buildingVertexData, buildingNormalData, buildingUVData, 20, 20, buildingIndexData, 30);
+	addRange(source, 0, 30, SCENE_MATERIAL_BUILDING); // building.vert takes the instance's
+}
+
+void BuildUFOMesh(MeshBlobSource &source)
+{
+	source = MeshBlobSource("ufo");
+	buildMesh(source, ufoVertexData, ufoNormalData, ufoUVData, 24, 64, ufoIndexData, 36);
+	addRange(source, 0, 36, SCENE_MATERIAL_UFO);
+}
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+{
+	// FNV-1a
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+uint64_t SceneGeometryHash()
+{
+	// Blobs baked with another vertex layout are rebuilt too
+	uint32_t layout[2] = { SCENE_VERTEX_FORMAT, (uint32_t)sizeof(PackedVertex) };
+	uint64_t hash = hashBytes(14695981039346656037ull, layout, sizeof(layout));
+	hash = hashBytes(hash, groundVertexData, sizeof(groundVertexData));
+	hash = hashBytes(hash, groundNormalData, sizeof(groundNormalData));
+	hash = hashBytes(hash, groundIndexData, sizeof(groundIndexData));
+	hash = hashBytes(hash, groundUVData, sizeof(groundUVData));
+	hash = hashBytes(hash, buildingVertexData, sizeof(buildingVertexData));
+	hash = hashBytes(hash, buildingNormalData, sizeof(buildingNormalData));
+	hash = hashBytes(hash, buildingIndexData, sizeof(buildingIndexData));
+	hash = hashBytes(hash, buildingUVData, sizeof(buildingUVData));
+	hash = hashBytes(hash, ufoVertexData, sizeof(ufoVertexData));
+	hash = hashBytes(hash, ufoNormalData, sizeof(ufoNormalData));
+	hash = hashBytes(hash, ufoIndexData, sizeof(ufoIndexData));
+	hash = hashBytes(hash, ufoUVData, sizeof(ufoUVData));
+	return hash;
+}
@@ -0,0 +1,58 @@
+#ifndef _SCENE_GEOMETRY_H_
+#define _SCENE_GEOMETRY_H_
+
+#include <render/mesh_blob.h>
+#include "city.h"
+
+// Hand-authored geometry of the ground, the building box and the UFO. The renderer builds 
+// its meshes from these arrays only when baked/scene.mesh is missing; 
+// tools/asset_bake bakes them into that file.
+
+// Bumped whenever the built-in meshes' vertex layout (PackedVertex) or 
+// their materials change, so SceneGeometryHash changes with it. Their color 
+// is constant and comes from the draw range's baseColor uniform.
+#define SCENE_VERTEX_FORMAT 3
+
+// Layers of the scene's material array. The built-in meshes store theirs 
+// per vertex, the buildings per instance.
+enum SceneMaterial {
+	SCENE_MATERIAL_ROAD,
+	SCENE_MATERIAL_SKY,
+	SCENE_MATERIAL_BUILDING, // CITY_LAYER_COUNT wall textures
+	SCENE_MATERIAL_UFO = SCENE_MATERIAL_BUILDING + CITY_LAYER_COUNT,
+	SCENE_MATERIAL_COUNT
+};
+
+extern const float groundVertexData[72];
+extern const float groundNormalData[72];
+extern const unsigned int groundIndexData[36];
+extern const float groundUVData[48];
+
+extern const float buildingVertexData[60];
+extern const float buildingNormalData[60];
+extern const unsigned int buildingIndexData[30];
+extern const float buildingUVData[40];
+
+extern const float ufoVertexData[72];
+extern const float ufoNormalData[72];
+extern const unsigned int ufoIndexData[96];
+extern const float ufoUVData[128];
+
+// Draw ranges of the ground mesh, one per material. They are adjacent, so 
+// both can go in one draw.
+enum GroundRange {
+	GROUND_RANGE_GROUND,
+	GROUND_RANGE_BACKGROUND,
+	GROUND_RANGE_COUNT
+};
+
+// Interleaves the arrays into meshes named "ground", "building" and "ufo"
+void BuildGroundMesh(MeshBlobSource &source);
+void BuildBuildingMesh(MeshBlobSource &source);
+void BuildUFOMesh(MeshBlobSource &source);
+
+// Hash of all the arrays above, recorded in baked/scene.mesh so that a blob 
+// baked from older geometry is rebuilt instead of used
+uint64_t SceneGeometryHash();
+
+#endif
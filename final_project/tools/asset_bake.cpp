@@ -0,0 +1,108 @@
+// Offline converter from the scene's source geometry to GPU-ready mesh blobs 
+// (see render/mesh_blob.h). Bakes the built-in ground, building and UFO meshes into 
+// OUTPUT_DIR/scene.mesh and every given .gltf model into OUTPUT_DIR/<name>.mesh.
+//
+//     asset_bake OUTPUT_DIR [MODEL.gltf ...]
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <tiny_gltf.h>
+
+#include <render/gltf_mesh.h>
+#include <render/mesh_blob.h>
+#include <scene/scene_geometry.h>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+static void makeDirectory(const std::string &path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+// "model/Robot_dog.gltf" -> "Robot_dog"
+static std::string baseName(const std::string &path)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+static size_t blobBytes(const std::vector<MeshBlobSource> &meshes)
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < meshes.size(); ++i) bytes += meshes[i].vertices.size() + meshes[i].indices.size();
+	return bytes;
+}
+
+static bool bakeScene(const std::string &directory)
+{
+	std::vector<MeshBlobSource> meshes(3, MeshBlobSource(""));
+	BuildGroundMesh(meshes[0]);
+	BuildBuildingMesh(meshes[1]);
+	BuildUFOMesh(meshes[2]);
+
+	std::string path = directory + "/scene.mesh";
+	if (!WriteMeshBlob(path.c_str(), meshes, std::vector<MeshBlobInstance>(), NULL, SceneGeometryHash())) {
+		std::cerr << "Failed to write " << path << std::endl;
+		return false;
+	}
+	std::cout << path << ": " << meshes.size() << " meshes, " << blobBytes(meshes) << " bytes of vertex and index data" << std::endl;
+	return true;
+}
+
+static bool bakeModel(const std::string &directory, const std::string &modelPath)
+{
+	std::vector<GLTFMeshData> data;
+	std::vector<GLTFMeshInstance> instances;
+	if (!LoadGLTFMeshData(modelPath, data, instances)) return false;
+
+	std::vector<MeshBlobSource> meshes(data.size(), MeshBlobSource(""));
+	for (size_t i = 0; i < data.size(); ++i) BuildGLTFMeshSource(data[i], meshes[i]);
+
+	std::vector<MeshBlobInstance> blobInstances(instances.size());
+	for (size_t i = 0; i < instances.size(); ++i) {
+		memset(&blobInstances[i], 0, sizeof(MeshBlobInstance));
+		blobInstances[i].mesh = (uint32_t)instances[i].mesh;
+		memcpy(blobInstances[i].transform, &instances[i].transform[0][0], sizeof(blobInstances[i].transform));
+	}
+
+	std::string path = directory + "/" + baseName(modelPath) + ".mesh";
+	if (!WriteMeshBlob(path.c_str(), meshes, blobInstances, modelPath.c_str())) {
+		std::cerr << "Failed to write " << path << std::endl;
+		return false;
+	}
+	std::cout << path << ": " << meshes.size() << " meshes, " << blobInstances.size() << " instances, " 
+		<< blobBytes(meshes) << " bytes of vertex and index data" << std::endl;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		std::cerr << "Usage: asset_bake OUTPUT_DIR [MODEL.gltf ...]" << std::endl;
+		return 1;
+	}
+
+	std::string directory = argv[1];
+	makeDirectory(directory);
+
+	bool ok = bakeScene(directory);
+	for (int i = 2; i < argc; ++i) {
+		ok = bakeModel(directory, argv[i]) && ok;
+	}
+	return ok ? 0 : 1;
+}